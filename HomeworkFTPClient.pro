@@ -2,7 +2,7 @@ QT       += core gui
 
 greaterThan(QT_MAJOR_VERSION, 4): QT += widgets
 
-CONFIG += c++11
+CONFIG += c++17
 
 # The following define makes your compiler emit warnings if you use
 # any Qt feature that has been marked deprecated (the exact warnings
@@ -15,30 +15,69 @@ DEFINES += QT_DEPRECATED_WARNINGS
 # You can also select to disable deprecated APIs only up to a certain version of Qt.
 #DEFINES += QT_DISABLE_DEPRECATED_BEFORE=0x060000    # disables all the APIs deprecated before Qt 6.0.0
 
+# Winsock is only needed on Windows; other platforms use BSD sockets from libc
 # "Ws2_32.lib" in MSVC, "libws2_32.a" in MinGW
-LIBS += -lws2_32
+win32: LIBS += -lws2_32
+# "Mswsock.lib" in MSVC, "libmswsock.a" in MinGW, for TransmitFile()
+win32: LIBS += -lmswsock
+# zlib, for MODE Z compressed data connections
+LIBS += -lz
 
 SOURCES += \
+    src/BufferPool.cpp \
+    src/Checksum.cpp \
+    src/CommandPipeline.cpp \
+    src/CommandSequence.cpp \
+    src/Deflate.cpp \
+    src/IoUring.cpp \
     src/ListTask.cpp \
+    src/RateLimiter.cpp \
+    src/Reactor.cpp \
+    src/Resolver.cpp \
+    src/ServerCapabilities.cpp \
+    src/SessionPool.cpp \
+    src/Socket.cpp \
+    src/TransferProgress.cpp \
+    src/TransferScheduler.cpp \
+    src/LocalFile.cpp \
     src/MyUtils.cpp \
     src/UploadFileTask.cpp \
     src/main.cpp \
     src/mainwindow.cpp \
     src/FTPSession.cpp \
     src/FTPFunction.cpp \
+    src/FtpReply.cpp \
     src/test_z.cpp \
-    src/DownloadFileTask.cpp
+    src/DownloadFileTask.cpp \
+    src/DownloadSegmentTask.cpp
 
 HEADERS += \
+    include/BufferPool.h \
+    include/Checksum.h \
+    include/CommandPipeline.h \
+    include/CommandSequence.h \
+    include/Deflate.h \
+    include/IoUring.h \
     include/ListTask.h \
+    include/RateLimiter.h \
+    include/Reactor.h \
+    include/Resolver.h \
+    include/ServerCapabilities.h \
+    include/LocalFile.h \
     include/MyUtils.h \
     include/RunAsyncAwait.h \
     include/UploadFileTask.h \
     include/mainwindow.h \
     include/ScopeGuard.h \
+    include/SessionPool.h \
+    include/Socket.h \
+    include/TransferProgress.h \
+    include/TransferScheduler.h \
     include/FTPSession.h \
     include/FTPFunction.h \
-    include/DownloadFileTask.h
+    include/FtpReply.h \
+    include/DownloadFileTask.h \
+    include/DownloadSegmentTask.h
 
 FORMS += \
     ui/mainwindow.ui
@@ -0,0 +1,104 @@
+//进程内共享的传输缓冲区池
+#ifndef BUFFER_POOL_H
+#define BUFFER_POOL_H
+
+#include <cstddef>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+namespace utils
+{
+
+    /**
+     * @brief 按页对齐的缓冲区池
+     * @author zhb
+     *
+     * 同时进行或先后进行的传输任务复用同一批缓冲区，
+     * 不必每次传输都重新分配内存、清零
+     */
+    class BufferPool
+    {
+    public:
+        //对齐到内存页
+        static const std::size_t ALIGNMENT = 4096;
+        //每种大小最多缓存的空闲缓冲区个数
+        static const std::size_t MAX_IDLE_PER_SIZE = 8;
+
+        /**
+         * @brief 从池中借出的缓冲区，析构时自动归还
+         */
+        class Buffer
+        {
+        public:
+            Buffer() : pool(nullptr), ptr(nullptr), len(0) {}
+            Buffer(Buffer &&other) noexcept
+                : pool(other.pool), ptr(other.ptr), len(other.len)
+            {
+                other.ptr = nullptr;
+                other.len = 0;
+            }
+            Buffer &operator=(Buffer &&other) noexcept;
+            ~Buffer() { this->release(); }
+            //禁止复制
+            Buffer(const Buffer &) = delete;
+            Buffer &operator=(const Buffer &) = delete;
+
+            char *data() const { return ptr; }
+            std::size_t size() const { return len; }
+
+            /**
+             * @brief 提前归还缓冲区
+             */
+            void release();
+
+        private:
+            friend class BufferPool;
+            Buffer(BufferPool *pool, char *ptr, std::size_t len)
+                : pool(pool), ptr(ptr), len(len)
+            {
+            }
+
+            BufferPool *pool;
+            char *ptr;
+            std::size_t len;
+        };
+
+        /**
+         * @brief 全局唯一的缓冲区池
+         * @author zhb
+         */
+        static BufferPool &instance();
+
+        ~BufferPool();
+        //禁止复制
+        BufferPool(const BufferPool &) = delete;
+        BufferPool &operator=(const BufferPool &) = delete;
+
+        /**
+         * @brief 借出一个缓冲区
+         * @author zhb
+         * @param size 需要的字节数，会向上取整到页大小的整数倍
+         * @return 缓冲区，内容未清零；分配失败时 data() 为 nullptr
+         */
+        Buffer acquire(std::size_t size);
+
+        /**
+         * @brief 释放所有空闲的缓冲区
+         * @author zhb
+         */
+        void trim();
+
+    private:
+        BufferPool() = default;
+
+        void giveBack(char *ptr, std::size_t size);
+
+        std::mutex mutex;
+        //大小 -> 空闲的缓冲区
+        std::unordered_map<std::size_t, std::vector<char *>> idle;
+    };
+
+} // namespace utils
+
+#endif // BUFFER_POOL_H
@@ -0,0 +1,47 @@
+//传输数据的校验和
+#ifndef CHECKSUM_H
+#define CHECKSUM_H
+
+#include <cstddef>
+#include <cstdint>
+
+namespace utils
+{
+
+    /**
+     * @brief CRC-32（IEEE 802.3，与 zlib、XCRC、HASH CRC32 相同）
+     * @author zhb
+     *
+     * 数据分块经过时依次 update()，不必事后重读文件；
+     * 查表时每次处理 8 个字节（slicing-by-8）
+     */
+    class Crc32
+    {
+    public:
+        /**
+         * @brief 追加一块数据
+         * @author zhb
+         */
+        void update(const void *data, std::size_t len);
+
+        std::uint32_t value() const { return crc; }
+
+        /**
+         * @brief 由两段数据各自的 CRC 算出拼接后的 CRC
+         * @author zhb
+         * @param crc1 前一段的 CRC
+         * @param crc2 后一段的 CRC
+         * @param len2 后一段的字节数
+         *
+         * 分段下载时各段分别计算，最后按顺序合并
+         */
+        static std::uint32_t combine(std::uint32_t crc1, std::uint32_t crc2,
+                                     long long len2);
+
+    private:
+        std::uint32_t crc = 0;
+    };
+
+} // namespace utils
+
+#endif // CHECKSUM_H
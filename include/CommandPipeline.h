@@ -0,0 +1,139 @@
+//在一条控制连接上连续写出多条命令，按顺序匹配回复
+#ifndef COMMAND_PIPELINE_H
+#define COMMAND_PIPELINE_H
+
+#include "../include/FTPFunction.h"
+#include "../include/Socket.h"
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace ftpclient
+{
+
+    /**
+     * @brief 命令流水线：不等上一条命令的回复就发下一条
+     * @author zhb
+     *
+     * 最多 depth 条命令在途，合并成一次 send() 写出，回复按 FIFO 顺序
+     * 交给各自的回调。批量的 DELE、SIZE 等只需约一个 RTT，
+     * 而不是每条命令一个 RTT
+     *
+     * RFC 959 没有要求服务器支持流水线，有的服务器会丢掉
+     * 还没处理的输入。第一次在某台服务器上使用时先连续发两条 NOOP：
+     * - 两条都得到 2xx 回复，记为支持，之后按 depth 流水线发送
+     * - 第二条的回复等了 PROBE_TIMEOUT_FACTOR 倍的超时时间还没到，
+     *   多半是服务器丢了输入：发一条 PWD，丢弃迟到的 200 直到收到 PWD 的
+     *   回复，使回复重新对齐。其间没有收到迟到的 200 才记为不支持
+     * - 出错、连接断开或等待被取消时不记录结果，下次再试
+     * - 不支持时逐条发送，调用方的用法不变
+     * 结果记在 CapabilityCache 中，同一服务器只试一次
+     *
+     * 只能用于只有一个最终回复的命令，不能用于 RETR、LIST 等
+     * 先回复 1xx 的命令。用法：
+     * @code
+     * auto pipeline = CommandPipeline::create(sock, timeout);
+     * for (const auto &name : names)
+     *     pipeline->add("DELE " + name + "\r\n", {250}, onDeleted);
+     * pipeline->run([]() { ... });
+     * @endcode
+     */
+    class CommandPipeline : public std::enable_shared_from_this<CommandPipeline>
+    {
+    public:
+        //参数为结果状态码和收到的回复
+        using Done = std::function<void(CmdToServerRet, std::string)>;
+        using Result = std::pair<CmdToServerRet, std::string>;
+
+        //默认最多在途的命令数，太多时双方的缓冲区可能都被填满
+        static const std::size_t DEFAULT_DEPTH = 16;
+        //试探时等第二条 NOOP 的回复比等普通回复更久，以免把慢的服务器
+        //当成不支持流水线
+        static const int PROBE_TIMEOUT_FACTOR = 3;
+
+        /**
+         * @brief 创建流水线，异步回调中要持有它，所以只能以 shared_ptr 使用
+         * @author zhb
+         * @param controlSock 控制连接，上面不能有未收取的回复
+         * @param timeout 等待每条回复的超时时间(ms)
+         * @param depth 最多在途的命令数，至少为 1
+         */
+        static std::shared_ptr<CommandPipeline>
+        create(SOCKET controlSock, int timeout,
+               std::size_t depth = DEFAULT_DEPTH);
+
+        /**
+         * @brief 追加一条命令，只能在 run() 之前调用
+         * @author zhb
+         * @param cmd 命令，必须以"\r\n"结尾
+         * @param expectedCodes 可接受的回复码
+         * @param done 收到回复或出错时调用，执行线程同 run() 的 finished
+         */
+        void add(const std::string &cmd, std::vector<int> expectedCodes,
+                 Done done);
+
+        /**
+         * @brief 追加一条命令，结果通过 future 取得
+         * @author zhb
+         *
+         * 不要在 Reactor 线程中等待这个 future
+         */
+        std::future<Result> add(const std::string &cmd,
+                                std::vector<int> expectedCodes);
+
+        /**
+         * @brief 开始发送
+         * @author zhb
+         * @param finished 所有命令都有结果后调用一次，可能在调用者线程或
+         *                 Reactor 线程中执行
+         *
+         * 收不到回复（超时、连接断开）时，这条及之后的命令都以
+         * RECV_FAILED 结束，控制连接不应再使用
+         */
+        void run(std::function<void()> finished);
+
+        //没有在 run() 前追加命令
+        bool empty() const { return queued.empty(); }
+
+    private:
+        struct Command
+        {
+            std::string cmd;
+            std::vector<int> expectedCodes;
+            Done done;
+        };
+
+        CommandPipeline(SOCKET controlSock, int timeout, std::size_t depth);
+
+        void probe();
+        //收取第二条 NOOP 的回复，超时与出错分开处理
+        void recvProbeReply(bool isFirstPositive);
+        //试探超时后发 PWD，使之后的回复与命令重新对齐
+        void resync();
+        void recvResyncReply();
+        //把队列中的命令写出去，直到在途的命令数达到 depth
+        void fill();
+        void recvNext();
+        void onReply(int iResult, std::string reply);
+        //之后的命令全部以 ret 结束
+        void failAll(CmdToServerRet ret);
+
+        SOCKET controlSock;
+        int timeout;
+        std::size_t depth;
+        std::deque<Command> queued;
+        //已写出、还没收到回复的命令，回复按这个顺序到达
+        std::deque<Command> inFlight;
+        std::function<void()> finished;
+        //重新对齐时收到了第二条 NOOP 迟到的回复，说明它没有被丢掉
+        bool isLateNoopSeen = false;
+    };
+
+} // namespace ftpclient
+
+#endif // COMMAND_PIPELINE_H
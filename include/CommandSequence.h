@@ -0,0 +1,149 @@
+//在 Reactor 上依次执行的一串 FTP 操作
+#ifndef COMMAND_SEQUENCE_H
+#define COMMAND_SEQUENCE_H
+
+#include "../include/FTPFunction.h"
+#include "../include/Socket.h"
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace ftpclient
+{
+
+    /**
+     * @brief 命令序列：把"发命令 -> 等回复 -> 发下一条命令"写成一个整体
+     * @author zhb
+     *
+     * 每一步都是非阻塞的异步操作，完成时调用传入的 next 进入下一步，
+     * 整个序列只需等待一次（如 utils::reactorAwait()），
+     * 中间不经过信号，也不占用线程池中的线程
+     *
+     * 用法：
+     * @code
+     * auto seq = CommandSequence::create();
+     * seq->addCommand(sock, "TYPE I\r\n", {200});
+     * seq->addStep([](CommandSequence::Next next) { ... });
+     * seq->run([](CommandSequence::Res res, std::string msg) { ... });
+     * @endcode
+     *
+     * 步骤中不要持有 seq 的 shared_ptr（会循环引用），需要时用裸指针
+     */
+    class CommandSequence : public std::enable_shared_from_this<CommandSequence>
+    {
+    public:
+        enum class Res
+        {
+            SUCCEEDED,
+            FAILED_WITH_MSG, //服务器拒绝，带错误消息
+            FAILED,          //网络错误等
+            STOPPED          //被 stop()
+        };
+
+        //每一步结束时调用：SUCCEEDED 进入下一步，其余结果结束整个序列
+        using Next = std::function<void(Res, std::string)>;
+        using Step = std::function<void(Next)>;
+        using Done = std::function<void(Res, std::string)>;
+
+        /**
+         * @brief 创建序列，异步回调中要持有它，所以只能以 shared_ptr 使用
+         * @author zhb
+         */
+        static std::shared_ptr<CommandSequence> create();
+
+        /**
+         * @brief 追加一步任意的异步操作
+         * @author zhb
+         * @param step 操作，结束时必须且只能调用一次 next
+         */
+        void addStep(Step step);
+
+        /**
+         * @brief 追加一步：发送命令并检查回复码
+         * @author zhb
+         * @param controlSock 控制连接
+         * @param makeCmd 执行到这一步时生成命令（可以用到前面步骤的结果），
+         *                返回空字符串表示跳过这一步
+         * @param expectedCodes 可接受的回复码
+         * @param onReply 回复码符合时调用，可为空，返回 false 视为
+         *                FAILED_WITH_MSG（如回复格式不对）
+         */
+        void addCommand(SOCKET controlSock,
+                        std::function<std::string()> makeCmd,
+                        std::vector<int> expectedCodes,
+                        std::function<bool(const std::string &)> onReply =
+                            nullptr);
+        void addCommand(SOCKET controlSock, const std::string &cmd,
+                        std::vector<int> expectedCodes,
+                        std::function<bool(const std::string &)> onReply =
+                            nullptr);
+
+        /**
+         * @brief 追加一步：让服务器进入被动模式，再建立数据连接
+         * @author zhb
+         * @param controlSock 控制连接
+         * @param sendTimeout 数据连接阻塞式send()超时时间(ms)
+         * @param recvTimeout 数据连接阻塞式recv()超时时间(ms)
+         * @param profile 数据连接的 TCP 设置
+         * @param onConnected 数据连接建立后调用，参数为数据连接
+         */
+        void addPassiveConnect(SOCKET controlSock, int sendTimeout,
+                               int recvTimeout,
+                               const utils::SocketProfile &profile,
+                               std::function<void(SOCKET)> onConnected);
+
+        /**
+         * @brief 追加一步：服务器支持时切换为 MODE Z 压缩传输
+         * @author zhb
+         * @param controlSock 控制连接
+         * @param level 压缩级别 1 ~ 9
+         * @param onResult 这一步成功时调用，参数为是否已切换为 MODE Z
+         *
+         * 服务器不支持或拒绝时照常进入下一步，继续用 MODE S 传输
+         */
+        void addDeflateMode(SOCKET controlSock, int level,
+                            std::function<void(bool)> onResult);
+
+        /**
+         * @brief 开始执行
+         * @author zhb
+         * @param done 序列结束时调用一次，参数为结果和错误消息，
+         *             可能在调用者线程或 Reactor 线程中执行
+         */
+        void run(Done done);
+
+        /**
+         * @brief 在某一步中调用：当前步骤成功后直接结束序列，不再执行后面的步骤
+         * @author zhb
+         */
+        void skipRest() { isSkipRest = true; }
+
+        /**
+         * @brief 请求停止，当前步骤结束后序列以 STOPPED 结束
+         * @author zhb
+         *
+         * 要让正在等待的网络操作马上结束，还需要关闭（或 Reactor::cancel()）
+         * 对应的 socket
+         */
+        void stop() { isStopped = true; }
+        bool stopped() const { return isStopped; }
+
+        //命令的超时时间（ms）
+        static const int COMMAND_TIMEOUT = 3000;
+
+    private:
+        CommandSequence() = default;
+
+        void runStep(std::size_t index);
+
+        std::vector<Step> steps;
+        Done done;
+        std::atomic<bool> isStopped{false};
+        std::atomic<bool> isSkipRest{false};
+    };
+
+} // namespace ftpclient
+
+#endif // COMMAND_SEQUENCE_H
@@ -0,0 +1,116 @@
+//数据连接 MODE Z 使用的 zlib 流式压缩、解压
+#ifndef DEFLATE_H
+#define DEFLATE_H
+
+#include "../include/BufferPool.h"
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <string>
+
+struct z_stream_s;
+
+namespace utils
+{
+    //压缩数据的去处，返回 false 时中止
+    using DeflateSink = std::function<bool(const char *, std::size_t)>;
+
+    //未指定时使用的压缩级别，与 zlib 的默认值相同
+    const int DEFAULT_DEFLATE_LEVEL = 6;
+
+    /**
+     * @brief 流式压缩（RFC 1950 zlib 格式，即 MODE Z 使用的格式）
+     * @author zhb
+     *
+     * 文件分块依次 compress()，最后一块 finish 为 true
+     */
+    class Deflater
+    {
+    public:
+        /**
+         * @param level 压缩级别，会被限制在 1 ~ 9 之间
+         */
+        explicit Deflater(int level = DEFAULT_DEFLATE_LEVEL);
+        ~Deflater();
+        //禁止复制
+        Deflater(const Deflater &) = delete;
+        Deflater &operator=(const Deflater &) = delete;
+
+        /**
+         * @brief 初始化或分配输出缓冲区是否失败
+         */
+        bool isInitFailed() const { return initFailed; }
+
+        /**
+         * @brief 压缩一块数据，产生的压缩数据分若干次交给 sink
+         * @author zhb
+         * @param data 数据
+         * @param len 字节数
+         * @param finish 是否为最后一块，为 true 时写出流的结尾
+         * @param sink 压缩数据的去处
+         * @return 压缩与 sink 是否都成功
+         */
+        bool compress(const char *data, std::size_t len, bool finish,
+                      const DeflateSink &sink);
+
+    private:
+        std::unique_ptr<z_stream_s> stream;
+        BufferPool::Buffer out;
+        bool initFailed = false;
+    };
+
+    /**
+     * @brief 流式解压，与 Deflater 对应
+     * @author zhb
+     */
+    class Inflater
+    {
+    public:
+        enum class Res
+        {
+            //数据已用完，流还没有结束
+            NEED_MORE,
+            //流已结束，之后的数据被忽略
+            STREAM_END,
+            //数据损坏或 sink 返回 false
+            FAILED
+        };
+
+        Inflater();
+        ~Inflater();
+        //禁止复制
+        Inflater(const Inflater &) = delete;
+        Inflater &operator=(const Inflater &) = delete;
+
+        bool isInitFailed() const { return initFailed; }
+
+        /**
+         * @brief 解压收到的一块数据，解压出的数据分若干次交给 sink
+         * @author zhb
+         * @param data 压缩数据
+         * @param len 字节数
+         * @param sink 解压数据的去处
+         * @return 结果状态码
+         */
+        Res decompress(const char *data, std::size_t len,
+                       const DeflateSink &sink);
+
+    private:
+        std::unique_ptr<z_stream_s> stream;
+        BufferPool::Buffer out;
+        bool initFailed = false;
+        bool isEnded = false;
+    };
+
+    /**
+     * @brief 一次解压一段完整的压缩数据，用于目录列表等小块数据
+     * @author zhb
+     * @param in 压缩数据
+     * @param out 出口参数，解压后的数据
+     * @return 数据是否完整、未损坏
+     */
+    bool inflateAll(const std::string &in, std::string &out);
+
+} // namespace utils
+
+#endif // DEFLATE_H
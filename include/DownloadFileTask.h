@@ -1,11 +1,20 @@
 #ifndef DOWNLOADFILETASK_H
 #define DOWNLOADFILETASK_H
 
+#include "../include/CommandSequence.h"
 #include "../include/FTPSession.h"
+#include "../include/LocalFile.h"
+#include "../include/RateLimiter.h"
+#include "../include/TransferProgress.h"
 #include <QObject>
+#include <algorithm>
+#include <atomic>
 #include <cstring>
 #include <fstream>
 #include <iostream>
+#include <memory>
+#include <utility>
+#include <vector>
 
 namespace ftpclient
 {
@@ -59,13 +68,113 @@ namespace ftpclient
          */
         void stop();
 
+        /**
+         * @brief 设置数据连接收发缓冲区的大小
+         * @author zhb
+         * @param size 字节数，会被限制在 64 KiB ~ 8 MiB 之间
+         */
+        void setBufferSize(int size)
+        {
+            bufferSize = clampTransferBufferSize(size);
+        }
+
+        /**
+         * @brief 设置是否使用零拷贝方式下载
+         * @author zhb
+         * @param enable 是否启用
+         *
+         * 仅在二进制模式下生效；平台不支持时自动改用普通方式
+         */
+        void setZeroCopy(bool enable) { zeroCopy = enable; }
+
+        /**
+         * @brief 设置本任务的限速，传输过程中也可以修改
+         * @author zhb
+         * @param bytesPerSecond 限速值（字节/秒），0 表示不限速
+         *
+         * 同时还受 utils::RateLimiter::globalDownload() 的全局限速约束
+         */
+        void setRateLimit(long long bytesPerSecond)
+        {
+            rateLimiter.setLimit(bytesPerSecond);
+        }
+
+        /**
+         * @brief 设置分段下载的段数
+         * @author zhb
+         * @param count 段数，会被限制在 1 ~ MAX_SEGMENT_COUNT 之间，1 表示不分段
+         *
+         * 默认不分段。每段各用一条控制连接和数据连接；小于
+         * MIN_SEGMENTED_FILESIZE 的文件仍然只用一条连接。分段下载暂停或
+         * 失败后 resume() 只下载各段还没下完的部分，其余续传只用一条连接
+         */
+        void setSegmentCount(int count)
+        {
+            segmentCount = std::max(1, std::min(count, MAX_SEGMENT_COUNT));
+        }
+
+        /**
+         * @brief 设置是否在传输时计算 CRC-32，结束后与服务器的比较
+         * @author zhb
+         * @param enable 是否启用
+         *
+         * 仅在二进制模式、从头下载时生效；启用后不再零拷贝下载，
+         * 因为数据要经过缓冲区才能计算；服务器不支持 XCRC / HASH 时不校验
+         */
+        void setVerifyChecksum(bool enable) { verifyChecksum = enable; }
+
+        /**
+         * @brief 设置 MODE Z 压缩级别
+         * @author zhb
+         * @param level 0 表示不压缩，1 ~ 9 为 zlib 的压缩级别
+         *
+         * 服务器不支持 MODE Z 时照常不压缩传输；续传时不压缩；
+         * 压缩时不分段下载，因为各段要用 REST 定位
+         */
+        void setCompressionLevel(int level)
+        {
+            compressionLevel = std::max(0, std::min(level, 9));
+        }
+
+        /**
+         * @brief 设置用 io_uring 读写本地文件时同时进行的块数
+         * @author zhb
+         * @param depth 0 表示不使用 io_uring，其余会被限制在 2 ~ 64 之间
+         *
+         * 仅 Linux 下生效，内核不支持时照常读写；零拷贝传输时不经过本地文件读写
+         */
+        void setDiskQueueDepth(int depth)
+        {
+            if (depth > 0)
+                depth = std::max(2, std::min(depth, MAX_DISK_QUEUE_DEPTH));
+            diskQueueDepth = std::max(0, depth);
+        }
+
+        /**
+         * @brief 设置数据连接的 TCP 设置（收发缓冲区、拥塞控制算法）
+         * @author zhb
+         * @param profile 一般由 utils::dataSocketProfile() 按带宽时延积得出
+         *
+         * 在建立数据连接前设置才有效
+         */
+        void setSocketProfile(const utils::SocketProfile &profile)
+        {
+            socketProfile = profile;
+        }
+
+        //开启分段下载时建议的段数
+        static const int DEFAULT_SEGMENT_COUNT = 4;
+        static const int MAX_SEGMENT_COUNT = 16;
+        static const long long MIN_SEGMENTED_FILESIZE = 16 * 1024 * 1024;
+
     signals:
 
         /**
-         * @brief 信号：下载百分比
-         * @param percent 百分比
+         * @brief 信号：下载进度，传输期间每 utils::PROGRESS_TICK_INTERVAL
+         * 发射一次
+         * @param progress 字节数、百分比、速率和剩余时间
          */
-        void percentSync(int percent);
+        void progressSync(utils::TransferProgress::Snapshot progress);
 
         /**
          * @brief 信号：下载开始
@@ -83,6 +192,11 @@ namespace ftpclient
          */
         void downloadFailed();
 
+        /**
+         * @brief 信号：下载完成，但收到的数据与服务器上文件的 CRC-32 不一致
+         */
+        void downloadChecksumMismatch();
+
         /**
          * @brief 信号：下载失败
          */
@@ -101,23 +215,28 @@ namespace ftpclient
         void connectSignals();
 
         /**
-         * @brief 进入被动模式
-         * @author zyc
+         * @brief 获取文件大小、进入被动模式、建立数据连接、发送 REST 和 RETR
+         * @author zhb
+         *
+         * 整个过程是一个 CommandSequence，只等待一次；
+         * 文件够大时获取文件大小后就转为分段下载
          */
-        void enterPassiveMode();
+        void prepareTransfer();
 
         /**
-         * @brief 数据套接字连接
-         * @author zyc
-         * @param hostname 主机名
-         * @param port 端口号
+         * @brief 把文件分成 segmentCount 段，各段并行下载
+         * @author zhb
          */
-        void dataSocketConnect(const std::string &hostname, int port);
+        void downloadSegmented();
 
         /**
-         * @brief 发送 RETR 或 REST 命令请求下载
+         * @brief 让服务器计算文件的 CRC-32 并与本地的比较
+         * @author zhb
+         * @param controlSock 空闲的控制连接
+         * @param localCrc 传输时算出的 CRC-32
          */
-        void downloadRequest();
+        VerifyChecksumRes verifyChecksumOnServer(SOCKET controlSock,
+                                                 std::uint32_t localCrc);
 
         /**
          * @brief 退出下载
@@ -131,8 +250,8 @@ namespace ftpclient
         std::string localFilepath;
         //服务器文件路径
         std::string remoteFilepath;
-        //文件输出流
-        std::ofstream ofs;
+        //本地文件，构造时清空
+        utils::LocalFile file;
         //若 socket 未创建，则为 INVALID_SOCKET
         SOCKET dataSocket;
         //数据连接是否建立
@@ -144,6 +263,37 @@ namespace ftpclient
         //服务器上文件的大小
         long long remoteFilesize;
         long long downloadOffset = 0;
+        //数据连接收发缓冲区大小
+        int bufferSize = DEFAULT_TRANSFER_BUFFER_SIZE;
+        //是否尝试零拷贝下载
+        bool zeroCopy = true;
+        //是否校验 CRC-32
+        bool verifyChecksum = false;
+        // MODE Z 压缩级别，0 表示不压缩
+        int compressionLevel = 0;
+        // io_uring 同时读写的块数，0 表示不使用
+        int diskQueueDepth = 0;
+        //数据连接的 TCP 设置
+        utils::SocketProfile socketProfile;
+        //本次传输是否为 MODE Z
+        bool isDeflate = false;
+        //服务器是否处于二进制传输模式，ASCII 模式下不能零拷贝
+        bool isBinaryMode = false;
+        //分段下载的段数，每段多占一条控制连接，由调用者决定是否分段
+        int segmentCount = 1;
+        //本次是否为分段下载
+        bool isSegmented = false;
+        //上次分段下载还没下完的区间 [begin, end)，续传时只下载这些；
+        //为空表示上次不是分段下载或已经下完
+        std::vector<std::pair<long long, long long>> pendingRanges;
+        //通知各段停止
+        std::atomic<bool> segmentStop{false};
+        //传输线程（分段下载时为各段）累加字节数，界面线程定时采样
+        utils::TransferProgress progress;
+        //本任务的限速，分段下载时各段共用
+        utils::RateLimiter rateLimiter;
+        //正在执行的准备序列，没有时为空
+        std::shared_ptr<CommandSequence> preparing;
 
         static const int SENDTIMEOUT = 3000;
         static const int RECVTIMEOUT = 3000;
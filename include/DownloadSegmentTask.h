@@ -0,0 +1,160 @@
+#ifndef DOWNLOADSEGMENTTASK_H
+#define DOWNLOADSEGMENTTASK_H
+
+#include "../include/Checksum.h"
+#include "../include/FTPFunction.h"
+#include "../include/LocalFile.h"
+#include "../include/RateLimiter.h"
+#include "../include/TransferProgress.h"
+#include <atomic>
+#include <string>
+
+namespace ftpclient
+{
+    /**
+     * @brief 分段下载中的一段：用独立的控制连接和数据连接下载文件的
+     * [begin, end) 部分，写到本地文件的相同位置
+     *
+     * 成员函数为阻塞式的同步函数，需要在子线程中调用
+     */
+    class DownloadSegmentTask
+    {
+    public:
+        /**
+         * @brief DownloadSegmentTask 构造函数
+         * @param hostname 服务器主机名
+         * @param port 端口号
+         * @param username 用户名
+         * @param password 密码
+         * @param remoteFilepath 服务器文件路径
+         * @param file 已打开的本地文件，各段共用
+         * @param begin 本段起始位置
+         * @param end 本段结束位置（不含）
+         * @param filesize 服务器上文件的大小
+         * @param progress 各段共用的进度，累加已写入的字节数
+         * @param stopFlag 各段共用的停止标志
+         * @param throttle 各段共用的限速
+         * @param bufferSize 数据连接收发缓冲区大小
+         * @param computeChecksum 是否计算本段的 CRC-32
+         * @param diskQueueDepth io_uring 同时写的块数，0 表示同步写
+         * @param socketProfile 数据连接的 TCP 设置
+         */
+        DownloadSegmentTask(const std::string &hostname, int port,
+                            const std::string &username,
+                            const std::string &password,
+                            const std::string &remoteFilepath,
+                            utils::LocalFile &file, long long begin,
+                            long long end, long long filesize,
+                            utils::TransferProgress &progress,
+                            std::atomic<bool> &stopFlag,
+                            const utils::Throttle &throttle, int bufferSize,
+                            bool computeChecksum = false,
+                            int diskQueueDepth = 0,
+                            const utils::SocketProfile &socketProfile =
+                                utils::SocketProfile());
+        ~DownloadSegmentTask();
+        //禁止复制
+        DownloadSegmentTask(const DownloadSegmentTask &) = delete;
+        DownloadSegmentTask &operator=(const DownloadSegmentTask &) = delete;
+
+        enum class Res
+        {
+            SUCCEEDED,
+            FAILED_WITH_MSG,
+            FAILED,
+            READ_FILE_ERROR,
+            //被 stopFlag 停止
+            STOPPED
+        };
+
+        /**
+         * @brief 下载本段
+         * @author zhb
+         * @param errorMsg 出口参数，来自服务器的错误消息
+         * @return 结果状态码
+         */
+        Res run(std::string &errorMsg);
+
+        /**
+         * @brief 从 begin 起已经写入本地文件的字节数
+         * @author zhb
+         *
+         * run() 停止或失败时也已把收到的数据写出，续传时从
+         * begin + received() 接着下载本段
+         */
+        long long received() const { return receivedBytes; }
+
+        /**
+         * @brief 本段数据的 CRC-32，各段按顺序用 utils::Crc32::combine()
+         * 合并即为整个文件的
+         * @author zhb
+         *
+         * run() 成功且 computeChecksum 为 true 时才有意义
+         */
+        std::uint32_t crc32() const { return checksum.value(); }
+
+    private:
+        /**
+         * @brief 建立控制连接->登录->切换为二进制模式
+         * @author zhb
+         *
+         * SessionPool 中有可用连接时直接取用
+         */
+        Res connectAndLogin(std::string &errorMsg);
+
+        /**
+         * @brief 进入被动模式（PASV或EPSV）并建立数据连接
+         * @author zhb
+         */
+        Res dataConnect(std::string &errorMsg);
+
+        /**
+         * @brief 发送 REST begin 和 RETR
+         * @author zhb
+         */
+        Res requestRange(std::string &errorMsg);
+
+        /**
+         * @brief 接收数据直到本段结束
+         * @author zhb
+         */
+        Res recvRange();
+
+        /**
+         * @brief 关闭数据连接；最后一段收取 226 并把控制连接还回
+         * SessionPool，其余各段随后关闭控制连接即中止传输
+         * @author zhb
+         */
+        Res finishTransfer(std::string &errorMsg);
+
+        void closeSockets();
+
+        std::string hostname;
+        int port;
+        std::string username;
+        std::string password;
+        std::string remoteFilepath;
+        utils::LocalFile &file;
+        long long begin;
+        long long end;
+        long long filesize;
+        utils::TransferProgress &progress;
+        std::atomic<bool> &stopFlag;
+        utils::Throttle throttle;
+        int bufferSize;
+        //从 begin 起已写入文件的字节数
+        long long receivedBytes = 0;
+        bool computeChecksum;
+        int diskQueueDepth;
+        utils::SocketProfile socketProfile;
+        utils::Crc32 checksum;
+        //若 socket 未创建，则为 INVALID_SOCKET
+        SOCKET controlSock;
+        SOCKET dataSock;
+
+        static const int SOCKET_SEND_TIMEOUT = 3000;
+        static const int SOCKET_RECV_TIMEOUT = 3000;
+    };
+} // namespace ftpclient
+
+#endif // DOWNLOADSEGMENTTASK_H
@@ -1,12 +1,19 @@
 //用于实现 FTP 协议的全局函数
-//都是阻塞式函数，应当在子线程中执行
+//除 async 开头的函数外都是阻塞式函数，应当在子线程中执行
 #ifndef FTP_FUNCTION_H
 #define FTP_FUNCTION_H
 
-#include <WinSock2.h>
+#include "../include/Checksum.h"
+#include "../include/FtpReply.h"
+#include "../include/LocalFile.h"
+#include "../include/RateLimiter.h"
+#include "../include/Socket.h"
+#include "../include/TransferProgress.h"
 #include <fstream>
-#include <regex>
+#include <functional>
+#include <initializer_list>
 #include <string>
+#include <vector>
 
 namespace ftpclient
 {
@@ -15,6 +22,7 @@ namespace ftpclient
     {
         //成功连接到服务器
         SUCCEEDED,
+        //初始化套接字库失败（Windows 上为 WSAStartup()）
         WSAStartup_FAILED,
         getaddrinfo_FAILED,
         socket_FAILED,
@@ -22,6 +30,11 @@ namespace ftpclient
         UNABLE_TO_CONNECT_TO_SERVER
     };
 
+    //阻塞式 connectToServer() 的连接超时时间(ms)
+    const int CONNECT_TIMEOUT = 10000;
+    //服务器有多个地址时，每隔多久多发起一个连接(ms)，取 RFC 8305 的建议值
+    const int CONNECT_ATTEMPT_DELAY = 250;
+
     /**
      * @brief 创建socket并连接到服务器
      * @author zhb
@@ -30,12 +43,37 @@ namespace ftpclient
      * @param port 端口号，形如"21"或"ftp"均可
      * @param sendTimeout 阻塞式send()超时时间(ms)，负数表示不设置
      * @param recvTimeout 阻塞式recv()超时时间(ms)，负数表示不设置
+     * @param profile 连接前应用的 TCP 设置，默认为控制连接的设置
      * @return 结果状态码
+     *
+     * 主机名解析出多个地址时，各地址的非阻塞连接在 Reactor 线程中交错发起，
+     * 先连上的胜出（Happy Eyeballs），不可达的 IPv6 地址不会拖住 IPv4；
+     * 最多等待 CONNECT_TIMEOUT。不能在 Reactor 线程中调用
+     */
+    ConnectToServerRes connectToServer(
+        SOCKET &sock, const std::string &hostname, const std::string &port,
+        int sendTimeout, int recvTimeout,
+        const utils::SocketProfile &profile = utils::controlSocketProfile());
+
+    /**
+     * @brief 非阻塞地连接到服务器，等待连接时不占用线程（用于数据连接）
+     * @author zhb
+     * @param hostname 主机名或 IP 地址，主机名在解析线程中解析，
+     *                 不阻塞 Reactor 线程
+     * @param port 端口号
+     * @param timeout 连接超时时间(ms)
+     * @param sendTimeout 连接后阻塞式send()超时时间(ms)，负数表示不设置
+     * @param recvTimeout 连接后阻塞式recv()超时时间(ms)，负数表示不设置
+     * @param profile 连接前应用的 TCP 设置
+     * @param done 结束时调用，参数为结果状态码和 socket（阻塞模式），
+     *             可能在调用者线程或 Reactor 线程中执行
+     *
+     * 有多个地址时同 connectToServer()，交错发起连接，先连上的胜出
      */
-    ConnectToServerRes connectToServer(SOCKET &sock,
-                                       const std::string &hostname,
-                                       const std::string &port, int sendTimeout,
-                                       int recvTimeout);
+    void asyncConnectToServer(
+        const std::string &hostname, int port, int timeout, int sendTimeout,
+        int recvTimeout, const utils::SocketProfile &profile,
+        std::function<void(ConnectToServerRes, SOCKET)> done);
 
     enum class RecvMultRes
     {
@@ -45,15 +83,37 @@ namespace ftpclient
     };
 
     /**
-     * @brief 一次性收取多条消息
+     * @brief 收取一条可能为多行的回复（如欢迎消息、登录成功消息）
      * @author zhb
      * @param controlSock 控制连接
-     * @param matchRegex 用于匹配的正则
+     * @param expectedCode 期望的回复码
      * @param msg 出口参数，收到的消息
      * @return 结果状态码
+     *
+     * 收到多行回复的最后一行"NNN text"后立即返回
+     */
+    RecvMultRes recvMultipleMsg(SOCKET controlSock, int expectedCode,
+                                std::string &msg);
+
+    /**
+     * @brief 发送 ABOR 后收取服务器的回复
+     * @author zhb
+     * @param controlSock 控制连接
+     * @param msg 出口参数，收到的消息
+     * @return 结果状态码
+     *
+     * 两种情况：1. 服务器返回 226/225；2. 服务器先返回 426，再返回 226/225
+     */
+    RecvMultRes recvAborMsg(SOCKET controlSock, std::string &msg);
+
+    /**
+     * @brief 数据传输结束后收取控制连接上的结束回复
+     * @author zhb
+     * @param controlSock 控制连接
+     * @param msg 出口参数，收到的消息
+     * @return 结果状态码，回复码为 226 或 250 时成功
      */
-    RecvMultRes recvMultipleMsg(SOCKET controlSock,
-                                const std::regex &matchRegex, std::string &msg);
+    RecvMultRes recvTransferCompleteMsg(SOCKET controlSock, std::string &msg);
 
     /**
      * @brief 收取多条欢迎消息
@@ -80,14 +140,124 @@ namespace ftpclient
      * @author zhb
      * @param controlSock 控制连接
      * @param sendCmd 命令，必须以"\r\n"结尾
-     * @param matchRegex 匹配服务器消息的正则
+     * @param expectedCodes 可接受的回复码
      * @param recvMsg 出口参数，收到的消息
      * @return 结果状态码
      */
     CmdToServerRet cmdToServer(SOCKET controlSock, const std::string &sendCmd,
-                               const std::regex &matchRegex,
+                               std::initializer_list<int> expectedCodes,
                                std::string &recvMsg);
 
+    /**
+     * @brief 非阻塞地收取一条完整的回复
+     * @author zhb
+     * @param controlSock 控制连接
+     * @param timeout 每次等待数据的超时时间(ms)，负数表示不限时
+     * @param done 收到回复、超时或出错时调用，参数与 recvFtpReply() 相同：
+     *             收到的字节数（负数表示出错或超时，0 表示对方关闭连接）和回复
+     *
+     * 缓冲区中已有完整回复时 done 在调用者线程中立即执行，
+     * 否则由 Reactor 等待 socket 可读，done 在 Reactor 线程中执行
+     */
+    void asyncRecvFtpReply(SOCKET controlSock, int timeout,
+                           std::function<void(int, std::string)> done);
+
+    /**
+     * @brief 非阻塞地发送命令并收取回复，等待回复时不占用线程
+     * @author zhb
+     * @param controlSock 控制连接
+     * @param sendCmd 命令，必须以"\r\n"结尾
+     * @param expectedCodes 可接受的回复码
+     * @param timeout 等待回复的超时时间(ms)，负数表示不限时
+     * @param done 结束时调用，参数为结果状态码和收到的回复，
+     *             执行线程同 asyncRecvFtpReply()
+     *
+     * 命令很短，直接在调用者线程中 send()，不会等待
+     */
+    void
+    asyncCmdToServer(SOCKET controlSock, const std::string &sendCmd,
+                     std::vector<int> expectedCodes, int timeout,
+                     std::function<void(CmdToServerRet, std::string)> done);
+
+    /**
+     * @brief 非阻塞地让服务器进入被动模式，先发的命令返回 500 / 502 时
+     * 改用另一个
+     * @author zhb
+     * @param controlSock 控制连接
+     * @param timeout 等待回复的超时时间(ms)
+     * @param done 结束时调用，参数为结果状态码、数据连接的 IP 地址、端口号和
+     *             服务器的错误消息，执行线程同 asyncCmdToServer()
+     *
+     * 一般先试 PASV；CapabilityCache 中记录该服务器不支持 PASV，或控制连接
+     * 为 IPv6 时先试 EPSV。EPSV 模式下数据连接的地址为控制连接的对端地址
+     */
+    void asyncEnterPassiveMode(
+        SOCKET controlSock, int timeout,
+        std::function<void(CmdToServerRet, std::string, int, std::string)>
+            done);
+
+    //服务器计算大文件的校验和要读完整个文件，等待时间比普通命令长得多
+    const int CHECKSUM_TIMEOUT = 120000;
+
+    /**
+     * @brief 非阻塞地请求服务器计算文件的 CRC-32
+     * @author zhb
+     * @param controlSock 控制连接
+     * @param method 使用的命令，由 FEAT 的回复得到，不能为 NONE
+     * @param remoteFilepath 服务器文件路径
+     * @param timeout 等待 OPTS 等普通命令回复的超时时间(ms)，
+     *                计算校验和的命令用 CHECKSUM_TIMEOUT
+     * @param done 结束时调用，参数为结果状态码、CRC-32 和服务器的错误消息，
+     *             执行线程同 asyncCmdToServer()
+     */
+    void asyncRequestCrc32(
+        SOCKET controlSock, RemoteChecksum method,
+        const std::string &remoteFilepath, int timeout,
+        std::function<void(CmdToServerRet, std::uint32_t, std::string)> done);
+
+    /**
+     * @brief enterDeflateMode() 的非阻塞版本
+     * @author zhb
+     * @param controlSock 控制连接
+     * @param level 压缩级别 1 ~ 9
+     * @param timeout 等待回复的超时时间(ms)
+     * @param done 结束时调用，参数为结果状态码和服务器的错误消息，
+     *             执行线程同 asyncCmdToServer()
+     */
+    void asyncEnterDeflateMode(
+        SOCKET controlSock, int level, int timeout,
+        std::function<void(CmdToServerRet, std::string)> done);
+
+    enum class VerifyChecksumRes
+    {
+        //与服务器算出的一致
+        MATCHED,
+        //不一致，文件在传输中损坏或被改动
+        MISMATCHED,
+        //服务器不支持 XCRC / HASH，或拒绝计算，无法校验
+        UNSUPPORTED,
+        //网络错误
+        FAILED
+    };
+
+    /**
+     * @brief 非阻塞地用 FEAT 找出服务器计算 CRC-32 的命令，再与本地的比较
+     * @author zhb
+     * @param controlSock 控制连接，上面不能有未收取的回复（如已收到 226）
+     * @param remoteFilepath 服务器文件路径
+     * @param localCrc 传输时算出的 CRC-32
+     * @param timeout 等待 FEAT 等普通命令回复的超时时间(ms)
+     * @param done 结束时调用，参数为校验结果和服务器的 CRC-32，
+     *             执行线程同 asyncCmdToServer()
+     *
+     * 结果不为 FAILED 时控制连接仍可继续使用。
+     * CapabilityCache 中已有该服务器的 FEAT 结果时不再发送 FEAT
+     */
+    void asyncVerifyCrc32(
+        SOCKET controlSock, const std::string &remoteFilepath,
+        std::uint32_t localCrc, int timeout,
+        std::function<void(VerifyChecksumRes, std::uint32_t)> done);
+
     /**
      * @brief 连接到服务器并登录
      * @author zhb
@@ -126,6 +296,19 @@ namespace ftpclient
     CmdToServerRet putServerIntoEpsvMode(SOCKET controlSock, int &port,
                                          std::string &errorMsg);
 
+    /**
+     * @brief 让服务器进入被动模式，按 asyncEnterPassiveMode() 的规则
+     * 选择 PASV 或 EPSV
+     * @author zhb
+     * @param controlSock 控制连接
+     * @param hostname 出口参数，数据连接的 IP 地址
+     * @param port 出口参数，数据连接的端口号
+     * @param errorMsg 出口参数，来自服务器的错误信息
+     * @return 结果状态码
+     */
+    CmdToServerRet enterPassiveMode(SOCKET controlSock, std::string &hostname,
+                                    int &port, std::string &errorMsg);
+
     /**
      * @brief 向服务器发送 STOR 或 APPE 命令，请求上传文件
      * @author zhb
@@ -162,6 +345,20 @@ namespace ftpclient
     CmdToServerRet requestRestFromServer(SOCKET controlSock, long long offset,
                                          std::string &errorMsg);
 
+    /**
+     * @brief 非阻塞地发送 REST 命令
+     * @author zhb
+     * @param controlSock 控制连接
+     * @param offset 偏移量，单位字节
+     * @param timeout 等待回复的超时时间(ms)
+     * @param done 结束时调用，参数为结果状态码和收到的回复，
+     *             执行线程同 asyncCmdToServer()
+     *
+     * 与 requestRestFromServer() 一样把结果记入 CapabilityCache 的 restStream
+     */
+    void asyncRequestRest(SOCKET controlSock, long long offset, int timeout,
+                          std::function<void(CmdToServerRet, std::string)> done);
+
     /**
      * @brief 获取服务器上某个文件的大小
      * @author zhb
@@ -211,6 +408,32 @@ namespace ftpclient
                                                 bool binaryMode,
                                                 std::string &errorMsg);
 
+    /**
+     * @brief 让服务器以 MODE Z（zlib 压缩）方式传输数据
+     * @author zhb
+     * @param controlSock 控制连接
+     * @param level 压缩级别 1 ~ 9，服务器拒绝 OPTS 时用服务器的默认级别
+     * @param errorMsg 出口参数，来自服务器的错误信息
+     * @return 结果状态码
+     *
+     * 先用 FEAT 确认服务器支持 MODE Z，不支持时返回 FAILED_WITH_MSG，
+     * 调用者应继续用默认的 MODE S 传输。同一服务器的 FEAT 只发一次，
+     * 之后从 CapabilityCache 中取
+     */
+    CmdToServerRet enterDeflateMode(SOCKET controlSock, int level,
+                                    std::string &errorMsg);
+
+    /**
+     * @brief 恢复默认的 MODE S（不压缩）传输方式
+     * @author zhb
+     * @param controlSock 控制连接
+     * @param errorMsg 出口参数，来自服务器的错误信息
+     * @return 结果状态码
+     *
+     * 控制连接还回 SessionPool 前必须恢复
+     */
+    CmdToServerRet enterStreamMode(SOCKET controlSock, std::string &errorMsg);
+
     /**
      * @brief 向服务器发 NOOP 命令
      * @author zhb
@@ -284,45 +507,199 @@ namespace ftpclient
                                          bool isNameList,
                                          std::string &errorMsg);
 
+    //数据连接每次收发使用的缓冲区大小（字节）
+    const int DEFAULT_TRANSFER_BUFFER_SIZE = 256 * 1024;
+    const int MIN_TRANSFER_BUFFER_SIZE = 64 * 1024;
+    const int MAX_TRANSFER_BUFFER_SIZE = 8 * 1024 * 1024;
+
+    /**
+     * @brief 把缓冲区大小限制在 [MIN, MAX] 范围内
+     * @author zhb
+     */
+    int clampTransferBufferSize(int bufferSize);
+
     enum class UploadFileDataRes
     {
         SUCCEEDED,
         SEND_FAILED,
-        READ_FILE_ERROR
+        READ_FILE_ERROR,
+        //无法零拷贝发送（不是普通文件或平台不支持），尚未发送任何数据
+        ZERO_COPY_UNSUPPORTED,
+        //无法用 io_uring 读文件（平台或内核不支持），尚未发送任何数据
+        DISK_QUEUE_UNSUPPORTED
     };
 
+    //上传流水线中预读的块数
+    const int DEFAULT_UPLOAD_PIPELINE_DEPTH = 4;
+    // io_uring 读写本地文件时同时进行的块数，0 表示不使用 io_uring
+    const int DEFAULT_DISK_QUEUE_DEPTH = 8;
+    const int MAX_DISK_QUEUE_DEPTH = 64;
+
     /**
      * @brief 将文件数据上传到服务器
      * @author zhb
      * @param dataSock 数据连接
      * @param ifs 文件输入流
-     * @param percent 出口参数，已上传百分比
+     * @param progress 每发送一块累加已发送的字节数
+     * @param throttle 限速
+     * @param checksum 非空时在读文件的同时计算 CRC-32
+     * @param bufferSize 每次读文件、send() 的字节数
+     * @param pipelineDepth 预读的块数，为 1 时读文件与发送交替进行
+     * @return 结果状态码
+     *
+     * 读文件与发送是两级流水线：另开一个线程把文件读入环形缓冲区，
+     * 当前线程从中取出数据发送，慢速磁盘与慢速网络互不阻塞。
+     * 缓冲区从 utils::BufferPool 中借用
+     */
+    UploadFileDataRes
+    uploadFileDataToServer(SOCKET dataSock, std::ifstream &ifs,
+                           utils::TransferProgress &progress,
+                           const utils::Throttle &throttle,
+                           utils::Crc32 *checksum,
+                           int bufferSize = DEFAULT_TRANSFER_BUFFER_SIZE,
+                           int pipelineDepth = DEFAULT_UPLOAD_PIPELINE_DEPTH);
+
+    /**
+     * @brief 以 MODE Z 方式将文件数据上传到服务器，边读边压缩
+     * @author zhb
+     * @param dataSock 数据连接
+     * @param ifs 文件输入流
+     * @param progress 累加已压缩发送的文件字节数（压缩前）
+     * @param throttle 限速，按实际发送的压缩数据计算
+     * @param checksum 非空时计算文件数据（压缩前）的 CRC-32
+     * @param level 压缩级别 1 ~ 9
+     * @param bufferSize 每次读文件的字节数
+     * @param pipelineDepth 预读的块数
+     * @return 结果状态码
+     *
+     * 读文件同 uploadFileDataToServer()，在另一个线程中预读
+     */
+    UploadFileDataRes
+    uploadFileDataDeflate(SOCKET dataSock, std::ifstream &ifs,
+                          utils::TransferProgress &progress,
+                          const utils::Throttle &throttle,
+                          utils::Crc32 *checksum, int level,
+                          int bufferSize = DEFAULT_TRANSFER_BUFFER_SIZE,
+                          int pipelineDepth = DEFAULT_UPLOAD_PIPELINE_DEPTH);
+
+    /**
+     * @brief 将文件数据上传到服务器，用 io_uring 读文件（仅 Linux）
+     * @author zhb
+     * @param dataSock 数据连接
+     * @param localFilepath 本地文件路径
+     * @param offset 从文件的哪个位置开始上传（断点续传）
+     * @param progress 每发送一块累加已发送的字节数
+     * @param throttle 限速
+     * @param checksum 非空时计算 CRC-32
+     * @param bufferSize 每次读文件的字节数
+     * @param ioDepth 同时在读的块数
+     * @return 结果状态码，不支持 io_uring 时为 DISK_QUEUE_UNSUPPORTED
+     *
+     * 发送一块时后面的块已经在读，与 uploadFileDataToServer() 的效果相同，
+     * 但不需要读线程，读文件也不再是每块一次系统调用和一次线程切换
+     */
+    UploadFileDataRes
+    uploadFileDataQueued(SOCKET dataSock, const std::string &localFilepath,
+                         long long offset, utils::TransferProgress &progress,
+                         const utils::Throttle &throttle,
+                         utils::Crc32 *checksum,
+                         int bufferSize = DEFAULT_TRANSFER_BUFFER_SIZE,
+                         int ioDepth = DEFAULT_DISK_QUEUE_DEPTH);
+
+    //零拷贝上传时每次交给内核的字节数，每块发送完后更新一次进度
+    const long long ZERO_COPY_CHUNK_SIZE = 4 * 1024 * 1024;
+    //零拷贝下载时管道的容量，也是每次 splice() 的最大字节数
+    const int ZERO_COPY_PIPE_SIZE = 1024 * 1024;
+
+    /**
+     * @brief 以零拷贝方式将文件数据上传到服务器
+     * @author zhb
+     * @param dataSock 数据连接
+     * @param localFilepath 本地文件路径
+     * @param offset 从文件的哪个位置开始发送（断点续传）
+     * @param progress 每发送一块累加已发送的字节数
+     * @param throttle 限速
      * @return 结果状态码
+     *
+     * Linux 下使用 sendfile()，Windows 下使用 TransmitFile()，
+     * 数据由内核直接从文件发往 socket，不经过用户态缓冲区。
+     * 返回 ZERO_COPY_UNSUPPORTED 时应改用 uploadFileDataToServer()
      */
-    UploadFileDataRes uploadFileDataToServer(SOCKET dataSock,
-                                             std::ifstream &ifs, int &percent);
+    UploadFileDataRes uploadFileDataZeroCopy(SOCKET dataSock,
+                                             const std::string &localFilepath,
+                                             long long offset,
+                                             utils::TransferProgress &progress,
+                                             const utils::Throttle &throttle);
+
+    //下载超过这个大小的文件时，写过的部分不再留在页缓存中
+    const long long DROP_CACHE_MIN_FILESIZE = 1024LL * 1024 * 1024;
 
     enum class DownloadFileDataRes
     {
         SUCCEEDED,
         GET_SIZE_FAILED,
         RECV_FAILED,
-        READ_FILE_ERROR
+        READ_FILE_ERROR,
+        //无法零拷贝接收（平台不支持），尚未接收任何数据
+        ZERO_COPY_UNSUPPORTED
     };
 
     /**
      * @brief 下载服务器文件
      * @author zhb
      * @param dataSock 数据连接
-     * @param ofs 文件输出流
-     * @param remoteFilesize 服务器上文件大小
-     * @param percent 出口参数，已下载百分比
+     * @param writer 写本地文件，决定写入位置和每次写文件的字节数
+     * @param progress 每接收一块累加已接收的字节数
+     * @param throttle 限速
+     * @param checksum 非空时顺带计算收到的数据的 CRC-32
+     * @return 结果状态码
+     *
+     * 直接 recv() 到 writer 的缓冲区中，攒满一块才写文件；
+     * 接收失败时也会写出已收到的数据，以便续传
+     */
+    DownloadFileDataRes
+    downloadFileDataFromServer(SOCKET dataSock, utils::SequentialWriter &writer,
+                               utils::TransferProgress &progress,
+                               const utils::Throttle &throttle,
+                               utils::Crc32 *checksum);
+
+    /**
+     * @brief 以 MODE Z 方式下载服务器文件，边收边解压
+     * @author zhb
+     * @param dataSock 数据连接
+     * @param writer 写本地文件
+     * @param progress 累加解压后写入文件的字节数
+     * @param throttle 限速，按实际收到的压缩数据计算
+     * @param checksum 非空时计算解压后数据的 CRC-32
+     * @param bufferSize 每次 recv() 的最大字节数
+     * @return 结果状态码
+     *
+     * 压缩流没有正常结束就断开连接视为 RECV_FAILED
+     */
+    DownloadFileDataRes
+    downloadFileDataInflate(SOCKET dataSock, utils::SequentialWriter &writer,
+                            utils::TransferProgress &progress,
+                            const utils::Throttle &throttle,
+                            utils::Crc32 *checksum,
+                            int bufferSize = DEFAULT_TRANSFER_BUFFER_SIZE);
+
+    /**
+     * @brief 以零拷贝方式下载服务器文件
+     * @author zhb
+     * @param dataSock 数据连接
+     * @param localFilepath 本地文件路径
+     * @param offset 写入本地文件的起始位置（断点续传）
+     * @param progress 每接收一块累加已接收的字节数
+     * @param throttle 限速
      * @return 结果状态码
+     *
+     * Linux 下通过管道用 splice() 把数据从 socket 搬到文件，
+     * 不经过用户态缓冲区。
+     * 返回 ZERO_COPY_UNSUPPORTED 时应改用 downloadFileDataFromServer()
      */
-    DownloadFileDataRes downloadFileDataFromServer(SOCKET dataSock,
-                                                   std::ofstream &ofs,
-                                                   long long remoteFilesize,
-                                                   int &percent);
+    DownloadFileDataRes downloadFileDataZeroCopy(
+        SOCKET dataSock, const std::string &localFilepath, long long offset,
+        utils::TransferProgress &progress, const utils::Throttle &throttle);
 
 } // namespace ftpclient
 
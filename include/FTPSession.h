@@ -1,13 +1,18 @@
 #ifndef FTPSESSION_H
 #define FTPSESSION_H
 
+#include "../include/CommandPipeline.h"
 #include "../include/FTPFunction.h"
+#include "../include/Socket.h"
 #include <QObject>
 #include <QTimer>
+#include <algorithm>
+#include <condition_variable>
 #include <functional>
+#include <memory>
 #include <mutex>
 #include <string>
-#include <winsock2.h>
+#include <vector>
 
 namespace ftpclient
 {
@@ -23,16 +28,13 @@ namespace ftpclient
          * @param password 密码
          * @param port 端口号
          * @param autoKeepAlive 自动发送 NOOP 命令保活
+         * @param pooled 是否优先从 SessionPool 取已登录的控制连接
          */
         FTPSession(const std::string &hostname, const std::string &username,
                    const std::string password, int port = 21,
-                   bool autoKeepAlive = true);
+                   bool autoKeepAlive = true, bool pooled = false);
         //析构函数
-        ~FTPSession()
-        {
-            this->quit();
-            WSACleanup();
-        }
+        ~FTPSession() { this->quit(); }
         //禁止复制
         FTPSession(const FTPSession &) = delete;
         FTPSession &operator=(const FTPSession &) = delete;
@@ -40,6 +42,9 @@ namespace ftpclient
         /**
          * @brief 连接服务器->登录->切换为二进制模式
          * @author zhb
+         *
+         * pooled 为 true 且池中有可用连接时，直接发射
+         * setTransferModeSucceeded(true)
          */
         void connectAndLogin();
 
@@ -139,6 +144,22 @@ namespace ftpclient
          */
         void renameFile(const std::string &oldName, const std::string &newName);
 
+        /**
+         * @brief 以流水线方式发送一条命令
+         * @author zhb
+         * @param cmd 命令，必须以"\r\n"结尾，不能是 RETR、LIST 等
+         *            需要数据连接的命令
+         * @param expectedCodes 可接受的回复码
+         * @param done 收到回复或出错时在 GUI 线程中调用，参数为结果状态码和回复
+         *
+         * 同一轮事件中加入的命令（如批量删除时对每个文件调用一次）
+         * 回到事件循环后由一个 CommandPipeline 连续发出，按顺序匹配回复，
+         * 不必每条命令等一个 RTT。服务器不支持流水线时自动逐条发送
+         */
+        void pipelineCommand(
+            const std::string &cmd, std::vector<int> expectedCodes,
+            std::function<void(CmdToServerRet, std::string)> done);
+
         /**
          * @brief 获取当前目录中的文件名
          * @author zhb
@@ -151,12 +172,33 @@ namespace ftpclient
          */
         void listWorkingDir(bool isNameList = true);
 
+        /**
+         * @brief 设置获取目录列表时的 MODE Z 压缩级别
+         * @author zhb
+         * @param level 0 表示不压缩，1 ~ 9 为 zlib 的压缩级别
+         *
+         * 每次 LIST 前后要多发 FEAT、MODE Z、MODE S 几条命令，
+         * 只在目录很大或网络很慢时才划算
+         */
+        void setCompressionLevel(int level)
+        {
+            compressionLevel = std::max(0, std::min(level, 9));
+        }
+
         /**
          * @brief 关闭控制端口的连接
          * @author zhb
          */
         void quit();
 
+        /**
+         * @brief 把控制连接还给 SessionPool 而不关闭
+         * @author zhb
+         *
+         * 只能在控制连接空闲（如收到 226 之后）时调用
+         */
+        void releaseToPool();
+
         std::string getHostname() const { return hostname; }
         int getPort() const { return port; }
         std::string getUsername() const { return username; }
@@ -353,6 +395,36 @@ namespace ftpclient
                           void (FTPSession::*failedWithMsgSignal)(std::string),
                           void (FTPSession::*failedSignal)());
 
+        /**
+         * @brief 通过 Reactor 发送一条命令，结束后发射信号
+         * @author zhb
+         * @param cmd 命令，必须以"\r\n"结尾
+         * @param expectedCodes 可接受的回复码
+         *
+         * 信号参数同 runProcedure()
+         * 等待回复时不占用线程池中的线程，适用于只有一条命令的操作
+         */
+        void runCommand(const std::string &cmd, std::vector<int> expectedCodes,
+                        void (FTPSession::*succeededSignal)(),
+                        void (FTPSession::*failedWithMsgSignal)(std::string),
+                        void (FTPSession::*failedSignal)());
+
+        /**
+         * @brief 发出 pipelineCommand() 积累的命令
+         * @author zhb
+         */
+        void flushPipeline();
+
+        /**
+         * @brief 根据结果状态码发射 runProcedure() / runCommand() 的信号
+         * @author zhb
+         */
+        void emitProcedureResult(
+            CmdToServerRet res, std::string errorMsg,
+            void (FTPSession::*succeededSignal)(),
+            void (FTPSession::*failedWithMsgSignal)(std::string),
+            void (FTPSession::*failedSignal)());
+
         /**
          * @brief 创建socket、连接服务器
          * @author zhb
@@ -403,9 +475,56 @@ namespace ftpclient
         bool isConnected;
         //每隔一段时间给服务器发 NOOP 命令
         bool autoKeepAlive;
+        //是否使用 SessionPool
+        bool pooled;
+        //目录列表的 MODE Z 压缩级别，0 表示不压缩
+        int compressionLevel = 0;
+        //pipelineCommand() 加入、还没发出的命令
+        std::shared_ptr<CommandPipeline> pendingPipeline;
         QTimer sendNoopTimer;
+
+        /**
+         * @brief 控制连接的锁，可以在一个线程加锁、在另一个线程解锁
+         * @author zhb
+         *
+         * runCommand() 在 GUI 线程加锁，收到回复后在 Reactor 线程解锁，
+         * std::mutex 不允许这样用
+         */
+        class ControlLock
+        {
+        public:
+            void lock()
+            {
+                std::unique_lock<std::mutex> guard(mutex);
+                unlocked.wait(guard, [this]() { return !locked; });
+                locked = true;
+            }
+            bool try_lock()
+            {
+                std::lock_guard<std::mutex> guard(mutex);
+                if (locked)
+                    return false;
+                locked = true;
+                return true;
+            }
+            void unlock()
+            {
+                {
+                    std::lock_guard<std::mutex> guard(mutex);
+                    locked = false;
+                }
+                unlocked.notify_one();
+            }
+
+        private:
+            std::mutex mutex;
+            std::condition_variable unlocked;
+            bool locked = false;
+        };
+        using LockGuard = std::lock_guard<ControlLock>;
+
         //防止自动发 NOOP 的线程跟发命令的线程同时使用 socket
-        std::mutex sockMutex;
+        ControlLock sockMutex;
 
         static const int SOCKET_SEND_TIMEOUT = 1000;
         static const int SOCKET_RECV_TIMEOUT = 1000;
@@ -0,0 +1,123 @@
+//解析 FTP 服务器回复的函数
+//只在 string_view 上做扫描，不分配内存、不编译正则
+#ifndef FTP_REPLY_H
+#define FTP_REPLY_H
+
+#include <cstdint>
+#include <initializer_list>
+#include <string_view>
+
+namespace ftpclient
+{
+
+    /**
+     * @brief 读取一行开头的三位回复码
+     * @author zhb
+     * @param line 服务器回复（的第一行）
+     * @return 回复码，格式不对时返回 -1
+     *
+     * 回复码后面必须是' '、'-'、"\r\n"或者行尾
+     */
+    int parseReplyCode(std::string_view line);
+
+    /**
+     * @brief 是否为多行回复的第一行，即"NNN-text"
+     * @author zhb
+     */
+    bool isMultiLineReplyStart(std::string_view line);
+
+    /**
+     * @brief 是否为多行回复的最后一行，即"NNN text"
+     * @author zhb
+     * @param line 一行回复
+     * @param code 第一行的回复码
+     */
+    bool isLastReplyLine(std::string_view line, int code);
+
+    /**
+     * @brief 回复码是否为给定的几个之一
+     * @author zhb
+     * @param reply 服务器回复
+     * @param codes 可接受的回复码
+     */
+    bool replyCodeIn(std::string_view reply, std::initializer_list<int> codes);
+
+    /**
+     * @brief 解析"227 Entering passive mode (h1,h2,h3,h4,p1,p2)"
+     * @author zhb
+     * @param reply 服务器回复
+     * @param host 出口参数，IPv4 地址的四个字节
+     * @param port 出口参数，端口号
+     * @return 格式是否正确
+     */
+    bool parsePasvReply(std::string_view reply, int (&host)[4], int &port);
+
+    /**
+     * @brief 解析"229 Entering Extended Passive Mode (|||port|)"
+     * @author zhb
+     * @param reply 服务器回复
+     * @param port 出口参数，端口号
+     * @return 格式是否正确
+     *
+     * 按 RFC 2428，分隔符不一定是'|'，这里取括号后的第一个字符
+     */
+    bool parseEpsvReply(std::string_view reply, int &port);
+
+    /**
+     * @brief 解析"213 size"
+     * @author zhb
+     * @param reply 服务器回复
+     * @param size 出口参数，文件大小
+     * @return 格式是否正确
+     */
+    bool parseSizeReply(std::string_view reply, long long &size);
+
+    /**
+     * @brief 解析 257 "dir" is current directory.
+     * @author zhb
+     * @param reply 服务器回复
+     * @param path 出口参数，引号中的路径（其中的""尚未还原成"）
+     * @return 格式是否正确
+     */
+    bool parsePathReply(std::string_view reply, std::string_view &path);
+
+    /**
+     * @brief FEAT 的回复中是否列出了某个特性
+     * @author zhb
+     * @param reply "211-Features:\r\n MODE Z\r\n SIZE\r\n211 End"
+     * @param feature 特性，如"MODE Z"，忽略大小写
+     *
+     * 特性所在行在 feature 之后只能是空白或行尾
+     */
+    bool hasFeature(std::string_view reply, std::string_view feature);
+
+    //服务器计算文件 CRC-32 的命令
+    enum class RemoteChecksum
+    {
+        NONE,      //不支持
+        XCRC,      // XCRC path
+        HASH_CRC32 // OPTS HASH CRC32 + HASH path
+    };
+
+    /**
+     * @brief 从 FEAT 的回复中找出计算 CRC-32 的命令，两者都有时用 XCRC
+     * @author zhb
+     * @param reply "211-Features:\r\n XCRC\r\n HASH SHA-1;CRC32\r\n211 End"
+     */
+    RemoteChecksum parseChecksumFeature(std::string_view reply);
+
+    /**
+     * @brief 解析 XCRC 或 HASH 的回复，如"250 1A2B3C4D"、
+     * "213 CRC32 0-1234 1a2b3c4d file"
+     * @author zhb
+     * @param reply 服务器回复
+     * @param crc 出口参数，CRC-32
+     * @return 格式是否正确
+     *
+     * 取回复码后第一个恰好 8 位的十六进制数
+     */
+    bool parseCrc32Reply(std::string_view reply, std::uint32_t &crc);
+
+} // namespace ftpclient
+
+#endif // FTP_REPLY_H
@@ -0,0 +1,106 @@
+//传输时读写本地文件用的 io_uring（仅 Linux），直接使用系统调用，不依赖 liburing
+#ifndef IO_URING_H
+#define IO_URING_H
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <utility>
+#include <vector>
+
+namespace utils
+{
+
+    /**
+     * @brief 一个 io_uring 实例：提交队列 + 完成队列
+     * @author zhb
+     *
+     * 只支持已注册缓冲区上的定位读写（READ_FIXED / WRITE_FIXED）。
+     * 内核或平台不支持、被禁用时 isAvailable() 为 false，调用方应改用
+     * 普通的 pread / pwrite。不是线程安全的，每个传输线程各用一个
+     */
+    class IoUring
+    {
+    public:
+        struct Completion
+        {
+            //提交时给出的标记
+            std::uint64_t tag;
+            //读写的字节数，出错时为 -errno
+            int res;
+        };
+
+        /**
+         * @param entries 队列深度，即最多同时进行的请求数
+         */
+        explicit IoUring(unsigned entries);
+        ~IoUring();
+        //禁止复制
+        IoUring(const IoUring &) = delete;
+        IoUring &operator=(const IoUring &) = delete;
+
+        bool isAvailable() const;
+
+        /**
+         * @brief 注册缓冲区，内核不必在每次读写时重新锁定这些内存页
+         * @author zhb
+         * @param buffers 缓冲区，下标即读写时的 bufIndex
+         * @return 是否成功，失败时（如超出 RLIMIT_MEMLOCK）不能使用本实例
+         */
+        bool registerBuffers(const std::vector<std::pair<char *, std::size_t>>
+                                 &buffers);
+
+        /**
+         * @brief 把一个读请求放入提交队列，在下次 submit() 或 wait() 时提交
+         * @author zhb
+         * @param fd 文件描述符
+         * @param bufIndex 注册时缓冲区的下标
+         * @param data 读入的位置，须在该缓冲区内
+         * @param len 字节数
+         * @param offset 文件中的位置
+         * @param tag 完成时原样返回的标记
+         * @return 提交队列已满时返回 false
+         */
+        bool prepareRead(int fd, int bufIndex, char *data, unsigned len,
+                         long long offset, std::uint64_t tag);
+
+        /**
+         * @brief 把一个写请求放入提交队列，参数同 prepareRead()
+         * @author zhb
+         */
+        bool prepareWrite(int fd, int bufIndex, const char *data,
+                          unsigned len, long long offset, std::uint64_t tag);
+
+        /**
+         * @brief 提交已放入队列的请求，不等待完成
+         * @author zhb
+         * @return 是否成功
+         */
+        bool submit();
+
+        /**
+         * @brief 取一个已完成的请求，没有时返回 false，不进入内核
+         * @author zhb
+         */
+        bool peek(Completion &completion);
+
+        /**
+         * @brief 提交已放入队列的请求，并等待一个请求完成
+         * @author zhb
+         * @param completion 出口参数，完成的请求
+         * @return 是否成功
+         *
+         * 提交与等待合并为一次 io_uring_enter()
+         */
+        bool wait(Completion &completion);
+
+    private:
+        struct Rings;
+        bool enter(unsigned minComplete);
+
+        std::unique_ptr<Rings> rings;
+    };
+
+} // namespace utils
+
+#endif // IO_URING_H
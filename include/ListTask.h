@@ -20,11 +20,14 @@ namespace ftpclient
          * @param session FTPSesson对象引用
          * @param dir 要获取的目录名
          * @param isNameList 仅获取文件名
+         * @param compressionLevel MODE Z 压缩级别，0 表示不压缩
          */
-        ListTask(FTPSession &session, const std::string &dir, bool isNameList)
+        ListTask(FTPSession &session, const std::string &dir, bool isNameList,
+                 int compressionLevel = 0)
             : session(session),
               dir(dir),
               isNameList(isNameList),
+              compressionLevel(compressionLevel),
               dataSock(INVALID_SOCKET),
               isConnect(false)
         {
@@ -56,6 +59,10 @@ namespace ftpclient
                            std::string &errorMsg);
 
     private:
+        /**
+         * @brief 服务器支持时切换为 MODE Z，列表传输结束后恢复 MODE S
+         * @author zhb
+         */
         Res start(std::string &errorMsg);
 
         /**
@@ -113,6 +120,9 @@ namespace ftpclient
         std::string dir;
         //是否仅仅获取文件名
         bool isNameList;
+        int compressionLevel;
+        //本次是否为 MODE Z
+        bool isDeflate = false;
         //若 socket 未创建，则为 INVALID_SOCKET
         SOCKET dataSock;
         //数据连接是否建立
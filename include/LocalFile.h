@@ -0,0 +1,317 @@
+//本地文件的薄封装，提供系统原生句柄
+//零拷贝传输（sendfile/TransmitFile 等）需要句柄而不是 iostream
+#ifndef LOCAL_FILE_H
+#define LOCAL_FILE_H
+
+#include "../include/BufferPool.h"
+#include "../include/IoUring.h"
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace utils
+{
+
+    /**
+     * @brief 以原生句柄方式打开的本地文件，析构时自动关闭
+     * @author zhb
+     */
+    class LocalFile
+    {
+    public:
+#ifdef _WIN32
+        using NativeHandle = void *; // HANDLE
+#else
+        using NativeHandle = int; //文件描述符
+#endif
+
+        LocalFile();
+        ~LocalFile() { this->close(); }
+        LocalFile(LocalFile &&other) noexcept;
+        LocalFile &operator=(LocalFile &&other) noexcept;
+        //禁止复制
+        LocalFile(const LocalFile &) = delete;
+        LocalFile &operator=(const LocalFile &) = delete;
+
+        /**
+         * @brief 以只读方式打开文件
+         * @author zhb
+         * @param path 文件路径
+         * @return 是否成功
+         */
+        bool openForRead(const std::string &path);
+
+        /**
+         * @brief 以写方式打开文件，文件不存在时创建，不截断已有内容
+         * @author zhb
+         * @param path 文件路径
+         * @return 是否成功
+         */
+        bool openForWrite(const std::string &path);
+
+        /**
+         * @brief 关闭文件
+         * @author zhb
+         */
+        void close();
+
+        bool isOpen() const;
+
+        /**
+         * @brief 是否为普通磁盘文件（管道、设备等不是）
+         * @author zhb
+         */
+        bool isRegularFile() const;
+
+        /**
+         * @brief 获取文件大小（字节）
+         * @author zhb
+         * @return 文件大小，出错时返回 -1
+         */
+        long long size() const;
+
+        /**
+         * @brief 把文件大小设为 size（变长的部分读出来为 0）
+         * @author zhb
+         * @param size 新的文件大小
+         * @return 是否成功
+         */
+        bool resize(long long size);
+
+        /**
+         * @brief 在指定位置写入数据，不改变也不依赖文件指针
+         * @author zhb
+         * @param data 数据
+         * @param len 字节数
+         * @param offset 写入位置
+         * @return 是否全部写入成功
+         *
+         * 多个线程可以同时对同一个文件的不同位置调用
+         */
+        bool writeAt(const char *data, std::size_t len, long long offset);
+
+        /**
+         * @brief 从指定位置读数据，不改变也不依赖文件指针
+         * @author zhb
+         * @param data 读入的位置
+         * @param len 最多读的字节数
+         * @param offset 读取位置
+         * @return 读到的字节数，到文件结尾时为 0，出错时为 -1
+         */
+        long long readAt(char *data, std::size_t len, long long offset);
+
+        /**
+         * @brief 预先为文件分配 size 字节的磁盘空间，不改变文件大小
+         * @author zhb
+         * @param size 最终的文件大小
+         * @return 是否成功，失败（文件系统或平台不支持）时照常写入即可
+         *
+         * Linux 下为 fallocate(FALLOC_FL_KEEP_SIZE)，Windows 下为
+         * FileAllocationInfo；一次分配连续的空间，避免边写边扩展造成碎片。
+         * 文件大小不变，续传时仍可按文件大小确定断点
+         */
+        bool preallocate(long long size);
+
+        /**
+         * @brief 让内核开始把 [offset, offset + len) 写回磁盘，不等待
+         * @author zhb
+         *
+         * 与 dropCache() 配合使用；仅 Linux 下有效，其余平台什么也不做
+         */
+        void startWriteback(long long offset, long long len);
+
+        /**
+         * @brief 等 [offset, offset + len) 写回磁盘后，提示内核不再缓存这部分
+         * @author zhb
+         *
+         * 下载超大文件时避免把其他程序的缓存挤出去；
+         * 仅 Linux 下有效（posix_fadvise），其余平台什么也不做
+         */
+        void dropCache(long long offset, long long len);
+
+        NativeHandle nativeHandle() const { return handle; }
+
+    private:
+        NativeHandle handle;
+    };
+
+    /**
+     * @brief 顺序写文件：把零碎的数据攒成大块，按块对齐写入
+     * @author zhb
+     *
+     * recv() 每次收到的字节数不定，直接写文件会产生大量小写入；
+     * 攒满一块再写，写入位置（除第一块外）都是块大小的整数倍。
+     * 指定 ioDepth 时（仅 Linux）用 io_uring 写文件：攒满的块提交后立即
+     * 换一块缓冲区继续接收，最多 ioDepth 块同时在写，磁盘延迟与网络传输重叠。
+     * 缓冲区从 utils::BufferPool 中借用
+     */
+    class SequentialWriter
+    {
+    public:
+        //启用 dropCache 时每写满这么多字节就丢弃更早的缓存
+        static const long long DROP_CACHE_WINDOW = 32 * 1024 * 1024;
+
+        /**
+         * @param file 已打开的文件
+         * @param offset 从文件的哪个位置开始写
+         * @param blockSize 每次写文件的字节数
+         * @param dropCache 写过的部分是否提示内核不再缓存，用于超大文件
+         * @param ioDepth io_uring 同时写的块数，小于 2 或不支持时同步写
+         */
+        SequentialWriter(LocalFile &file, long long offset,
+                         std::size_t blockSize, bool dropCache = false,
+                         int ioDepth = 0);
+        //等待还在写的块
+        ~SequentialWriter();
+        //禁止复制
+        SequentialWriter(const SequentialWriter &) = delete;
+        SequentialWriter &operator=(const SequentialWriter &) = delete;
+
+        bool isAllocFailed() const { return slots.empty(); }
+
+        /**
+         * @brief 是否在使用 io_uring
+         */
+        bool isQueued() const { return ring != nullptr; }
+
+        /**
+         * @brief 缓冲区中的空闲空间，可以直接 recv() 进去，之后调用 commit()
+         * @author zhb
+         */
+        char *space() { return slots[current].buffer.data() + used; }
+        std::size_t spaceSize() const { return limit - used; }
+
+        /**
+         * @brief 确认已向 space() 写入了 len 个字节，攒满一块时写文件
+         * @author zhb
+         * @return 写文件是否成功
+         */
+        bool commit(std::size_t len);
+
+        /**
+         * @brief 追加数据，攒满一块时写文件
+         * @author zhb
+         * @return 写文件是否成功
+         */
+        bool write(const char *data, std::size_t len);
+
+        /**
+         * @brief 写出缓冲区中剩余的数据，并等待所有块写完
+         * @author zhb
+         * @return 写文件是否成功
+         */
+        bool flush();
+
+    private:
+        struct Slot
+        {
+            BufferPool::Buffer buffer;
+            //正在写的位置和字节数
+            long long pos = 0;
+            std::size_t len = 0;
+            bool busy = false;
+        };
+
+        bool writeBuffer();
+        //处理一个写完的块
+        bool complete(const IoUring::Completion &completion);
+        //等待所有块写完
+        bool drain();
+
+        LocalFile &file;
+        //各块缓冲区，同步写时只有一块
+        std::vector<Slot> slots;
+        //正在接收数据的块
+        std::size_t current = 0;
+        //正在写的块数
+        int inFlight = 0;
+        //缓冲区中已有的字节数
+        std::size_t used = 0;
+        //本块的大小，第一块只写到下一个对齐位置
+        std::size_t limit;
+        //缓冲区第一个字节在文件中的位置
+        long long pos;
+        bool isDropCache;
+        //还在缓存中、尚未 dropCache() 的起始位置
+        long long cachedFrom;
+        //析构时先于 slots 销毁，此时已没有进行中的写
+        std::unique_ptr<IoUring> ring;
+    };
+
+    /**
+     * @brief 顺序读文件：按块对齐读出，用于上传
+     * @author zhb
+     *
+     * 指定 ioDepth 时（仅 Linux）用 io_uring 预读：取走一块的同时，
+     * 后面 ioDepth - 1 块已经在读，不需要单独的读线程
+     */
+    class SequentialReader
+    {
+    public:
+        /**
+         * @param file 已打开的文件，读到打开时的文件大小为止
+         * @param offset 从文件的哪个位置开始读
+         * @param blockSize 每次读文件的字节数
+         * @param ioDepth io_uring 同时读的块数，小于 2 或不支持时同步读
+         */
+        SequentialReader(LocalFile &file, long long offset,
+                         std::size_t blockSize, int ioDepth = 0);
+        //等待还在读的块
+        ~SequentialReader();
+        //禁止复制
+        SequentialReader(const SequentialReader &) = delete;
+        SequentialReader &operator=(const SequentialReader &) = delete;
+
+        bool isAllocFailed() const { return slots.empty(); }
+
+        /**
+         * @brief 是否在使用 io_uring
+         */
+        bool isQueued() const { return ring != nullptr; }
+
+        /**
+         * @brief 取下一块数据，上一次取出的块在此时归还
+         * @author zhb
+         * @param data 出口参数，数据
+         * @param len 出口参数，字节数，读完时为 0
+         * @return 读文件是否成功，文件在读的过程中变短也算失败
+         */
+        bool next(const char *&data, std::size_t &len);
+
+    private:
+        struct Slot
+        {
+            BufferPool::Buffer buffer;
+            //这一块在文件中的位置和字节数
+            long long pos = 0;
+            std::size_t len = 0;
+            //读到的字节数，出错时为 -errno
+            int res = 0;
+            bool done = false;
+        };
+
+        //为一块安排下一个位置的读
+        bool startRead(std::size_t index);
+        //把只读了一部分的块同步读满
+        bool fill(Slot &slot, std::size_t got);
+
+        LocalFile &file;
+        std::vector<Slot> slots;
+        //下一个要取出的块
+        std::size_t head = 0;
+        //上次 next() 取出的块是否还没归还
+        bool isHeadTaken = false;
+        //正在读的块数
+        int inFlight = 0;
+        //下一块的位置
+        long long nextPos;
+        //文件大小
+        long long end;
+        std::size_t blockSize;
+        std::unique_ptr<IoUring> ring;
+    };
+
+} // namespace utils
+
+#endif // LOCAL_FILE_H
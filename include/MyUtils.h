@@ -2,11 +2,11 @@
 #ifndef MYUTILS_H
 #define MYUTILS_H
 
+#include "../include/Socket.h"
 #include <fstream>
 #include <string>
 #include <utility>
 #include <vector>
-#include <winsock2.h>
 
 namespace utils
 {
@@ -58,9 +58,53 @@ namespace utils
      * @param controlSock 控制连接
      * @param recvMsg 出口参数，收到的消息
      * @return 收到的字节数，负数表示出错
+     *
+     * 每个控制连接有自己的接收缓冲区，一次 recv() 尽量多收一些数据，
+     * 多收到的字节留在缓冲区中供下次调用使用
      */
     int recvFtpMsg(SOCKET controlSock, std::string &recvMsg);
 
+    /**
+     * @brief 接收一条完整的服务器回复（按 RFC 959 处理多行回复）
+     * @author zhb
+     * @param controlSock 控制连接
+     * @param reply 出口参数，收到的回复（多行回复的各行拼接在一起）
+     * @return 收到的字节数，负数表示出错，0 表示对方关闭连接
+     *
+     * 多行回复的第一行形如"NNN-text"，直到出现以"NNN "开头的一行才结束，
+     * 收到最后一行后立即返回，不等待 recv() 超时
+     */
+    int recvFtpReply(SOCKET controlSock, std::string &reply);
+
+    /**
+     * @brief 从控制连接的接收缓冲区中取出一条完整的回复，不调用 recv()
+     * @author zhb
+     * @param controlSock 控制连接
+     * @param reply 出口参数，取出的回复
+     * @return 缓冲区中是否有完整的回复，没有时缓冲区保持不变
+     *
+     * 与 fillFtpMsgBuffer() 配合，供非阻塞方式（Reactor）接收回复
+     */
+    bool takeFtpReply(SOCKET controlSock, std::string &reply);
+
+    /**
+     * @brief 调用一次 recv()，把收到的数据追加到控制连接的接收缓冲区
+     * @author zhb
+     * @param controlSock 控制连接，应当已可读，否则会阻塞
+     * @return recv() 的返回值
+     */
+    int fillFtpMsgBuffer(SOCKET controlSock);
+
+    /**
+     * @brief 丢弃某个控制连接接收缓冲区中剩余的数据
+     * @author zhb
+     * @param controlSock 控制连接
+     *
+     * 关闭 socket 前应调用，防止句柄被复用时读到旧连接的数据。
+     * 其他线程可能正在读这个缓冲区，它们读完前缓冲区不会被释放
+     */
+    void discardFtpMsgBuffer(SOCKET controlSock);
+
     /**
      * @brief 获取文件的大小（字节）
      * @author zhb
@@ -0,0 +1,112 @@
+//传输限速：令牌桶
+#ifndef RATE_LIMITER_H
+#define RATE_LIMITER_H
+
+#include <atomic>
+#include <chrono>
+#include <mutex>
+
+namespace utils
+{
+
+    /**
+     * @brief 令牌桶限速器
+     * @author zhb
+     *
+     * 令牌按限速值匀速生成，桶中最多存 BURST_MS 毫秒的量；
+     * 每传输一块取走与字节数相同的令牌，不够时可以透支，
+     * 透支的部分折算成需要等待的时间。
+     * 限速值可以随时修改，不限速时 reserve() 只读一次原子变量
+     */
+    class RateLimiter
+    {
+    public:
+        //桶的容量（ms），即允许的突发量
+        static const int BURST_MS = 100;
+        //限速很低时每块也至少传这么多字节，避免块太小
+        static const long long MIN_CHUNK_SIZE = 4096;
+
+        /**
+         * @param bytesPerSecond 限速值（字节/秒），0 表示不限速
+         */
+        explicit RateLimiter(long long bytesPerSecond = 0);
+        //禁止复制
+        RateLimiter(const RateLimiter &) = delete;
+        RateLimiter &operator=(const RateLimiter &) = delete;
+
+        /**
+         * @brief 进程内所有上传共用的限速器
+         * @author zhb
+         */
+        static RateLimiter &globalUpload();
+
+        /**
+         * @brief 进程内所有下载共用的限速器
+         * @author zhb
+         */
+        static RateLimiter &globalDownload();
+
+        /**
+         * @brief 修改限速值，可在任意线程调用，正在进行的传输立即生效
+         * @author zhb
+         * @param bytesPerSecond 限速值（字节/秒），0 表示不限速
+         */
+        void setLimit(long long bytesPerSecond);
+
+        long long limit() const
+        {
+            return bytesPerSecond.load(std::memory_order_relaxed);
+        }
+
+        /**
+         * @brief 取走 bytes 个令牌
+         * @author zhb
+         * @return 令牌不足时需要等待的时间，足够时为 0
+         */
+        std::chrono::nanoseconds reserve(long long bytes);
+
+        /**
+         * @brief 按限速值缩小一块的大小，使每块的等待时间不超过 BURST_MS
+         * @author zhb
+         * @param wanted 希望传输的字节数
+         * @return 本块应传输的字节数，不限速时为 wanted
+         */
+        long long chunkSize(long long wanted) const;
+
+    private:
+        using Clock = std::chrono::steady_clock;
+
+        std::atomic<long long> bytesPerSecond;
+        //以下由 mutex 保护
+        std::mutex mutex;
+        double tokens;
+        Clock::time_point lastRefill;
+    };
+
+    /**
+     * @brief 一次传输受到的限速：自己的限速和同方向的全局限速
+     * @author zhb
+     *
+     * 两个指针都可为空，表示没有对应的限制
+     */
+    struct Throttle
+    {
+        RateLimiter *own = nullptr;
+        RateLimiter *global = nullptr;
+
+        /**
+         * @brief 本块应传输的字节数，取两个限速器中较小的
+         * @author zhb
+         */
+        long long chunkSize(long long wanted) const;
+
+        /**
+         * @brief 传输 bytes 个字节后调用，令牌不足时睡眠到可以继续
+         * @author zhb
+         */
+        void consume(long long bytes) const;
+    };
+
+} // namespace utils
+
+#endif // RATE_LIMITER_H
@@ -0,0 +1,202 @@
+//所有控制连接共用的网络事件循环
+#ifndef REACTOR_H
+#define REACTOR_H
+
+#include "../include/Socket.h"
+#include <functional>
+#include <list>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace utils
+{
+
+    /**
+     * @brief 时间轮：按 tick 粒度管理大量超时，添加、取消均为 O(1)
+     * @author zhb
+     *
+     * 超过一圈的超时记录剩余圈数，指针每转过一次减一
+     * 本身不加锁，由 Reactor 持锁后使用
+     */
+    class TimerWheel
+    {
+    public:
+        using TimerId = long long;
+
+        //每格代表的时间（ms）
+        static const int TICK_MS = 10;
+        //格数
+        static const int SLOT_COUNT = 512;
+
+        TimerWheel();
+
+        /**
+         * @brief 添加一次性定时器
+         * @author zhb
+         * @param delayMs 延迟（ms），不足一格按一格算
+         * @param callback 到时后调用
+         * @return 定时器编号，用于取消
+         */
+        TimerId add(int delayMs, std::function<void()> callback);
+
+        /**
+         * @brief 取消定时器，已到时或不存在时什么也不做
+         * @author zhb
+         */
+        void cancel(TimerId id);
+
+        /**
+         * @brief 把指针推进到当前时刻，取出所有到时的回调
+         * @author zhb
+         * @param expired 出口参数，到时的回调追加在后面
+         */
+        void advance(std::vector<std::function<void()>> &expired);
+
+        /**
+         * @brief 距离指针下次移动的时间（ms），没有定时器时返回 -1
+         * @author zhb
+         */
+        int nextTimeout() const;
+
+        bool empty() const { return timers.empty(); }
+
+    private:
+        struct Timer
+        {
+            TimerId id;
+            //还要转过的圈数
+            int rounds;
+            std::function<void()> callback;
+        };
+        using Slot = std::list<Timer>;
+
+        std::vector<Slot> wheel;
+        //编号 -> (格, 在格中的位置)
+        std::unordered_map<TimerId, std::pair<int, Slot::iterator>> timers;
+        //指针所在的格
+        int current = 0;
+        //指针上次移动的时刻
+        long long lastTickMs;
+        TimerId nextId = 1;
+    };
+
+    /**
+     * @brief 网络事件循环：一个线程等待所有 socket 的可读、可写事件
+     * @author zhb
+     *
+     * Linux 上使用 epoll，其他平台使用 WSAPoll()/poll()
+     * 每次 watch() 只触发一次回调（就绪、超时、出错三者之一），
+     * 回调在 Reactor 线程中执行，不能阻塞
+     */
+    class Reactor
+    {
+    public:
+        enum Event
+        {
+            READABLE = 1,
+            WRITABLE = 2
+        };
+
+        enum class WaitRes
+        {
+            READY,   // socket 已就绪
+            TIMEOUT, //超时
+            FAILED   //出错或对方关闭连接
+        };
+
+        using Callback = std::function<void(WaitRes)>;
+
+        /**
+         * @brief 获取全局唯一的 Reactor，第一次调用时启动线程
+         * @author zhb
+         */
+        static Reactor &instance();
+
+        ~Reactor();
+        //禁止复制
+        Reactor(const Reactor &) = delete;
+        Reactor &operator=(const Reactor &) = delete;
+
+        /**
+         * @brief 等待 socket 就绪（一次性）
+         * @author zhb
+         * @param sock 要等待的 socket，同一时刻只能有一个等待
+         * @param events READABLE 和/或 WRITABLE
+         * @param timeoutMs 超时时间（ms），负数表示不限时
+         * @param callback 就绪、超时或出错时在 Reactor 线程中调用
+         * @return 是否成功登记，失败时不会调用 callback
+         */
+        bool watch(SOCKET sock, int events, int timeoutMs, Callback callback);
+
+        /**
+         * @brief 取消对 socket 的等待，回调立即在调用者线程中以 FAILED 调用
+         * @author zhb
+         *
+         * 关闭 socket 之前应调用，否则等待要到超时才结束
+         */
+        void cancel(SOCKET sock);
+
+        /**
+         * @brief 在 Reactor 线程中执行函数
+         * @author zhb
+         */
+        void post(std::function<void()> func);
+
+        /**
+         * @brief 添加一次性定时器，回调在 Reactor 线程中执行
+         * @author zhb
+         */
+        TimerWheel::TimerId addTimer(int delayMs,
+                                     std::function<void()> callback);
+        void cancelTimer(TimerWheel::TimerId id);
+
+    private:
+        Reactor();
+
+        struct Watch
+        {
+            int events;
+            Callback callback;
+            //超时定时器，0 表示不限时
+            TimerWheel::TimerId timerId = 0;
+            //每次 watch() 的序号，区分同一 socket 上先后的等待
+            unsigned long long serial;
+        };
+
+        void run();
+        void wakeUp();
+
+        /**
+         * @brief 把某个等待的回调取出并移除
+         * @author zhb
+         * @param serial 等待的序号，0 表示不检查
+         * @return 回调，等待不存在时为空
+         */
+        Callback takeWatch(SOCKET sock, unsigned long long serial);
+
+        //保护 watches、posted 和 timerWheel
+        std::mutex mutex;
+        std::unordered_map<SOCKET, Watch> watches;
+        std::vector<std::function<void()>> posted;
+        TimerWheel timerWheel;
+        unsigned long long nextSerial = 1;
+        bool isStopping = false;
+
+#ifdef __linux__
+        int epollFd = -1;
+        // eventfd，用于唤醒 epoll_wait()
+        int wakeFd = -1;
+#else
+        //发给自己的 UDP socket，用于唤醒 poll
+        SOCKET wakeSock = INVALID_SOCKET;
+        //poll 线程是否需要重建 pollfd 数组
+        bool watchesChanged = false;
+#endif
+        std::thread thread;
+    };
+
+} // namespace utils
+
+#endif // REACTOR_H
@@ -0,0 +1,142 @@
+//主机名解析：带有效期的缓存，数字地址不经过解析器
+#ifndef RESOLVER_H
+#define RESOLVER_H
+
+#include "../include/Socket.h"
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace utils
+{
+
+    /**
+     * @brief 解析出的一个 TCP 地址（已含端口号）
+     */
+    struct ResolvedAddress
+    {
+        sockaddr_storage addr;
+        socklen_t len;
+        int family;
+    };
+
+    /**
+     * @brief 进程内共享的主机名解析器
+     * @author zhb
+     *
+     * - 数字形式的地址（PASV 回复中的 IPv4、控制连接对端的地址等）
+     *   直接转换，不调用 getaddrinfo()
+     * - 解析结果按"主机名 + 端口"缓存 ttl 毫秒；getaddrinfo() 不提供 DNS 记录
+     *   本身的 TTL，因此统一使用 setTtl() 设置的值；解析失败不缓存
+     * - asyncResolve() 在解析线程中调用 getaddrinfo()，同一主机名同时
+     *   只解析一次，DNS 再慢也不会阻塞 Reactor 线程
+     * - 解析线程按需启动，最多 MAX_LOOKUP_THREADS 个，
+     *   一个主机解析得慢不会耽误其他主机
+     */
+    class Resolver
+    {
+    public:
+        using Addresses = std::vector<ResolvedAddress>;
+        //参数为是否成功和解析出的地址
+        using Done = std::function<void(bool, Addresses)>;
+
+        //默认缓存有效期(ms)
+        static const int DEFAULT_TTL = 60000;
+        //最多同时进行的 getaddrinfo() 数
+        static const std::size_t MAX_LOOKUP_THREADS = 4;
+
+        /**
+         * @brief 全局唯一的解析器，asyncResolve() 需要时才启动解析线程
+         * @author zhb
+         */
+        static Resolver &instance();
+
+        ~Resolver();
+        //禁止复制
+        Resolver(const Resolver &) = delete;
+        Resolver &operator=(const Resolver &) = delete;
+
+        /**
+         * @brief 阻塞式解析，缓存命中时不调用 getaddrinfo()
+         * @author zhb
+         * @param host 主机名或数字形式的 IP 地址
+         * @param port 端口号，形如"21"或"ftp"均可
+         * @param addresses 出口参数，解析出的地址，按 getaddrinfo() 的顺序
+         * @return 是否成功
+         */
+        bool resolve(const std::string &host, const std::string &port,
+                     Addresses &addresses);
+
+        /**
+         * @brief 非阻塞解析
+         * @author zhb
+         * @param host 主机名或数字形式的 IP 地址
+         * @param port 端口号
+         * @param done 数字地址或缓存命中时在调用者线程中立即调用，
+         *             否则解析结束后在 Reactor 线程中调用
+         */
+        void asyncResolve(const std::string &host, const std::string &port,
+                          Done done);
+
+        /**
+         * @brief 设置缓存有效期，0 表示不缓存
+         * @author zhb
+         * @param ttl 毫秒数
+         */
+        void setTtl(int ttl);
+
+        /**
+         * @brief 清空缓存，如网络环境变化后
+         * @author zhb
+         */
+        void clear();
+
+    private:
+        using Clock = std::chrono::steady_clock;
+
+        struct Entry
+        {
+            Addresses addresses;
+            Clock::time_point expiry;
+        };
+
+        Resolver() = default;
+
+        /**
+         * @brief 数字形式的地址和端口直接转换
+         * @return 不是数字形式时返回 false
+         */
+        static bool parseNumeric(const std::string &host,
+                                 const std::string &port,
+                                 Addresses &addresses);
+        //调用 getaddrinfo()，不经过缓存
+        static bool lookup(const std::string &host, const std::string &port,
+                           Addresses &addresses);
+
+        bool findCached(const std::string &key, Addresses &addresses);
+        void store(const std::string &key, const Addresses &addresses);
+        void run();
+
+        //保护以下所有成员
+        std::mutex mutex;
+        std::unordered_map<std::string, Entry> cache;
+        int ttl = DEFAULT_TTL;
+        //等待解析的主机名和端口，以及每个键上等待结果的回调
+        std::deque<std::pair<std::string, std::string>> queue;
+        std::unordered_map<std::string, std::vector<Done>> waiters;
+        std::condition_variable queueChanged;
+        bool isStopping = false;
+        std::vector<std::thread> threads;
+        //正在等待 queue 的解析线程数
+        std::size_t idleCount = 0;
+    };
+
+} // namespace utils
+
+#endif // RESOLVER_H
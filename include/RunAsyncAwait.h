@@ -1,13 +1,19 @@
 #ifndef RUN_ASYNC_AWAIT_H
 #define RUN_ASYNC_AWAIT_H
 
-#include <QApplication>
+#include <QEventLoop>
 #include <QFuture>
+#include <QFutureInterface>
+#include <QFutureWatcher>
+#include <QTimer>
 #include <QtConcurrent/QtConcurrent>
 #include <functional>
 
 namespace utils
 {
+    //传输过程中刷新进度的间隔（ms）
+    const int PROGRESS_TICK_INTERVAL = 100;
+
     /**
      * @brief 通过函数指针获取函数的返回类型
      * @author zhb
@@ -16,6 +22,39 @@ namespace utils
     template <class ReturnType, class... Args>
     ReturnType funcPtrRetType(ReturnType (*)(Args...));
 
+    /**
+     * @brief 等待 future 结束，等待期间照常处理事件
+     * @author zhb
+     * @param future 要等待的 future
+     * @param tickInterval onTick 的调用间隔（ms）
+     * @param onTick 等待期间定时调用，可为空
+     *
+     * 由 QFutureWatcher 的 finished 信号结束局部事件循环，
+     * 等待期间线程睡在事件循环里，不占 CPU
+     */
+    template <class ReturnType>
+    inline void awaitFuture(const QFuture<ReturnType> &future,
+                            int tickInterval = PROGRESS_TICK_INTERVAL,
+                            std::function<void()> onTick = nullptr)
+    {
+        if (future.isFinished())
+            return;
+        QEventLoop loop;
+        QFutureWatcher<ReturnType> watcher;
+        QObject::connect(&watcher, &QFutureWatcherBase::finished, &loop,
+                         &QEventLoop::quit);
+        QTimer timer;
+        if (onTick)
+        {
+            QObject::connect(&timer, &QTimer::timeout, onTick);
+            timer.start(tickInterval);
+        }
+        watcher.setFuture(future);
+        // setFuture() 之前就已结束时，finished 信号仍会经事件循环送达
+        if (!future.isFinished())
+            loop.exec();
+    }
+
     /**
      * @brief 异步执行某个函数（有返回值的函数）
      * @author zhb
@@ -29,9 +68,7 @@ namespace utils
     {
         QFuture<ReturnType> future = QtConcurrent::run(
             [&]() { return func(std::forward<Args>(args)...); });
-        while (!future.isFinished())
-            QApplication::processEvents();
-
+        awaitFuture(future);
         return future.result();
     }
 
@@ -44,8 +81,31 @@ namespace utils
     {
         QFuture<void> future = QtConcurrent::run(
             [&]() { return func(std::forward<Args>(args)...); });
-        while (!future.isFinished())
-            QApplication::processEvents();
+        awaitFuture(future);
+    }
+
+    /**
+     * @brief 等待一个回调式的异步操作（如 Reactor 上的网络操作）完成
+     * @author zhb
+     * @tparam ReturnType 操作结果的类型，需要显式指定
+     * @param start 发起操作，操作完成时（可在任意线程）调用传入的回调
+     * @return 操作结果
+     *
+     * 与 asyncAwait() 不同，等待期间不占用线程池中的线程
+     */
+    template <class ReturnType>
+    inline ReturnType
+    reactorAwait(std::function<void(std::function<void(ReturnType)>)> start)
+    {
+        QFutureInterface<ReturnType> promise;
+        promise.reportStarted();
+        start([promise](ReturnType result) mutable {
+            promise.reportResult(result);
+            promise.reportFinished();
+        });
+        QFuture<ReturnType> future = promise.future();
+        awaitFuture(future);
+        return future.result();
     }
 
 } // namespace utils
@@ -0,0 +1,139 @@
+//按服务器记录支持的命令，由 FEAT 和实际收到的回复填写
+#ifndef SERVER_CAPABILITIES_H
+#define SERVER_CAPABILITIES_H
+
+#include "../include/FtpReply.h"
+#include "../include/Socket.h"
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+namespace ftpclient
+{
+
+    /**
+     * @brief 某条命令或特性是否可用
+     */
+    enum class Support
+    {
+        UNKNOWN, //还没有试过，也不在 FEAT 中
+        YES,
+        NO
+    };
+
+    /**
+     * @brief 一台服务器的能力记录
+     * @author zhb
+     */
+    struct ServerCapabilities
+    {
+        Support epsv = Support::UNKNOWN;
+        Support pasv = Support::UNKNOWN;
+        //不支持时下载不续传、不分段
+        Support restStream = Support::UNKNOWN;
+        //不支持时上传不续传
+        Support size = Support::UNKNOWN;
+        // HASH 命令支持 CRC32 算法
+        Support hash = Support::UNKNOWN;
+        Support xcrc = Support::UNKNOWN;
+        Support modeZ = Support::UNKNOWN;
+        //连续写出的多条命令能否按顺序得到各自的回复，由 CommandPipeline 试出
+        Support pipelining = Support::UNKNOWN;
+        //是否已经发过 FEAT，服务器不支持 FEAT 时也为 true
+        bool isFeatKnown = false;
+        //FEAT 的原始回复，只在内存中保留，用作出错信息
+        std::string featReply;
+
+        /**
+         * @brief 计算 CRC-32 用的命令，与 parseChecksumFeature() 的选择相同
+         * @author zhb
+         */
+        RemoteChecksum checksumMethod() const;
+    };
+
+    /**
+     * @brief 进程内共享的服务器能力缓存
+     * @author zhb
+     *
+     * 以控制连接对端的数字地址和端口为键，同一服务器的所有控制连接
+     * （包括分段下载的各条连接）共用一条记录，不必把主机名传到每个函数里。
+     * 所有函数都是线程安全的。load() / save() 可以在两次运行之间保留记录
+     */
+    class CapabilityCache
+    {
+    public:
+        /**
+         * @brief 全局唯一的缓存
+         * @author zhb
+         */
+        static CapabilityCache &instance();
+
+        //禁止复制
+        CapabilityCache(const CapabilityCache &) = delete;
+        CapabilityCache &operator=(const CapabilityCache &) = delete;
+
+        /**
+         * @brief 取一台服务器的记录，没有时返回全为 UNKNOWN 的记录
+         * @author zhb
+         * @param controlSock 控制连接
+         */
+        ServerCapabilities get(SOCKET controlSock);
+
+        /**
+         * @brief 记录 FEAT 的结果
+         * @author zhb
+         * @param controlSock 控制连接
+         * @param reply FEAT 的回复，回复码不是 211 时视为服务器不支持 FEAT，
+         *              HASH、XCRC、MODE Z 记为 NO，其余保持 UNKNOWN
+         *
+         * 已经由实际回复得出的 YES / NO 不会被覆盖
+         */
+        void recordFeat(SOCKET controlSock, const std::string &reply);
+
+        /**
+         * @brief 记录一条命令是否可用，如 PASV 返回 500 后记为 NO
+         * @author zhb
+         * @param controlSock 控制连接
+         * @param field 要修改的成员，如 &ServerCapabilities::pasv
+         * @param value 新的值
+         */
+        void set(SOCKET controlSock, Support ServerCapabilities::*field,
+                 Support value);
+
+        /**
+         * @brief 清空缓存，如服务器升级之后
+         * @author zhb
+         */
+        void clear();
+
+        /**
+         * @brief 从文件读入记录，与内存中已有的记录合并
+         * @author zhb
+         * @param path 文件路径
+         * @return 是否成功，文件不存在时返回 false
+         *
+         * 也能读入没有格式版本行的旧文件，其中的 MLSD、UTF8 两列被忽略
+         */
+        bool load(const std::string &path);
+
+        /**
+         * @brief 把所有记录写入文件，第一行为格式版本，之后每台服务器一行
+         * @author zhb
+         * @param path 文件路径
+         * @return 是否成功
+         */
+        bool save(const std::string &path);
+
+    private:
+        CapabilityCache() = default;
+
+        //"地址 端口"，取不到对端地址时为空
+        static std::string keyOf(SOCKET controlSock);
+
+        std::mutex mutex;
+        std::unordered_map<std::string, ServerCapabilities> entries;
+    };
+
+} // namespace ftpclient
+
+#endif // SERVER_CAPABILITIES_H
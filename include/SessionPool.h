@@ -0,0 +1,91 @@
+//进程内共享的、已登录的控制连接池
+#ifndef SESSION_POOL_H
+#define SESSION_POOL_H
+
+#include "../include/Socket.h"
+#include <chrono>
+#include <cstddef>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace ftpclient
+{
+
+    /**
+     * @brief 按（用户名, 主机, 端口）缓存已登录、已切换为二进制模式的控制连接
+     * @author zhb
+     *
+     * 传输任务结束并收到 226 后把控制连接还回池中，下一个任务直接取用，
+     * 省去连接->欢迎消息->USER/PASS->TYPE 的几个来回
+     *
+     * acquire() 会发 NOOP 检查连接是否可用，是阻塞式函数，应当在子线程中调用
+     */
+    class SessionPool
+    {
+    public:
+        //每个主机最多缓存的空闲连接数
+        static const std::size_t MAX_IDLE_PER_HOST = 4;
+        //空闲超过这个时间的连接多半已被服务器断开，直接丢弃
+        static const int MAX_IDLE_SECONDS = 120;
+
+        /**
+         * @brief 全局唯一的连接池
+         * @author zhb
+         */
+        static SessionPool &instance();
+
+        ~SessionPool();
+        //禁止复制
+        SessionPool(const SessionPool &) = delete;
+        SessionPool &operator=(const SessionPool &) = delete;
+
+        /**
+         * @brief 取出一条可用的控制连接
+         * @author zhb
+         * @param hostname 服务器主机名
+         * @param port 端口号
+         * @param username 用户名
+         * @return 控制连接；池中没有可用连接时返回 INVALID_SOCKET
+         */
+        SOCKET acquire(const std::string &hostname, int port,
+                       const std::string &username);
+
+        /**
+         * @brief 归还控制连接，之后调用者不应再使用它
+         * @author zhb
+         * @param hostname 服务器主机名
+         * @param port 端口号
+         * @param username 用户名
+         * @param controlSock 控制连接，上面不能有未收取的回复
+         */
+        void release(const std::string &hostname, int port,
+                     const std::string &username, SOCKET controlSock);
+
+        /**
+         * @brief 关闭所有空闲连接
+         * @author zhb
+         */
+        void clear();
+
+    private:
+        SessionPool() = default;
+
+        struct IdleSession
+        {
+            SOCKET sock;
+            std::chrono::steady_clock::time_point since;
+        };
+
+        static std::string keyOf(const std::string &hostname, int port,
+                                 const std::string &username);
+
+        std::mutex mutex;
+        // "用户名@主机:端口" -> 空闲连接，最近归还的在最后
+        std::unordered_map<std::string, std::vector<IdleSession>> idle;
+    };
+
+} // namespace ftpclient
+
+#endif // SESSION_POOL_H
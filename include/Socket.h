@@ -0,0 +1,160 @@
+//套接字的跨平台封装
+// Windows 上使用 Winsock，其他平台使用 BSD socket，
+//两者都提供 SOCKET、INVALID_SOCKET、SOCKET_ERROR、closesocket()
+#ifndef SOCKET_H
+#define SOCKET_H
+
+#ifdef _WIN32
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#else
+#include <arpa/inet.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+using SOCKET = int;
+#define INVALID_SOCKET (-1)
+#define SOCKET_ERROR (-1)
+
+inline int closesocket(SOCKET sock) { return ::close(sock); }
+#endif
+
+#include <string>
+
+namespace utils
+{
+
+    // send() 的标志：POSIX 上对方关闭连接时返回 EPIPE 而不是产生 SIGPIPE
+#ifdef MSG_NOSIGNAL
+    const int SEND_FLAGS = MSG_NOSIGNAL;
+#else
+    const int SEND_FLAGS = 0;
+#endif
+
+    /**
+     * @brief 初始化套接字库，整个进程只执行一次
+     * @author zhb
+     * @return 是否成功
+     *
+     * Windows 上调用 WSAStartup()，进程退出时系统自动清理，不调用
+     * WSACleanup()；POSIX 上忽略 SIGPIPE（sendfile()/splice() 无法传
+     * MSG_NOSIGNAL）
+     */
+    bool initSockets();
+
+    /**
+     * @brief 最近一次套接字操作的错误码（WSAGetLastError() 或 errno）
+     * @author zhb
+     */
+    int lastSocketError();
+
+    /**
+     * @brief 非阻塞 connect() 的错误码是否表示"正在连接"
+     * @author zhb
+     * @param error lastSocketError() 的返回值
+     */
+    bool isConnectInProgress(int error);
+
+    /**
+     * @brief 已连接 socket 对端的 IP 地址（数字形式，IPv4 或 IPv6）
+     * @author zhb
+     * @return IP 地址，失败时为空字符串
+     */
+    std::string peerAddress(SOCKET sock);
+
+    /**
+     * @brief 设置阻塞式 send()/recv() 的超时时间
+     * @author zhb
+     * @param sock 被设置的 socket
+     * @param optname SO_SNDTIMEO 或 SO_RCVTIMEO
+     * @param timeout 超时时间(ms)
+     * @return 设置是否成功
+     *
+     * Winsock 的参数是毫秒数，POSIX 的参数是 timeval
+     */
+    bool setSocketTimeout(SOCKET sock, int optname, int timeout);
+
+    /**
+     * @brief 设置 socket 为非阻塞或阻塞模式
+     * @author zhb
+     * @return 设置是否成功
+     */
+    bool setNonBlocking(SOCKET sock, bool nonBlocking);
+
+    /**
+     * @brief 新建 socket 后的通用设置
+     * @author zhb
+     *
+     * POSIX 上设置 FD_CLOEXEC；没有 MSG_NOSIGNAL 的平台（如 macOS）
+     * 设置 SO_NOSIGPIPE
+     */
+    void prepareSocket(SOCKET sock);
+
+    //按带宽时延积设置收发缓冲区时的上下限
+    const int MIN_SOCKET_BUFFER_SIZE = 64 * 1024;
+    const int MAX_SOCKET_BUFFER_SIZE = 64 * 1024 * 1024;
+
+    /**
+     * @brief 连接前对 socket 做的 TCP 设置
+     * @author zhb
+     *
+     * 控制连接与数据连接的需求不同：控制连接一问一答，每条命令都很短，
+     * 需要关闭 Nagle 算法；数据连接要在长肥管道上跑满带宽，
+     * 收发缓冲区（即 TCP 窗口）至少要有一个带宽时延积
+     */
+    struct SocketProfile
+    {
+        // TCP_NODELAY，关闭 Nagle 算法
+        bool noDelay = false;
+        // SO_SNDBUF / SO_RCVBUF 的字节数，0 表示使用系统默认值，
+        //保留内核的自动调整
+        int bufferSize = 0;
+        //拥塞控制算法（TCP_CONGESTION，仅 Linux），如"bbr"，空表示系统默认
+        std::string congestion;
+    };
+
+    /**
+     * @brief 控制连接的设置：关闭 Nagle 算法，缓冲区用系统默认值
+     * @author zhb
+     */
+    SocketProfile controlSocketProfile();
+
+    /**
+     * @brief 数据连接的设置：按带宽时延积确定收发缓冲区大小
+     * @author zhb
+     * @param bytesPerSecond 估计的链路带宽（字节/秒），0 表示不知道，
+     *                       使用系统默认缓冲区
+     * @param rtt 估计的往返时间(ms)
+     * @param congestion 拥塞控制算法，空表示系统默认
+     */
+    SocketProfile dataSocketProfile(long long bytesPerSecond = 0, int rtt = 0,
+                                    const std::string &congestion = "");
+
+    /**
+     * @brief 计算带宽时延积，作为收发缓冲区大小
+     * @author zhb
+     * @param bytesPerSecond 链路带宽（字节/秒）
+     * @param rtt 往返时间(ms)
+     * @return 字节数，按 64 KiB 向上取整并限制在
+     *         MIN_SOCKET_BUFFER_SIZE ~ MAX_SOCKET_BUFFER_SIZE 之间；
+     *         参数不大于 0 时返回 0
+     */
+    int bdpBufferSize(long long bytesPerSecond, int rtt);
+
+    /**
+     * @brief 对新建的 socket 应用设置，须在 connect() 之前调用
+     * @author zhb
+     * @return 各项设置是否都成功
+     *
+     * 窗口缩放因子在握手时协商，连接建立后再加大接收缓冲区不一定有效；
+     * 实际生效的缓冲区大小还受系统上限（Linux 的 net.core.rmem_max、
+     * net.core.wmem_max）约束，失败的设置不影响连接
+     */
+    bool applySocketProfile(SOCKET sock, const SocketProfile &profile);
+
+} // namespace utils
+
+#endif // SOCKET_H
@@ -0,0 +1,90 @@
+//传输进度：字节计数、速率、剩余时间
+#ifndef TRANSFER_PROGRESS_H
+#define TRANSFER_PROGRESS_H
+
+#include <atomic>
+#include <chrono>
+
+namespace utils
+{
+
+    /**
+     * @brief 一次传输的进度
+     * @author zhb
+     *
+     * 传输线程只调用 add() 累加字节数（一次无锁的原子加法），
+     * 界面线程定时调用 sample() 取得百分比、速率和剩余时间。
+     * 速率是按时间加权的指数移动平均（EWMA），不随单次采样剧烈跳动
+     */
+    class TransferProgress
+    {
+    public:
+        struct Snapshot
+        {
+            //已传输的字节数，包括续传前已有的部分
+            long long doneBytes = 0;
+            //总字节数，未知时为 0
+            long long totalBytes = 0;
+            int percent = 0;
+            //平滑后的速率（字节/秒），还没有采样时为 0
+            double bytesPerSecond = 0;
+            //预计剩余时间（ms），无法估计时为 -1
+            long long etaMs = -1;
+            //从 reset() 起经过的时间（ms）
+            long long elapsedMs = 0;
+        };
+
+        //速率平滑的时间常数（ms），越大越平稳、对变化越迟钝
+        static const int RATE_SMOOTHING_MS = 2000;
+
+        TransferProgress() { this->reset(0); }
+        //禁止复制
+        TransferProgress(const TransferProgress &) = delete;
+        TransferProgress &operator=(const TransferProgress &) = delete;
+
+        /**
+         * @brief 开始一次新的传输，在传输线程启动前调用
+         * @author zhb
+         * @param totalBytes 总字节数，未知时为 0
+         * @param doneBytes 已有的字节数（断点续传的起点），不计入速率
+         */
+        void reset(long long totalBytes, long long doneBytes = 0);
+
+        /**
+         * @brief 累加已传输的字节数，可在任意线程调用
+         * @author zhb
+         */
+        void add(long long bytes)
+        {
+            done.fetch_add(bytes, std::memory_order_relaxed);
+        }
+
+        long long doneBytes() const
+        {
+            return done.load(std::memory_order_relaxed);
+        }
+
+        /**
+         * @brief 采样当前进度并更新平滑速率
+         * @author zhb
+         *
+         * 只能在一个线程中调用（一般是界面线程的定时器）
+         */
+        Snapshot sample();
+
+    private:
+        using Clock = std::chrono::steady_clock;
+
+        std::atomic<long long> done{0};
+        std::atomic<long long> total{0};
+        //以下只在 reset() 和 sample() 中访问
+        Clock::time_point startTime;
+        Clock::time_point lastSampleTime;
+        long long lastSampleBytes = 0;
+        double rate = 0;
+        bool hasRate = false;
+    };
+
+} // namespace utils
+
+#endif // TRANSFER_PROGRESS_H
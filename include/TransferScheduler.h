@@ -0,0 +1,361 @@
+#ifndef TRANSFERSCHEDULER_H
+#define TRANSFERSCHEDULER_H
+
+#include "../include/DownloadFileTask.h"
+#include "../include/FTPSession.h"
+#include "../include/UploadFileTask.h"
+#include <QObject>
+#include <functional>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace ftpclient
+{
+
+    /**
+     * @brief 传输调度器：维护上传、下载队列，同时运行多个传输任务
+     *
+     * 每个方向最多同时运行 maxUploads / maxDownloads 个任务，
+     * 同一主机上同时登录的控制连接数不超过 maxPerHost（服务器一般会限制
+     * 同一用户的登录数），分段下载的每一段和界面所用的会话都算一条
+     *
+     * 调用 addUpload() / addDownload() 添加任务，任务按添加顺序执行，
+     * 连接的是添加时会话所在的服务器
+     *
+     * 每个任务运行在自己的线程中：任务的 start() / resume() 要等到传输
+     * 结束才返回，期间进入局部事件循环，放在各自的线程里就不会互相嵌套，
+     * 调度器只发起任务，由任务的结束信号得知结果
+     */
+    class TransferScheduler : public QObject
+    {
+        Q_OBJECT
+    public:
+        enum class Direction
+        {
+            UPLOAD,
+            DOWNLOAD
+        };
+
+        enum class ItemState
+        {
+            QUEUED,  //排队中
+            RUNNING, //进行中
+            PAUSED,  //暂停
+            FAILED,  //失败
+            DONE     //完成
+        };
+
+        struct Item
+        {
+            int id;
+            Direction direction;
+            std::string localFilepath;
+            std::string remoteFilepath;
+            ItemState state;
+            //进度百分比
+            int percent;
+            //平滑后的速率（字节/秒），未在传输时为 0
+            double bytesPerSecond;
+            //预计剩余时间（ms），无法估计时为 -1
+            long long etaMs;
+            //失败时的错误消息，可能为空
+            std::string errorMsg;
+        };
+
+        static const int DEFAULT_MAX_UPLOADS = 3;
+        static const int DEFAULT_MAX_DOWNLOADS = 3;
+        static const int DEFAULT_MAX_PER_HOST = 4;
+
+        explicit TransferScheduler(QObject *parent = nullptr);
+        ~TransferScheduler();
+        //禁止复制
+        TransferScheduler(const TransferScheduler &) = delete;
+        TransferScheduler &operator=(const TransferScheduler &) = delete;
+
+        /**
+         * @brief 设置之后添加的任务所用的会话（取其主机名、用户名、密码、端口）
+         * @author zhb
+         * @param session FTP会话，为 nullptr 时暂停调度新任务
+         *
+         * 已添加的任务仍连接添加时的服务器；没有会话时添加的任务，
+         * 在设置会话后用这个会话
+         */
+        void setSession(FTPSession *session);
+
+        /**
+         * @brief 设置各方向、每个主机的并发数，至少为 1
+         * @author zhb
+         */
+        void setMaxUploads(int count);
+        void setMaxDownloads(int count);
+        void setMaxPerHost(int count);
+
+        /**
+         * @brief 设置某个方向所有任务共用的限速，立即生效
+         * @author zhb
+         * @param bytesPerSecond 限速值（字节/秒），0 表示不限速
+         */
+        void setGlobalRateLimit(Direction direction, long long bytesPerSecond);
+
+        /**
+         * @brief 设置单个任务的限速，进行中的任务立即生效
+         * @author zhb
+         * @param id 任务编号
+         * @param bytesPerSecond 限速值（字节/秒），0 表示不限速
+         */
+        void setRateLimit(int id, long long bytesPerSecond);
+
+        /**
+         * @brief 设置之后开始的任务是否校验 CRC-32
+         * @author zhb
+         * @param enable 是否启用，启用后不再零拷贝传输
+         *
+         * 不一致的任务以 FAILED 结束，错误消息为"checksumMismatch"
+         */
+        void setVerifyChecksum(bool enable);
+
+        /**
+         * @brief 设置之后开始的任务的 MODE Z 压缩级别
+         * @author zhb
+         * @param level 0 表示不压缩，1 ~ 9 为 zlib 的压缩级别
+         */
+        void setCompressionLevel(int level);
+
+        /**
+         * @brief 设置之后开始的任务用 io_uring 读写本地文件时同时进行的块数
+         * @author zhb
+         * @param depth 0 表示不使用 io_uring（仅 Linux 下有效）
+         */
+        void setDiskQueueDepth(int depth);
+
+        /**
+         * @brief 设置链路的带宽与往返时间估计，之后开始的任务据此
+         * 确定数据连接的收发缓冲区大小
+         * @author zhb
+         * @param bytesPerSecond 带宽（字节/秒），0 表示使用系统默认缓冲区
+         * @param rtt 往返时间(ms)
+         *
+         * 默认缓冲区在长肥管道上限制了窗口大小，吞吐量跑不满带宽
+         */
+        void setLinkEstimate(long long bytesPerSecond, int rtt);
+
+        /**
+         * @brief 设置之后开始的任务的数据连接使用的拥塞控制算法（仅 Linux）
+         * @author zhb
+         * @param name 算法名，如"bbr"，空表示系统默认
+         */
+        void setCongestionControl(const std::string &name);
+
+        /**
+         * @brief 添加上传任务
+         * @author zhb
+         * @param localFilepath 本地文件路径
+         * @param remoteFilepath 服务器文件路径，应使用绝对路径
+         * @return 任务编号
+         */
+        int addUpload(const std::string &localFilepath,
+                      const std::string &remoteFilepath);
+
+        /**
+         * @brief 添加下载任务
+         * @author zhb
+         * @param localFilepath 本地文件路径，应使用绝对路径
+         * @param remoteFilepath 服务器文件路径，应使用绝对路径
+         * @return 任务编号
+         */
+        int addDownload(const std::string &localFilepath,
+                        const std::string &remoteFilepath);
+
+        /**
+         * @brief 暂停任务，排队中或进行中的任务有效
+         * @author zhb
+         */
+        void pause(int id);
+
+        /**
+         * @brief 继续暂停或失败的任务（断点续传），任务重新排队
+         * @author zhb
+         */
+        void resume(int id);
+
+        /**
+         * @brief 取消任务并从列表中移除
+         * @author zhb
+         */
+        void cancel(int id);
+
+        /**
+         * @brief 移除所有已完成的任务
+         * @author zhb
+         */
+        void clearDone();
+
+        /**
+         * @brief 查询任务
+         * @author zhb
+         * @return 任务信息，编号不存在时返回 nullptr
+         */
+        const Item *item(int id) const;
+
+        /**
+         * @brief 按添加顺序列出某个方向的所有任务
+         * @author zhb
+         */
+        std::vector<Item> items(Direction direction) const;
+
+    signals:
+        /**
+         * @brief 信号：任务状态改变
+         * @param id 任务编号
+         * @param state 新状态
+         */
+        void itemStateChanged(int id, ItemState state);
+
+        /**
+         * @brief 信号：任务进度改变，传输期间定时发射，新进度用 item() 查询
+         * @param id 任务编号
+         */
+        void itemProgressChanged(int id);
+
+        /**
+         * @brief 信号：任务被移除
+         * @param id 任务编号
+         */
+        void itemRemoved(int id);
+
+    private:
+        struct Entry
+        {
+            Item item;
+            //添加时会话的登录信息，任务用它连接服务器
+            std::string hostname;
+            int port = 0;
+            std::string username;
+            std::string password;
+            //"用户名@主机:端口"，与登录信息一起确定，为空表示还没有确定
+            std::string hostKey;
+            //进行中时占用的控制连接数，分段下载时为段数
+            int connections = 0;
+            //二者至多一个不为空，完成或取消后释放；任务对象属于自己的线程，
+            //只能通过 runInTaskThread() 调用它的成员函数
+            //下载任务构造时会清空本地文件，暂停、失败后须用同一个对象续传
+            UploadFileTask *upload = nullptr;
+            DownloadFileTask *download = nullptr;
+            //再次开始时是否为续传，任务开始传输数据后才为 true
+            bool isResume = false;
+            //本任务的限速（字节/秒），0 表示不限速
+            long long rateLimit = 0;
+        };
+
+        int add(Direction direction, const std::string &localFilepath,
+                const std::string &remoteFilepath);
+
+        /**
+         * @brief 在并发数允许的范围内启动一个排队中的任务
+         * @author zhb
+         */
+        void schedule();
+
+        /**
+         * @brief 回到事件循环后再调用 schedule()
+         * @author zhb
+         */
+        void scheduleLater();
+
+        /**
+         * @brief 记下当前会话的登录信息，任务之后都连接这台服务器
+         * @author zhb
+         */
+        void captureLogin(Entry &entry);
+
+        /**
+         * @brief 启动任务
+         * @author zhb
+         * @param freeConnections 任务所在主机还能再登录的控制连接数，至少为 1
+         */
+        void startEntry(Entry &entry, int freeConnections);
+
+        /**
+         * @brief 为新建的任务创建线程，把任务移过去
+         * @author zhb
+         */
+        void moveToTaskThread(QObject *task);
+
+        /**
+         * @brief 在任务的线程中执行 func，不等待它完成
+         * @author zhb
+         */
+        void runInTaskThread(QObject *task, std::function<void()> func);
+
+        /**
+         * @brief 回到调度器的线程中执行 func，任务的信号在任务的线程中
+         * 发射，经过这里再访问 entries
+         * @author zhb
+         */
+        void runInOwnThread(std::function<void()> func);
+
+        void connectUploadSignals(int id, UploadFileTask *task);
+        void connectDownloadSignals(int id, DownloadFileTask *task);
+
+        /**
+         * @brief 任务已开始传输数据，之后再开始时续传
+         * @author zhb
+         */
+        void markStarted(int id);
+
+        /**
+         * @brief 任务结束（完成或失败）：更新状态、释放任务、继续调度
+         * @author zhb
+         */
+        void finish(int id, ItemState state, std::string errorMsg = "");
+
+        /**
+         * @brief 停止正在运行的任务，任务对象保留以便续传
+         * @author zhb
+         */
+        void stopTask(Entry &entry);
+
+        /**
+         * @brief 释放任务对象，任务回到自己线程的事件循环后删除，之后线程退出
+         * @author zhb
+         */
+        void releaseTask(Entry &entry);
+        void releaseTask(QObject *task);
+
+        void setState(Entry &entry, ItemState state);
+        void setProgress(int id,
+                         const utils::TransferProgress::Snapshot &progress);
+
+        int runningCount(Direction direction) const;
+
+        /**
+         * @brief 某个主机上已登录的控制连接数：进行中的任务占用的，
+         * 加上界面所用的会话
+         * @author zhb
+         */
+        int connectionCount(const std::string &hostKey) const;
+        bool isRunningOnHost(const std::string &hostKey) const;
+
+        FTPSession *session = nullptr;
+        int maxUploads = DEFAULT_MAX_UPLOADS;
+        int maxDownloads = DEFAULT_MAX_DOWNLOADS;
+        int maxPerHost = DEFAULT_MAX_PER_HOST;
+        //新任务是否校验 CRC-32
+        bool verifyChecksum = false;
+        //新任务的 MODE Z 压缩级别
+        int compressionLevel = 0;
+        // io_uring 同时读写的块数，0 表示不使用
+        int diskQueueDepth = 0;
+        //数据连接的 TCP 设置
+        utils::SocketProfile socketProfile;
+        int nextId = 0;
+        //已有一次 scheduleLater() 在等待
+        bool isScheduling = false;
+        //编号 -> 任务，编号递增，因此也是添加顺序
+        std::map<int, Entry> entries;
+    };
+
+} // namespace ftpclient
+
+#endif // TRANSFERSCHEDULER_H
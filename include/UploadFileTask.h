@@ -1,9 +1,14 @@
 #ifndef UPLOADFILETASK_H
 #define UPLOADFILETASK_H
 
+#include "../include/CommandSequence.h"
 #include "../include/FTPSession.h"
+#include "../include/RateLimiter.h"
+#include "../include/TransferProgress.h"
 #include <QObject>
+#include <algorithm>
 #include <fstream>
+#include <memory>
 #include <string>
 
 namespace ftpclient
@@ -55,16 +60,96 @@ namespace ftpclient
         std::string getLocalFilepath() { return localFilepath; }
         std::string getRemoteFilepath() { return remoteFilepath; }
 
+        /**
+         * @brief 设置数据连接收发缓冲区的大小
+         * @author zhb
+         * @param size 字节数，会被限制在 64 KiB ~ 8 MiB 之间
+         */
+        void setBufferSize(int size)
+        {
+            bufferSize = clampTransferBufferSize(size);
+        }
+
+        /**
+         * @brief 设置是否使用零拷贝方式上传
+         * @author zhb
+         * @param enable 是否启用
+         *
+         * 仅在二进制模式下生效；文件无法零拷贝发送时自动改用普通方式
+         */
+        void setZeroCopy(bool enable) { zeroCopy = enable; }
+
+        /**
+         * @brief 设置本任务的限速，传输过程中也可以修改
+         * @author zhb
+         * @param bytesPerSecond 限速值（字节/秒），0 表示不限速
+         *
+         * 同时还受 utils::RateLimiter::globalUpload() 的全局限速约束
+         */
+        void setRateLimit(long long bytesPerSecond)
+        {
+            rateLimiter.setLimit(bytesPerSecond);
+        }
+
+        /**
+         * @brief 设置是否在传输时计算 CRC-32，结束后与服务器的比较
+         * @author zhb
+         * @param enable 是否启用
+         *
+         * 仅在二进制模式、从头上传时生效；启用后不再零拷贝上传，
+         * 因为数据要经过缓冲区才能计算；服务器不支持 XCRC / HASH 时不校验
+         */
+        void setVerifyChecksum(bool enable) { verifyChecksum = enable; }
+
+        /**
+         * @brief 设置 MODE Z 压缩级别
+         * @author zhb
+         * @param level 0 表示不压缩，1 ~ 9 为 zlib 的压缩级别
+         *
+         * 服务器不支持 MODE Z 时照常不压缩传输
+         */
+        void setCompressionLevel(int level)
+        {
+            compressionLevel = std::max(0, std::min(level, 9));
+        }
+
+        /**
+         * @brief 设置用 io_uring 读写本地文件时同时进行的块数
+         * @author zhb
+         * @param depth 0 表示不使用 io_uring，其余会被限制在 2 ~ 64 之间
+         *
+         * 仅 Linux 下生效，内核不支持时照常读写；零拷贝传输时不经过本地文件读写
+         */
+        void setDiskQueueDepth(int depth)
+        {
+            if (depth > 0)
+                depth = std::max(2, std::min(depth, MAX_DISK_QUEUE_DEPTH));
+            diskQueueDepth = std::max(0, depth);
+        }
+
+        /**
+         * @brief 设置数据连接的 TCP 设置（收发缓冲区、拥塞控制算法）
+         * @author zhb
+         * @param profile 一般由 utils::dataSocketProfile() 按带宽时延积得出
+         *
+         * 在建立数据连接前设置才有效
+         */
+        void setSocketProfile(const utils::SocketProfile &profile)
+        {
+            socketProfile = profile;
+        }
+
     signals:
         /**
          * @brief 信号：上传开始
          */
         void uploadStarted();
         /**
-         * @brief 信号：上传百分比
-         * @param percentage 百分比
+         * @brief 信号：上传进度，传输期间每 utils::PROGRESS_TICK_INTERVAL
+         * 发射一次
+         * @param progress 字节数、百分比、速率和剩余时间
          */
-        void uploadPercentage(int percentage);
+        void uploadProgress(utils::TransferProgress::Snapshot progress);
         /**
          * @brief 信号：上传成功
          */
@@ -79,6 +164,10 @@ namespace ftpclient
          * @param msg 来自服务器的错误消息
          */
         void uploadFailedWithMsg(std::string msg);
+        /**
+         * @brief 信号：上传完成，但服务器上文件的 CRC-32 与发送的不一致
+         */
+        void uploadChecksumMismatch();
         /**
          * @brief 信号：读取文件错误
          */
@@ -86,38 +175,17 @@ namespace ftpclient
 
     private:
         /**
-         * @brief 让服务器切换到被动模式（PASV或EPSV）
-         * @author zhb
-         *
-         * 异步函数
-         * - 若成功，转到 dataConnect()
-         * - 若失败，发射信号 uploadFailedWithMsg(msg) 或 uploadFailed
-         */
-        void enterPassiveMode();
-
-        /**
-         * @brief 与服务器建立数据连接
-         * @author zhb
-         * @param hostname 主机名
-         * @param port 端口号
-         *
-         * 异步函数
-         * - 若成功，转到 uploadRequest()
-         * - 若失败，发射 uploadFailed 信号
-         */
-        void dataConnect(const std::string &hostname, int port);
-
-        /**
-         * @brief 向服务器发 STOR 或 APPE 请求上传
+         * @brief 请求上传前的准备
          * @author zhb
          *
-         * 异步函数
+         * 续传时获取文件大小，随后进入被动模式、建立数据连接、发送 STOR 或
+         * APPE，整个过程是一个 CommandSequence，只等待一次
          * - 若服务器同意上传，发射 uploadStarted 信号，随后转到执行
          * uploadFileData()，向服务器发送文件内容
-         * - 若服务器拒绝上传，发射 uploadFailedWithMsg(msg) 信号
+         * - 若服务器拒绝，发射 uploadFailedWithMsg(msg) 信号
          * - 其他网络错误，发射 uploadFailed 信号
          */
-        void uploadRequest();
+        void prepareTransfer();
 
         /**
          * @brief 向服务器发送文件内容
@@ -126,6 +194,7 @@ namespace ftpclient
          * 异步函数，运行结束后会发射以下信号之一
          * - uploadSucceeded
          * - uploadFailed
+         * - uploadChecksumMismatch
          * - readFileError
          */
         void uploadFileData();
@@ -158,6 +227,28 @@ namespace ftpclient
         //是否为续传
         bool isAppend;
         long long uploadOffset = 0;
+        //数据连接收发缓冲区大小
+        int bufferSize = DEFAULT_TRANSFER_BUFFER_SIZE;
+        //是否尝试零拷贝上传
+        bool zeroCopy = true;
+        //是否校验 CRC-32
+        bool verifyChecksum = false;
+        // MODE Z 压缩级别，0 表示不压缩
+        int compressionLevel = 0;
+        // io_uring 同时读写的块数，0 表示不使用
+        int diskQueueDepth = 0;
+        //数据连接的 TCP 设置
+        utils::SocketProfile socketProfile;
+        //本次传输是否为 MODE Z
+        bool isDeflate = false;
+        //服务器是否处于二进制传输模式，ASCII 模式下不能零拷贝
+        bool isBinaryMode = false;
+        //传输线程累加字节数，界面线程定时采样
+        utils::TransferProgress progress;
+        //本任务的限速
+        utils::RateLimiter rateLimiter;
+        //正在执行的准备序列，没有时为空
+        std::shared_ptr<CommandSequence> preparing;
 
         static const int SOCKET_SEND_TIMEOUT = 3000;
         static const int SOCKET_RECV_TIMEOUT = 3000;
@@ -1,16 +1,16 @@
 #ifndef MAINWINDOW_H
 #define MAINWINDOW_H
 
-#include "../include/DownloadFileTask.h"
 #include "../include/FTPSession.h"
-#include "../include/UploadFileTask.h"
+#include "../include/TransferScheduler.h"
 #include <QFuture>
 #include <QMainWindow>
 #include <QtConcurrent/QtConcurrent>
 #include <QtDebug>
-#include <deque>
+#include <map>
 #include <memory>
 #include <string>
+#include <vector>
 
 QT_BEGIN_NAMESPACE
 namespace Ui
@@ -35,18 +35,10 @@ public:
     void initConnection(ftpclient::FTPSession *se);
 
     /**
-     * @brief 连接上传信号
+     * @brief 连接传输调度器的信号
      * @authors zyc, zhb
-     * @param UploadFileTask 上传任务
      */
-    void connectUploadSignals(ftpclient::UploadFileTask *task);
-
-    /**
-     * @brief 连接下载信号
-     * @authors zyc, zhb
-     * @param DownloadFileTask 下载任务
-     */
-    void connectDownloadSignals(ftpclient::DownloadFileTask *task);
+    void connectSchedulerSignals();
 
 private slots:
 
@@ -93,61 +85,35 @@ private:
      */
     void hideFTPFunction(bool value);
 
-    /**
-     * @brief 若队列非空且此时上传空闲，则调度一个上传任务来执行
-     * @author zhb
-     */
-    void scheduleUploadQueue();
-
-    /**
-     * @brief 若队列非空且此时下载空闲，则调度一个下载任务来执行
-     * @author zhb
-     */
-    void scheduleDownloadQueue();
-
-    /**
-     * @brief 插入上传任务
-     * @author zhb
-     * @param filename 文件名
-     * @param localFilepath 本地路径
-     * @param remoteFilepath 远程路径
-     */
-    void pushUpload(const QString &filename, const std::string &localFilepath,
-                    const std::string &remoteFilepath);
-
-    /**
-     * @brief 插入下载任务
-     * @author zhb
-     * @param filename 文件名
-     * @param localFilepath 本地路径
-     * @param remoteFilepath 远程路径
-     */
-    void pushDownload(const QString &filename, const std::string &localFilepath,
-                      const std::string &remoteFilepath);
+    using Direction = ftpclient::TransferScheduler::Direction;
+    using ItemState = ftpclient::TransferScheduler::ItemState;
 
     /**
-     * @brief 移除上传任务
+     * @brief 刷新任务在上传或下载列表中对应的一行，新任务则插入一行
      * @author zhb
+     * @param id 任务编号
      */
-    void popUpload();
+    void updateTransferRow(int id);
 
     /**
-     * @brief 移除下载任务
+     * @brief 从上传或下载列表中删除任务对应的一行
      * @author zhb
+     * @param id 任务编号
      */
-    void popDownload();
+    void removeTransferRow(int id);
 
     /**
-     * @brief 上传结束：修改UI、出队、调度
+     * @brief 刷新某个方向的总进度条和按钮
      * @author zhb
      */
-    void uploadEndedUISchedule();
+    void updateTransferControls(Direction direction);
 
     /**
-     * @brief 下载结束：修改UI、出队、调度
+     * @brief 上传或下载列表中选中的任务，没有选中时取第一个
      * @author zhb
+     * @return 任务编号，列表为空时返回 -1
      */
-    void downloadEndedUISchedule();
+    int selectedTransfer(Direction direction) const;
 
     Ui::MainWindow *ui;
 
@@ -157,17 +123,6 @@ private:
     bool isLogin = false;
     bool isBinary = true;
 
-    enum class TransStatus
-    {
-        RUNNING, //进行中
-        PAUSE,   //暂停
-        FREE     //空闲
-    };
-    //上传状态
-    TransStatus uploadStatus = TransStatus::FREE;
-    //下载状态
-    TransStatus downloadStatus = TransStatus::FREE;
-
     std::unique_ptr<ftpclient::FTPSession> se;
 
     std::string currentDir = "/";
@@ -176,10 +131,12 @@ private:
     std::string currentItem;
 
     //上传下载队列
-    std::unique_ptr<ftpclient::UploadFileTask> runningUploadTask;
-    std::unique_ptr<ftpclient::DownloadFileTask> runningDownloadTask;
-    std::deque<std::pair<std::string, std::string>> uploadQueue;
-    std::deque<std::pair<std::string, std::string>> downloadQueue;
+    ftpclient::TransferScheduler scheduler;
+    //列表中每一行对应的任务编号
+    std::vector<int> uploadIds;
+    std::vector<int> downloadIds;
+    //任务编号 -> 列表中显示的文件名
+    std::map<int, QString> transferNames;
     QStringListModel uploadListModel;
     QStringListModel downloadListModel;
 };
@@ -0,0 +1,111 @@
+#include "../include/BufferPool.h"
+#include <cstdlib>
+#ifdef _WIN32
+#include <malloc.h>
+#endif
+
+namespace
+{
+    char *alignedAlloc(std::size_t size)
+    {
+#ifdef _WIN32
+        return static_cast<char *>(
+            _aligned_malloc(size, utils::BufferPool::ALIGNMENT));
+#else
+        void *ptr = nullptr;
+        if (posix_memalign(&ptr, utils::BufferPool::ALIGNMENT, size) != 0)
+            return nullptr;
+        return static_cast<char *>(ptr);
+#endif
+    }
+
+    void alignedFree(char *ptr)
+    {
+#ifdef _WIN32
+        _aligned_free(ptr);
+#else
+        std::free(ptr);
+#endif
+    }
+} // namespace
+
+namespace utils
+{
+
+    const std::size_t BufferPool::ALIGNMENT;
+    const std::size_t BufferPool::MAX_IDLE_PER_SIZE;
+
+    BufferPool::Buffer &BufferPool::Buffer::operator=(Buffer &&other) noexcept
+    {
+        if (this != &other)
+        {
+            this->release();
+            pool = other.pool;
+            ptr = other.ptr;
+            len = other.len;
+            other.ptr = nullptr;
+            other.len = 0;
+        }
+        return *this;
+    }
+
+    void BufferPool::Buffer::release()
+    {
+        if (ptr != nullptr)
+            pool->giveBack(ptr, len);
+        ptr = nullptr;
+        len = 0;
+    }
+
+    BufferPool &BufferPool::instance()
+    {
+        static BufferPool pool;
+        return pool;
+    }
+
+    BufferPool::~BufferPool() { this->trim(); }
+
+    BufferPool::Buffer BufferPool::acquire(std::size_t size)
+    {
+        //向上取整到页大小的整数倍，这样相近的请求可以复用
+        size = (size + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT;
+        if (size == 0)
+            size = ALIGNMENT;
+        {
+            std::lock_guard<std::mutex> guard(mutex);
+            auto iter = idle.find(size);
+            if (iter != idle.end() && !iter->second.empty())
+            {
+                char *ptr = iter->second.back();
+                iter->second.pop_back();
+                return Buffer(this, ptr, size);
+            }
+        }
+        char *ptr = alignedAlloc(size);
+        return Buffer(this, ptr, ptr != nullptr ? size : 0);
+    }
+
+    void BufferPool::trim()
+    {
+        std::lock_guard<std::mutex> guard(mutex);
+        for (auto &item : idle)
+            for (char *ptr : item.second)
+                alignedFree(ptr);
+        idle.clear();
+    }
+
+    void BufferPool::giveBack(char *ptr, std::size_t size)
+    {
+        {
+            std::lock_guard<std::mutex> guard(mutex);
+            std::vector<char *> &list = idle[size];
+            if (list.size() < MAX_IDLE_PER_SIZE)
+            {
+                list.push_back(ptr);
+                return;
+            }
+        }
+        alignedFree(ptr);
+    }
+
+} // namespace utils
@@ -0,0 +1,115 @@
+#include "../include/Checksum.h"
+#include <array>
+
+namespace
+{
+    //反射形式的 CRC-32 多项式
+    const std::uint32_t POLY = 0xEDB88320u;
+
+    // tables[k][b]：字节 b 后面再跟 k 个零字节时的 CRC
+    struct Tables
+    {
+        std::array<std::array<std::uint32_t, 256>, 8> t;
+
+        Tables()
+        {
+            for (std::uint32_t b = 0; b < 256; ++b)
+            {
+                std::uint32_t crc = b;
+                for (int bit = 0; bit < 8; ++bit)
+                    crc = (crc >> 1) ^ (POLY & (0u - (crc & 1)));
+                t[0][b] = crc;
+            }
+            for (std::uint32_t b = 0; b < 256; ++b)
+                for (int k = 1; k < 8; ++k)
+                    t[k][b] = (t[k - 1][b] >> 8) ^ t[0][t[k - 1][b] & 0xFF];
+        }
+    };
+
+    const Tables &tables()
+    {
+        static const Tables instance;
+        return instance;
+    }
+
+    // GF(2) 上 32x32 矩阵乘向量，矩阵按列存放
+    std::uint32_t gf2MatrixTimes(const std::uint32_t *mat, std::uint32_t vec)
+    {
+        std::uint32_t sum = 0;
+        for (; vec != 0; vec >>= 1, ++mat)
+            if (vec & 1)
+                sum ^= *mat;
+        return sum;
+    }
+
+    void gf2MatrixSquare(std::uint32_t *square, const std::uint32_t *mat)
+    {
+        for (int n = 0; n < 32; ++n)
+            square[n] = gf2MatrixTimes(mat, mat[n]);
+    }
+} // namespace
+
+namespace utils
+{
+
+    void Crc32::update(const void *data, std::size_t len)
+    {
+        const auto &t = tables().t;
+        const unsigned char *p = static_cast<const unsigned char *>(data);
+        std::uint32_t c = ~crc;
+        //每次 8 个字节，按小端拼成两个 32 位数，与字节序无关
+        while (len >= 8)
+        {
+            std::uint32_t lo = c ^ (std::uint32_t(p[0]) |
+                                    std::uint32_t(p[1]) << 8 |
+                                    std::uint32_t(p[2]) << 16 |
+                                    std::uint32_t(p[3]) << 24);
+            c = t[7][lo & 0xFF] ^ t[6][(lo >> 8) & 0xFF] ^
+                t[5][(lo >> 16) & 0xFF] ^ t[4][lo >> 24] ^ t[3][p[4]] ^
+                t[2][p[5]] ^ t[1][p[6]] ^ t[0][p[7]];
+            p += 8;
+            len -= 8;
+        }
+        while (len-- > 0)
+            c = (c >> 8) ^ t[0][(c ^ *p++) & 0xFF];
+        crc = ~c;
+    }
+
+    std::uint32_t Crc32::combine(std::uint32_t crc1, std::uint32_t crc2,
+                                 long long len2)
+    {
+        //与 zlib 的 crc32_combine() 相同：把 crc1 乘上"补 len2 个零字节"的
+        //算子，再与 crc2 异或
+        if (len2 <= 0)
+            return crc1;
+        std::uint32_t even[32]; //补 2^k 个零比特的算子
+        std::uint32_t odd[32];
+
+        odd[0] = POLY; //补 1 个零比特
+        std::uint32_t row = 1;
+        for (int n = 1; n < 32; ++n)
+        {
+            odd[n] = row;
+            row <<= 1;
+        }
+        gf2MatrixSquare(even, odd); // 2 个零比特
+        gf2MatrixSquare(odd, even); // 4 个零比特
+
+        //每轮平方一次，对应 len2 的一个二进制位（第一轮为 1 个零字节）
+        do
+        {
+            gf2MatrixSquare(even, odd);
+            if (len2 & 1)
+                crc1 = gf2MatrixTimes(even, crc1);
+            len2 >>= 1;
+            if (len2 == 0)
+                break;
+            gf2MatrixSquare(odd, even);
+            if (len2 & 1)
+                crc1 = gf2MatrixTimes(odd, crc1);
+            len2 >>= 1;
+        } while (len2 != 0);
+        return crc1 ^ crc2;
+    }
+
+} // namespace utils
@@ -0,0 +1,247 @@
+#include "../include/CommandPipeline.h"
+#include "../include/FtpReply.h"
+#include "../include/MyUtils.h"
+#include "../include/Reactor.h"
+#include "../include/ServerCapabilities.h"
+#include <algorithm>
+
+namespace
+{
+    using ftpclient::parseReplyCode;
+
+    //命令很短，阻塞式 send() 不会等待太久
+    bool sendAll(SOCKET sock, const std::string &data)
+    {
+        std::size_t sent = 0;
+        while (sent < data.length())
+        {
+            int iResult = send(sock, data.c_str() + sent,
+                               int(data.length() - sent), utils::SEND_FLAGS);
+            if (iResult == SOCKET_ERROR || iResult == 0)
+                return false;
+            sent += std::size_t(iResult);
+        }
+        return true;
+    }
+
+    bool isPositiveReply(const std::string &reply)
+    {
+        int code = parseReplyCode(reply);
+        return code >= 200 && code < 300;
+    }
+} // namespace
+
+namespace ftpclient
+{
+
+    const std::size_t CommandPipeline::DEFAULT_DEPTH;
+    const int CommandPipeline::PROBE_TIMEOUT_FACTOR;
+
+    std::shared_ptr<CommandPipeline>
+    CommandPipeline::create(SOCKET controlSock, int timeout, std::size_t depth)
+    {
+        return std::shared_ptr<CommandPipeline>(
+            new CommandPipeline(controlSock, timeout, depth));
+    }
+
+    CommandPipeline::CommandPipeline(SOCKET controlSock, int timeout,
+                                     std::size_t depth)
+        : controlSock(controlSock),
+          timeout(timeout),
+          depth(std::max<std::size_t>(depth, 1))
+    {
+    }
+
+    void CommandPipeline::add(const std::string &cmd,
+                              std::vector<int> expectedCodes, Done done)
+    {
+        queued.push_back({cmd, std::move(expectedCodes), std::move(done)});
+    }
+
+    std::future<CommandPipeline::Result>
+    CommandPipeline::add(const std::string &cmd,
+                         std::vector<int> expectedCodes)
+    {
+        auto promise = std::make_shared<std::promise<Result>>();
+        this->add(cmd, std::move(expectedCodes),
+                  [promise](CmdToServerRet ret, std::string recvMsg) {
+                      promise->set_value(Result(ret, std::move(recvMsg)));
+                  });
+        return promise->get_future();
+    }
+
+    void CommandPipeline::run(std::function<void()> finished)
+    {
+        this->finished = std::move(finished);
+        const Support pipelining =
+            CapabilityCache::instance().get(controlSock).pipelining;
+        if (pipelining == Support::NO)
+            depth = 1;
+        //只有一条命令或逐条发送时不必试探
+        if (pipelining == Support::UNKNOWN && depth > 1 && queued.size() > 1)
+            this->probe();
+        else
+            this->fill();
+    }
+
+    void CommandPipeline::probe()
+    {
+        //正常为两条"200 OK"
+        if (!sendAll(controlSock, "NOOP\r\nNOOP\r\n"))
+        {
+            this->failAll(CmdToServerRet::SEND_FAILED);
+            return;
+        }
+        auto self = shared_from_this();
+        asyncRecvFtpReply(controlSock, timeout, [self](int iResult,
+                                                       std::string reply) {
+            if (iResult <= 0)
+            {
+                self->failAll(CmdToServerRet::RECV_FAILED);
+                return;
+            }
+            self->recvProbeReply(isPositiveReply(reply));
+        });
+    }
+
+    void CommandPipeline::recvProbeReply(bool isFirstPositive)
+    {
+        std::string reply;
+        if (utils::takeFtpReply(controlSock, reply))
+        {
+            //回复没有错位，但第二条被拒绝（如"503"）也按不支持处理
+            const bool isSupported = isFirstPositive && isPositiveReply(reply);
+            CapabilityCache::instance().set(
+                controlSock, &ServerCapabilities::pipelining,
+                isSupported ? Support::YES : Support::NO);
+            if (!isSupported)
+                depth = 1;
+            this->fill();
+            return;
+        }
+        //asyncRecvFtpReply() 不区分超时和出错，这里自己等
+        const int probeTimeout =
+            timeout < 0 ? timeout : timeout * PROBE_TIMEOUT_FACTOR;
+        auto self = shared_from_this();
+        auto onReadable = [self, isFirstPositive](utils::Reactor::WaitRes res) {
+            //第二条 NOOP 没有回复，多半被服务器丢掉了
+            if (res == utils::Reactor::WaitRes::TIMEOUT)
+                self->resync();
+            //出错或被 quit() 取消，与流水线无关，不记录
+            else if (res != utils::Reactor::WaitRes::READY ||
+                     utils::fillFtpMsgBuffer(self->controlSock) <= 0)
+                self->failAll(CmdToServerRet::RECV_FAILED);
+            else //可能还没收全，继续等
+                self->recvProbeReply(isFirstPositive);
+        };
+        if (!utils::Reactor::instance().watch(
+                controlSock, utils::Reactor::READABLE, probeTimeout, onReadable))
+            this->failAll(CmdToServerRet::RECV_FAILED);
+    }
+
+    void CommandPipeline::resync()
+    {
+        depth = 1;
+        //正常为 257 "dir" is current directory.
+        if (!sendAll(controlSock, "PWD\r\n"))
+        {
+            this->failAll(CmdToServerRet::SEND_FAILED);
+            return;
+        }
+        this->recvResyncReply();
+    }
+
+    void CommandPipeline::recvResyncReply()
+    {
+        auto self = shared_from_this();
+        asyncRecvFtpReply(controlSock, timeout,
+                          [self](int iResult, std::string reply) {
+                              if (iResult <= 0)
+                                  self->failAll(CmdToServerRet::RECV_FAILED);
+                              //第二条 NOOP 的回复可能只是迟到了，跳过它
+                              else if (parseReplyCode(reply) == 200)
+                              {
+                                  self->isLateNoopSeen = true;
+                                  self->recvResyncReply();
+                              }
+                              //收到 PWD 的回复，之后的回复已对齐。
+                              //NOOP 只是迟到时不下结论，这次逐条发送，下次再试
+                              else
+                              {
+                                  if (!self->isLateNoopSeen)
+                                      CapabilityCache::instance().set(
+                                          self->controlSock,
+                                          &ServerCapabilities::pipelining,
+                                          Support::NO);
+                                  self->fill();
+                              }
+                          });
+    }
+
+    void CommandPipeline::fill()
+    {
+        std::string batch;
+        while (inFlight.size() < depth && !queued.empty())
+        {
+            batch += queued.front().cmd;
+            inFlight.push_back(std::move(queued.front()));
+            queued.pop_front();
+        }
+        if (!batch.empty() && !sendAll(controlSock, batch))
+        {
+            this->failAll(CmdToServerRet::SEND_FAILED);
+            return;
+        }
+        if (inFlight.empty())
+        {
+            auto callback = std::move(finished);
+            if (callback)
+                callback();
+        }
+        else
+            this->recvNext();
+    }
+
+    void CommandPipeline::recvNext()
+    {
+        auto self = shared_from_this();
+        asyncRecvFtpReply(controlSock, timeout,
+                          [self](int iResult, std::string reply) {
+                              self->onReply(iResult, std::move(reply));
+                          });
+    }
+
+    void CommandPipeline::onReply(int iResult, std::string reply)
+    {
+        if (iResult <= 0)
+        {
+            this->failAll(CmdToServerRet::RECV_FAILED);
+            return;
+        }
+        Command command = std::move(inFlight.front());
+        inFlight.pop_front();
+        const auto &codes = command.expectedCodes;
+        if (std::find(codes.begin(), codes.end(), parseReplyCode(reply)) ==
+            codes.end())
+            command.done(CmdToServerRet::FAILED_WITH_MSG, std::move(reply));
+        else
+            command.done(CmdToServerRet::SUCCEEDED, std::move(reply));
+        //空出的位置补上新的命令
+        this->fill();
+    }
+
+    void CommandPipeline::failAll(CmdToServerRet ret)
+    {
+        std::deque<Command> commands = std::move(inFlight);
+        inFlight.clear();
+        for (Command &command : queued)
+            commands.push_back(std::move(command));
+        queued.clear();
+        for (Command &command : commands)
+            command.done(ret, std::string());
+        auto callback = std::move(finished);
+        if (callback)
+            callback();
+    }
+
+} // namespace ftpclient
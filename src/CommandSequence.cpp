@@ -0,0 +1,141 @@
+#include "../include/CommandSequence.h"
+
+namespace ftpclient
+{
+
+    const int CommandSequence::COMMAND_TIMEOUT;
+
+    std::shared_ptr<CommandSequence> CommandSequence::create()
+    {
+        return std::shared_ptr<CommandSequence>(new CommandSequence);
+    }
+
+    void CommandSequence::addStep(Step step)
+    {
+        steps.push_back(std::move(step));
+    }
+
+    void CommandSequence::addCommand(
+        SOCKET controlSock, std::function<std::string()> makeCmd,
+        std::vector<int> expectedCodes,
+        std::function<bool(const std::string &)> onReply)
+    {
+        this->addStep([controlSock, makeCmd, expectedCodes,
+                       onReply](Next next) {
+            std::string cmd = makeCmd();
+            if (cmd.empty())
+            {
+                next(Res::SUCCEEDED, std::string());
+                return;
+            }
+            asyncCmdToServer(
+                controlSock, cmd, expectedCodes, COMMAND_TIMEOUT,
+                [next, onReply](CmdToServerRet ret, std::string recvMsg) {
+                    if (ret == CmdToServerRet::SUCCEEDED &&
+                        (!onReply || onReply(recvMsg)))
+                        next(Res::SUCCEEDED, std::string());
+                    else if (ret == CmdToServerRet::SUCCEEDED ||
+                             ret == CmdToServerRet::FAILED_WITH_MSG)
+                        next(Res::FAILED_WITH_MSG, std::move(recvMsg));
+                    else
+                        next(Res::FAILED, std::string());
+                });
+        });
+    }
+
+    void CommandSequence::addCommand(
+        SOCKET controlSock, const std::string &cmd,
+        std::vector<int> expectedCodes,
+        std::function<bool(const std::string &)> onReply)
+    {
+        this->addCommand(
+            controlSock, [cmd]() { return cmd; }, std::move(expectedCodes),
+            std::move(onReply));
+    }
+
+    void CommandSequence::addPassiveConnect(
+        SOCKET controlSock, int sendTimeout, int recvTimeout,
+        const utils::SocketProfile &profile,
+        std::function<void(SOCKET)> onConnected)
+    {
+        this->addStep([controlSock, sendTimeout, recvTimeout, profile,
+                       onConnected](Next next) {
+            auto onPassive = [sendTimeout, recvTimeout, profile, onConnected,
+                              next](CmdToServerRet ret, std::string hostname,
+                                    int port, std::string errorMsg) {
+                if (ret != CmdToServerRet::SUCCEEDED)
+                {
+                    next(ret == CmdToServerRet::FAILED_WITH_MSG
+                             ? Res::FAILED_WITH_MSG
+                             : Res::FAILED,
+                         std::move(errorMsg));
+                    return;
+                }
+                asyncConnectToServer(
+                    hostname, port, COMMAND_TIMEOUT, sendTimeout, recvTimeout,
+                    profile, [onConnected, next](ConnectToServerRes res, SOCKET sock) {
+                        if (res != ConnectToServerRes::SUCCEEDED)
+                        {
+                            next(Res::FAILED, std::string());
+                            return;
+                        }
+                        onConnected(sock);
+                        next(Res::SUCCEEDED, std::string());
+                    });
+            };
+            asyncEnterPassiveMode(controlSock, COMMAND_TIMEOUT, onPassive);
+        });
+    }
+
+    void CommandSequence::addDeflateMode(SOCKET controlSock, int level,
+                                         std::function<void(bool)> onResult)
+    {
+        this->addStep([controlSock, level, onResult](Next next) {
+            asyncEnterDeflateMode(
+                controlSock, level, COMMAND_TIMEOUT,
+                [onResult, next](CmdToServerRet ret, std::string) {
+                    if (ret == CmdToServerRet::SUCCEEDED ||
+                        ret == CmdToServerRet::FAILED_WITH_MSG)
+                    {
+                        onResult(ret == CmdToServerRet::SUCCEEDED);
+                        next(Res::SUCCEEDED, std::string());
+                    }
+                    else
+                        next(Res::FAILED, std::string());
+                });
+        });
+    }
+
+    void CommandSequence::run(Done done)
+    {
+        this->done = std::move(done);
+        isSkipRest = false;
+        this->runStep(0);
+    }
+
+    void CommandSequence::runStep(std::size_t index)
+    {
+        if (isStopped)
+        {
+            done(Res::STOPPED, std::string());
+            return;
+        }
+        if (index == steps.size() || isSkipRest)
+        {
+            done(Res::SUCCEEDED, std::string());
+            return;
+        }
+        //回调持有序列，保证序列活到最后一步结束
+        auto self = shared_from_this();
+        steps[index]([self, index](Res res, std::string errorMsg) {
+            //被停止时网络操作多半是被强行结束的，结果没有意义
+            if (self->isStopped)
+                self->done(Res::STOPPED, std::string());
+            else if (res != Res::SUCCEEDED)
+                self->done(res, std::move(errorMsg));
+            else
+                self->runStep(index + 1);
+        });
+    }
+
+} // namespace ftpclient
@@ -0,0 +1,113 @@
+#include "../include/Deflate.h"
+#include <algorithm>
+#include <climits>
+#include <zlib.h>
+
+namespace
+{
+    //每次交给 sink 的最大字节数
+    const std::size_t DEFLATE_OUT_SIZE = 64 * 1024;
+} // namespace
+
+namespace utils
+{
+
+    Deflater::Deflater(int level)
+        : stream(new z_stream_s()),
+          out(BufferPool::instance().acquire(DEFLATE_OUT_SIZE))
+    {
+        level = std::max(1, std::min(level, 9));
+        initFailed = out.data() == nullptr ||
+                     deflateInit(stream.get(), level) != Z_OK;
+    }
+
+    Deflater::~Deflater()
+    {
+        if (!initFailed)
+            deflateEnd(stream.get());
+    }
+
+    bool Deflater::compress(const char *data, std::size_t len, bool finish,
+                            const DeflateSink &sink)
+    {
+        if (initFailed)
+            return false;
+        //缓冲区最大 8 MiB，不会超过 uInt 的范围
+        stream->next_in = reinterpret_cast<Bytef *>(const_cast<char *>(data));
+        stream->avail_in = uInt(len);
+        const int flush = finish ? Z_FINISH : Z_NO_FLUSH;
+        while (true)
+        {
+            stream->next_out = reinterpret_cast<Bytef *>(out.data());
+            stream->avail_out = uInt(out.size());
+            int ret = deflate(stream.get(), flush);
+            if (ret == Z_STREAM_ERROR)
+                return false;
+            std::size_t produced = out.size() - stream->avail_out;
+            if (produced > 0 && !sink(out.data(), produced))
+                return false;
+            if (finish ? ret == Z_STREAM_END
+                       : stream->avail_in == 0 && stream->avail_out != 0)
+                return true;
+        }
+    }
+
+    Inflater::Inflater()
+        : stream(new z_stream_s()),
+          out(BufferPool::instance().acquire(DEFLATE_OUT_SIZE))
+    {
+        initFailed =
+            out.data() == nullptr || inflateInit(stream.get()) != Z_OK;
+    }
+
+    Inflater::~Inflater()
+    {
+        if (!initFailed)
+            inflateEnd(stream.get());
+    }
+
+    Inflater::Res Inflater::decompress(const char *data, std::size_t len,
+                                       const DeflateSink &sink)
+    {
+        if (initFailed)
+            return Res::FAILED;
+        if (isEnded)
+            return Res::STREAM_END;
+        stream->next_in = reinterpret_cast<Bytef *>(const_cast<char *>(data));
+        stream->avail_in = uInt(len);
+        while (true)
+        {
+            stream->next_out = reinterpret_cast<Bytef *>(out.data());
+            stream->avail_out = uInt(out.size());
+            int ret = inflate(stream.get(), Z_NO_FLUSH);
+            if (ret != Z_OK && ret != Z_STREAM_END && ret != Z_BUF_ERROR)
+                return Res::FAILED;
+            std::size_t produced = out.size() - stream->avail_out;
+            if (produced > 0 && !sink(out.data(), produced))
+                return Res::FAILED;
+            if (ret == Z_STREAM_END)
+            {
+                isEnded = true;
+                return Res::STREAM_END;
+            }
+            //输出缓冲区没填满，说明输入已经用完
+            if (stream->avail_out != 0)
+                return Res::NEED_MORE;
+        }
+    }
+
+    bool inflateAll(const std::string &in, std::string &out)
+    {
+        Inflater inflater;
+        out.clear();
+        if (in.size() > std::size_t(UINT_MAX))
+            return false;
+        auto res = inflater.decompress(
+            in.data(), in.size(), [&out](const char *data, std::size_t len) {
+                out.append(data, len);
+                return true;
+            });
+        return res == Inflater::Res::STREAM_END;
+    }
+
+} // namespace utils
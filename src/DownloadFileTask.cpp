@@ -1,43 +1,51 @@
 #include "../include/DownloadFileTask.h"
+#include "../include/DownloadSegmentTask.h"
 #include "../include/FTPFunction.h"
+#include "../include/FtpReply.h"
+#include "../include/LocalFile.h"
 #include "../include/MyUtils.h"
 #include "../include/RunAsyncAwait.h"
-#include <QApplication>
+#include "../include/ServerCapabilities.h"
+#include "../include/SessionPool.h"
 #include <QFuture>
+#include <QThreadPool>
 #include <QtConcurrent/QtConcurrent>
 #include <algorithm>
 #include <fstream>
-#include <io.h>
 #include <iostream>
-#include <regex>
+#include <vector>
 
 namespace ftpclient
 {
 
     const int DownloadFileTask::SENDTIMEOUT;
     const int DownloadFileTask::RECVTIMEOUT;
+    const int DownloadFileTask::DEFAULT_SEGMENT_COUNT;
+    const int DownloadFileTask::MAX_SEGMENT_COUNT;
+    const long long DownloadFileTask::MIN_SEGMENTED_FILESIZE;
 
     DownloadFileTask::DownloadFileTask(FTPSession &session,
                                        const std::string &localFilepath,
                                        const std::string &remoteFilepath)
         : session(session.getHostname(), session.getUsername(),
-                  session.getPassword(), session.getPort(), false),
+                  session.getPassword(), session.getPort(), false, true),
           localFilepath(localFilepath),
           remoteFilepath(remoteFilepath),
-          ofs(localFilepath, std::ios_base::out | std::ios_base::binary),
           dataSocket(INVALID_SOCKET),
           isDataConnected(false),
           isSetStop(false),
           isReset(false)
     {
+        //自己的会话作为子对象，任务被移到传输线程时一起移过去
+        //（参数 session 与成员同名，必须写 this->）
+        this->session.setParent(this);
+        //与原先用 ofstream 打开时一样清空文件
+        if (file.openForWrite(localFilepath))
+            file.resize(0);
         this->connectSignals();
     }
 
-    DownloadFileTask::~DownloadFileTask()
-    {
-        this->quit();
-        WSACleanup();
-    }
+    DownloadFileTask::~DownloadFileTask() { this->quit(); }
 
     void DownloadFileTask::connectSignals()
     {
@@ -68,28 +76,22 @@ namespace ftpclient
                          [this]() { emit downloadFailed(); });
         QObject::connect(&session, &FTPSession::setTransferModeFailed,
                          [this]() { emit downloadFailed(); });
-        //传输模式设置成功，下一步获取服务器上文件的大小
+        //传输模式设置成功，下一步准备传输
         QObject::connect(&session, &FTPSession::setTransferModeSucceeded,
-                         [this]() { session.getFilesize(remoteFilepath); });
-        //获取文件大小失败，发送故障信号
-        QObject::connect(&session, &FTPSession::getFilesizeFailedWithMsg,
-                         [this](std::string msg) {
-                             emit downloadFailedWithMsg(std::move(msg));
-                         });
-        QObject::connect(&session, &FTPSession::getFilesizeFailed,
-                         [this]() { emit downloadFailed(); });
-        //获取文件大小成功，按照既定流程执行
-        QObject::connect(&session, &FTPSession::getFilesizeSucceeded,
-                         [this](long long filesize) {
-                             this->remoteFilesize = filesize;
-                             this->enterPassiveMode();
+                         [this](bool binaryMode) {
+                             isBinaryMode = binaryMode;
+                             this->prepareTransfer();
                          });
     }
 
     void DownloadFileTask::start()
     {
         isReset = false;
+        downloadOffset = 0;
         isSetStop = false;
+        isSegmented = false;
+        segmentStop = false;
+        pendingRanges.clear();
         session.connectAndLogin();
     }
 
@@ -97,59 +99,35 @@ namespace ftpclient
     {
         isReset = true;
         isSetStop = false;
-        std::ifstream ifs(localFilepath, std::ios_base::binary);
-        this->downloadOffset = utils::getFilesize(ifs);
-        ofs.seekp(downloadOffset);
+        isSegmented = false;
+        segmentStop = false;
+        this->downloadOffset = std::max(0LL, file.size());
         session.connectAndLogin();
     }
 
     void DownloadFileTask::stop()
     {
         isSetStop = true;
-        utils::asyncAwait([this]() {
-            std::string sendCmd = "ABOR\r\n";
-            send(session.getControlSock(), sendCmd.c_str(), sendCmd.length(),
-                 0);
-            std::string recvMsg;
-            //两种情况：1. 服务器返回 226/225；2. 服务器先返回 426，再返回
-            // 226/225 为了省事这里不检查返回码，只是把缓冲区中的消息吃掉
-            recvMultipleMsg(session.getControlSock(), std::regex("."), recvMsg);
-        });
-        //关闭数据连接和控制连接
-        this->quit();
-    }
-
-    void DownloadFileTask::enterPassiveMode()
-    {
-        std::string errorMsg;
-        std::string dataHostname;
-        int port;
-        //先尝试 PASV 模式
-        auto pasvRet = utils::asyncAwait<CmdToServerRet>(
-            putServerIntoPasvMode, session.getControlSock(), port, dataHostname,
-            errorMsg);
-        if (pasvRet == CmdToServerRet::SUCCEEDED)
-            this->dataSocketConnect(dataHostname, port);
-        else if (pasvRet == CmdToServerRet::FAILED_WITH_MSG)
+        segmentStop = true;
+        //还没开始传输，不必 ABOR，关闭连接让序列马上结束
+        if (preparing)
         {
-            //返回码为500，必须要用EPSV模式
-            if (std::regex_search(errorMsg, std::regex(R"(^500.*)")))
-            {
-                auto epsvRet = utils::asyncAwait<CmdToServerRet>(
-                    putServerIntoEpsvMode, session.getControlSock(), port,
-                    errorMsg);
-                if (epsvRet == CmdToServerRet::SUCCEEDED)
-                    this->dataSocketConnect(session.getHostname(), port);
-                else if (epsvRet == CmdToServerRet::FAILED_WITH_MSG)
-                    emit downloadFailedWithMsg(errorMsg);
-                else
-                    emit downloadFailed();
-            }
-            else
-                emit downloadFailedWithMsg(errorMsg);
+            preparing->stop();
+            this->quit();
+            return;
         }
-        else
-            emit downloadFailed();
+        //分段下载时主控制连接已关闭，各段自己断开连接
+        if (!isSegmented)
+            utils::asyncAwait([this]() {
+                std::string sendCmd = "ABOR\r\n";
+                send(session.getControlSock(), sendCmd.c_str(),
+                     sendCmd.length(), utils::SEND_FLAGS);
+                std::string recvMsg;
+                //不检查返回码，只是把 ABOR 的回复吃掉
+                recvAborMsg(session.getControlSock(), recvMsg);
+            });
+        //关闭数据连接和控制连接
+        this->quit();
     }
 
     void DownloadFileTask::quit()
@@ -163,97 +141,400 @@ namespace ftpclient
         session.quit();
     }
 
-    void DownloadFileTask::dataSocketConnect(const std::string &hostname,
-                                             int port)
+    void DownloadFileTask::prepareTransfer()
     {
         if (isSetStop)
             return;
+        //各步骤的结果，序列结束前只在 Reactor 线程中访问
+        struct Prepared
+        {
+            long long filesize = 0;
+            SOCKET dataSock = INVALID_SOCKET;
+            bool isSegmented = false;
+            bool isDeflate = false;
+        };
+        auto prepared = std::make_shared<Prepared>();
+        const SOCKET controlSock = session.getControlSock();
+        //已知服务器不支持 REST 时无法从断点继续，清空本地文件从头下载；
+        //还不知道时照常发送，由回复得出结果
+        const bool canRest =
+            CapabilityCache::instance().get(controlSock).restStream !=
+            Support::NO;
+        if (isReset && !canRest)
+        {
+            isReset = false;
+            downloadOffset = 0;
+            pendingRanges.clear();
+            file.resize(0);
+        }
+        //续传时 REST 的偏移量与压缩流对不上，不压缩
+        const bool canDeflate = !isReset && compressionLevel > 0;
+        //上次分段下载没有下完，续传时仍按段下载剩下的区间
+        const bool isRangeResume = isReset && !pendingRanges.empty();
+        //其余续传、压缩时仍用一条连接；各段靠 REST 定位，不支持时也不分段
+        const bool canSegment =
+            isRangeResume ||
+            (!isReset && !canDeflate && canRest && segmentCount > 1);
+        auto seq = CommandSequence::create();
+        CommandSequence *rawSeq = seq.get();
 
-        auto res = utils::asyncAwait<ConnectToServerRes>(
-            connectToServer, dataSocket, hostname, std::to_string(port),
-            DownloadFileTask::SENDTIMEOUT, DownloadFileTask::RECVTIMEOUT);
-        if (res != ConnectToServerRes::SUCCEEDED)
-            emit downloadFailed();
-        else
+        //正常为"213 size"
+        seq->addCommand(controlSock, "SIZE " + remoteFilepath + "\r\n", {213},
+                        [prepared, rawSeq, canSegment,
+                         isRangeResume](const std::string &reply) {
+                            if (!parseSizeReply(reply, prepared->filesize))
+                                return false;
+                            //分段下载时各段自己建立数据连接
+                            if (canSegment &&
+                                (isRangeResume ||
+                                 prepared->filesize >= MIN_SEGMENTED_FILESIZE))
+                            {
+                                prepared->isSegmented = true;
+                                rawSeq->skipRest();
+                            }
+                            return true;
+                        });
+        if (canDeflate)
+            seq->addDeflateMode(
+                controlSock, compressionLevel,
+                [prepared](bool enabled) { prepared->isDeflate = enabled; });
+        seq->addPassiveConnect(
+            controlSock, DownloadFileTask::SENDTIMEOUT,
+            DownloadFileTask::RECVTIMEOUT, socketProfile,
+            [prepared](SOCKET sock) { prepared->dataSock = sock; });
+        const long long offset = downloadOffset;
+        if (isReset)
+            seq->addStep([controlSock, offset](CommandSequence::Next next) {
+                asyncRequestRest(
+                    controlSock, offset, CommandSequence::COMMAND_TIMEOUT,
+                    [next](CmdToServerRet ret, std::string recvMsg) {
+                        if (ret == CmdToServerRet::SUCCEEDED)
+                            next(CommandSequence::Res::SUCCEEDED,
+                                 std::string());
+                        else if (ret == CmdToServerRet::FAILED_WITH_MSG)
+                            next(CommandSequence::Res::FAILED_WITH_MSG,
+                                 std::move(recvMsg));
+                        else
+                            next(CommandSequence::Res::FAILED, std::string());
+                    });
+            });
+        seq->addCommand(controlSock, "RETR " + remoteFilepath + "\r\n",
+                        {150, 125});
+
+        using Result = std::pair<CommandSequence::Res, std::string>;
+        preparing = seq;
+        Result res = utils::reactorAwait<Result>(
+            [seq](std::function<void(Result)> finish) {
+                seq->run([finish](CommandSequence::Res res, std::string msg) {
+                    finish(Result(res, std::move(msg)));
+                });
+            });
+        preparing.reset();
+
+        //序列已结束，数据连接交给 quit() 管理
+        isDeflate = prepared->isDeflate;
+        if (prepared->dataSock != INVALID_SOCKET)
         {
+            dataSocket = prepared->dataSock;
             isDataConnected = true;
-            this->downloadRequest();
         }
-    }
-
-    void DownloadFileTask::downloadRequest()
-    {
         if (isSetStop)
-            return;
-        std::string errorMsg;
-        if (isReset)
         {
-            auto resetRes = utils::asyncAwait<CmdToServerRet>(
-                requestRestFromServer, session.getControlSock(), downloadOffset,
-                errorMsg);
-            if (!isSetStop && resetRes != CmdToServerRet::SUCCEEDED)
-            {
-                if (resetRes == CmdToServerRet::FAILED_WITH_MSG)
-                    emit downloadFailedWithMsg(std::move(errorMsg));
-                else
-                    emit downloadFailed();
-                return;
-            }
+            // stop() 关闭连接时数据连接可能还没交过来
+            this->quit();
+            return;
         }
-
-        CmdToServerRet retrRes = utils::asyncAwait<CmdToServerRet>(
-            requestRetrFromFromServer, session.getControlSock(), remoteFilepath,
-            errorMsg);
-        if (!isSetStop)
+        if (res.first == CommandSequence::Res::FAILED_WITH_MSG)
+            emit downloadFailedWithMsg(std::move(res.second));
+        else if (res.first != CommandSequence::Res::SUCCEEDED)
+            emit downloadFailed();
+        else
         {
-            if (retrRes == CmdToServerRet::SUCCEEDED)
+            //服务器上的文件变了，已下载的各段作废，重新分段下载
+            if (isRangeResume && prepared->filesize != remoteFilesize)
+                pendingRanges.clear();
+            this->remoteFilesize = prepared->filesize;
+            if (prepared->isSegmented)
+                this->downloadSegmented();
+            else
             {
                 emit downloadStarted();
                 this->downloadFileData(); //开始传输文件内容
             }
-            else if (retrRes == CmdToServerRet::FAILED_WITH_MSG)
-                emit downloadFailedWithMsg(std::move(errorMsg));
-            else // res == SEND_FAILED || res == RECV_FAILED
-                emit downloadFailed();
         }
     }
 
     void DownloadFileTask::downloadFileData()
     {
-        int percent = 0, lastPercent = 0;
+        progress.reset(remoteFilesize, downloadOffset);
+        const utils::Throttle throttle{&rateLimiter,
+                                       &utils::RateLimiter::globalDownload()};
+        // ASCII 模式下收到的内容与服务器上的不同，续传时只收到后半段，
+        //这两种情况都算不出能与服务器比较的 CRC
+        const bool isChecksummed =
+            verifyChecksum && isBinaryMode && downloadOffset == 0;
+        utils::Crc32 checksum;
         QFuture<DownloadFileDataRes> downFuture =
-            QtConcurrent::run([this, &percent]() {
-                return downloadFileDataFromServer(dataSocket, ofs,
-                                                  remoteFilesize, percent);
+            QtConcurrent::run([this, &throttle, isChecksummed, &checksum]() {
+                if (!file.isOpen())
+                    return DownloadFileDataRes::READ_FILE_ERROR;
+                //一次分配好整个文件的空间，不改变文件大小，失败也无妨
+                file.preallocate(remoteFilesize);
+                auto *crc = isChecksummed ? &checksum : nullptr;
+                //攒满一块再写，写入位置按块对齐；可以用 io_uring 边收边写
+                utils::SequentialWriter writer(
+                    file, downloadOffset,
+                    std::size_t(clampTransferBufferSize(bufferSize)),
+                    remoteFilesize >= DROP_CACHE_MIN_FILESIZE, diskQueueDepth);
+                //解压要经过用户态，不能零拷贝
+                if (isDeflate)
+                    return downloadFileDataInflate(dataSocket, writer,
+                                                   progress, throttle, crc,
+                                                   bufferSize);
+                auto res = DownloadFileDataRes::ZERO_COPY_UNSUPPORTED;
+                if (zeroCopy && isBinaryMode && !isChecksummed)
+                    res = downloadFileDataZeroCopy(dataSocket, localFilepath,
+                                                   downloadOffset, progress,
+                                                   throttle);
+                if (res == DownloadFileDataRes::ZERO_COPY_UNSUPPORTED)
+                    res = downloadFileDataFromServer(dataSocket, writer,
+                                                     progress, throttle, crc);
+                return res;
             });
-        while (!downFuture.isFinished())
-        {
-            QApplication::processEvents();
-            if (percent != lastPercent)
-            {
-                emit percentSync(percent);
-                lastPercent = percent;
-            }
-        }
+        auto syncProgress = [this]() { emit progressSync(progress.sample()); };
+        //定时刷新进度，其余时间睡在事件循环里
+        utils::awaitFuture(downFuture, utils::PROGRESS_TICK_INTERVAL,
+                           syncProgress);
+        syncProgress();
 
         //关闭数据连接
         closesocket(dataSocket);
         dataSocket = INVALID_SOCKET;
         isDataConnected = false;
 
+        //收到 226 后控制连接可以还回连接池
+        bool isReusable = false;
         if (!isSetStop)
         {
             auto downRes = downFuture.result();
             if (downRes == DownloadFileDataRes::SUCCEEDED)
-                emit downloadSucceed();
+            {
+                //下载结束，用控制连接接收服务器消息
+                std::string errorMsg;
+                auto recvRes = utils::asyncAwait<RecvMultRes>(
+                    recvTransferCompleteMsg, session.getControlSock(),
+                    errorMsg);
+                if (recvRes == RecvMultRes::SUCCEEDED)
+                {
+                    auto verifyRes = VerifyChecksumRes::UNSUPPORTED;
+                    if (isChecksummed)
+                        verifyRes = this->verifyChecksumOnServer(
+                            session.getControlSock(), checksum.value());
+                    //等待校验时可能被 stop()，这时连接已关闭，不再发射信号
+                    if (!isSetStop)
+                    {
+                        //校验时网络出错，文件已经收完，只是连接不能再用
+                        isReusable = verifyRes != VerifyChecksumRes::FAILED;
+                        if (verifyRes == VerifyChecksumRes::MISMATCHED)
+                            emit downloadChecksumMismatch();
+                        else
+                            emit downloadSucceed();
+                    }
+                }
+                else if (recvRes == RecvMultRes::FAILED_WITH_MSG)
+                    emit downloadFailedWithMsg(std::move(errorMsg));
+                else
+                    emit downloadFailed();
+            }
             else if (downRes == DownloadFileDataRes::READ_FILE_ERROR)
                 emit readFileError();
             else
                 emit downloadFailed();
         }
 
-        //关闭控制连接
-        session.quit();
+        //连接池中的连接都是 MODE S
+        if (isReusable && isDeflate)
+        {
+            std::string errorMsg;
+            isReusable = utils::asyncAwait<CmdToServerRet>(
+                             enterStreamMode, session.getControlSock(),
+                             errorMsg) == CmdToServerRet::SUCCEEDED;
+        }
+        //关闭控制连接或还回连接池
+        if (isReusable)
+            session.releaseToPool();
+        else
+            session.quit();
+    }
+
+    void DownloadFileTask::downloadSegmented()
+    {
+        //主控制连接只用来获取文件大小，还回连接池给其中一段使用
+        session.releaseToPool();
+        isSegmented = true;
+        segmentStop = false;
+
+        //续传时只下载上次没下完的区间，否则把文件平均分成 segmentCount 段
+        std::vector<std::pair<long long, long long>> ranges = pendingRanges;
+        const bool isRangeResume = !ranges.empty();
+        if (!isRangeResume)
+        {
+            const long long segmentSize =
+                (remoteFilesize + segmentCount - 1) / segmentCount;
+            for (int i = 0; i < segmentCount; ++i)
+            {
+                long long begin = segmentSize * i;
+                long long end = std::min(remoteFilesize, begin + segmentSize);
+                if (begin >= end)
+                    break;
+                ranges.emplace_back(begin, end);
+            }
+        }
+        //随时可能失败或被停止，先按各段都没下载记下
+        pendingRanges = ranges;
+        long long remaining = 0;
+        for (const auto &range : ranges)
+            remaining += range.second - range.first;
+        //只下载了部分区间时算不出整个文件的 CRC-32
+        const bool isChecksummed = verifyChecksum && !isRangeResume;
+
+        //各段用定位写入，文件先分配好空间、占好最终大小
+        file.preallocate(remoteFilesize);
+        if (!file.resize(remoteFilesize))
+        {
+            emit readFileError();
+            return;
+        }
+        emit downloadStarted();
+
+        struct SegmentResult
+        {
+            DownloadSegmentTask::Res res = DownloadSegmentTask::Res::FAILED;
+            std::string errorMsg;
+            //本段的 CRC-32 和长度
+            std::uint32_t crc = 0;
+            long long len = 0;
+            //本段已写入文件的字节数
+            long long received = 0;
+        };
+        const std::string hostname = session.getHostname();
+        const int port = session.getPort();
+        const std::string username = session.getUsername();
+        const std::string password = session.getPassword();
+        progress.reset(remoteFilesize, remoteFilesize - remaining);
+        const utils::Throttle throttle{&rateLimiter,
+                                       &utils::RateLimiter::globalDownload()};
+        //各段都是阻塞的网络读写，用单独的线程池，不和全局线程池抢线程。
+        //续传时剩下的区间可能比段数多，同时登录的连接仍不超过 segmentCount
+        QThreadPool pool;
+        pool.setMaxThreadCount(std::min(int(ranges.size()), segmentCount));
+        std::vector<QFuture<SegmentResult>> futures;
+        for (const auto &range : ranges)
+        {
+            const long long begin = range.first;
+            const long long end = range.second;
+            futures.push_back(QtConcurrent::run(&pool, [&, begin, end]() {
+                SegmentResult result;
+                DownloadSegmentTask segment(
+                    hostname, port, username, password, remoteFilepath, file,
+                    begin, end, remoteFilesize, progress, segmentStop,
+                    throttle, bufferSize, isChecksummed, diskQueueDepth,
+                    socketProfile);
+                result.res = segment.run(result.errorMsg);
+                result.received = segment.received();
+                result.crc = segment.crc32();
+                result.len = end - begin;
+                return result;
+            }));
+        }
+
+        auto onTick = [this, &futures]() {
+            //任何一段失败，其余各段也不必再下载
+            for (auto &future : futures)
+                if (future.isFinished() &&
+                    future.result().res != DownloadSegmentTask::Res::SUCCEEDED)
+                    segmentStop = true;
+            emit progressSync(progress.sample());
+        };
+        //依次等待各段，等待期间定时刷新进度、检查失败
+        for (auto &future : futures)
+            utils::awaitFuture(future, utils::PROGRESS_TICK_INTERVAL, onTick);
+        onTick();
+
+        //记下各段还没下完的部分，暂停或失败后 resume() 接着下载
+        pendingRanges.clear();
+        for (std::size_t i = 0; i < futures.size(); ++i)
+        {
+            const long long begin =
+                ranges[i].first + futures[i].result().received;
+            if (begin < ranges[i].second)
+                pendingRanges.emplace_back(begin, ranges[i].second);
+        }
+
+        if (isSetStop)
+            return;
+        //按第一个真正出错（而不是被停止）的段报告结果
+        for (auto &future : futures)
+        {
+            SegmentResult result = future.result();
+            if (result.res == DownloadSegmentTask::Res::SUCCEEDED ||
+                result.res == DownloadSegmentTask::Res::STOPPED)
+                continue;
+            if (result.res == DownloadSegmentTask::Res::READ_FILE_ERROR)
+                emit readFileError();
+            else if (result.res == DownloadSegmentTask::Res::FAILED_WITH_MSG)
+                emit downloadFailedWithMsg(std::move(result.errorMsg));
+            else
+                emit downloadFailed();
+            return;
+        }
+
+        if (isChecksummed)
+        {
+            std::uint32_t crc = 0;
+            for (auto &future : futures)
+                crc = utils::Crc32::combine(crc, future.result().crc,
+                                            future.result().len);
+            //最后一段收到 226 后把控制连接还回了连接池，借来发校验命令
+            SOCKET controlSock = utils::asyncAwait<SOCKET>([&]() {
+                return SessionPool::instance().acquire(hostname, port,
+                                                       username);
+            });
+            if (controlSock != INVALID_SOCKET)
+            {
+                auto verifyRes = this->verifyChecksumOnServer(controlSock, crc);
+                if (verifyRes == VerifyChecksumRes::FAILED)
+                {
+                    utils::discardFtpMsgBuffer(controlSock);
+                    closesocket(controlSock);
+                }
+                else
+                    SessionPool::instance().release(hostname, port, username,
+                                                    controlSock);
+                if (isSetStop)
+                    return;
+                if (verifyRes == VerifyChecksumRes::MISMATCHED)
+                {
+                    emit downloadChecksumMismatch();
+                    return;
+                }
+            }
+        }
+        emit downloadSucceed();
+    }
+
+    VerifyChecksumRes
+    DownloadFileTask::verifyChecksumOnServer(SOCKET controlSock,
+                                             std::uint32_t localCrc)
+    {
+        return utils::reactorAwait<VerifyChecksumRes>(
+            [this, controlSock,
+             localCrc](std::function<void(VerifyChecksumRes)> finish) {
+                asyncVerifyCrc32(controlSock, remoteFilepath, localCrc,
+                                 CommandSequence::COMMAND_TIMEOUT,
+                                 [finish](VerifyChecksumRes res,
+                                          std::uint32_t) { finish(res); });
+            });
     }
 
 } // namespace ftpclient
@@ -0,0 +1,223 @@
+#include "../include/DownloadSegmentTask.h"
+#include "../include/MyUtils.h"
+#include "../include/SessionPool.h"
+#include <algorithm>
+
+namespace ftpclient
+{
+
+    const int DownloadSegmentTask::SOCKET_SEND_TIMEOUT;
+    const int DownloadSegmentTask::SOCKET_RECV_TIMEOUT;
+
+    DownloadSegmentTask::DownloadSegmentTask(
+        const std::string &hostname, int port, const std::string &username,
+        const std::string &password, const std::string &remoteFilepath,
+        utils::LocalFile &file, long long begin, long long end,
+        long long filesize, utils::TransferProgress &progress,
+        std::atomic<bool> &stopFlag, const utils::Throttle &throttle,
+        int bufferSize, bool computeChecksum, int diskQueueDepth,
+        const utils::SocketProfile &socketProfile)
+        : hostname(hostname),
+          port(port),
+          username(username),
+          password(password),
+          remoteFilepath(remoteFilepath),
+          file(file),
+          begin(begin),
+          end(end),
+          filesize(filesize),
+          progress(progress),
+          stopFlag(stopFlag),
+          throttle(throttle),
+          bufferSize(bufferSize),
+          computeChecksum(computeChecksum),
+          diskQueueDepth(diskQueueDepth),
+          socketProfile(socketProfile),
+          controlSock(INVALID_SOCKET),
+          dataSock(INVALID_SOCKET)
+    {
+    }
+
+    DownloadSegmentTask::~DownloadSegmentTask() { this->closeSockets(); }
+
+    void DownloadSegmentTask::closeSockets()
+    {
+        if (dataSock != INVALID_SOCKET)
+        {
+            closesocket(dataSock);
+            dataSock = INVALID_SOCKET;
+        }
+        if (controlSock != INVALID_SOCKET)
+        {
+            utils::discardFtpMsgBuffer(controlSock);
+            closesocket(controlSock);
+            controlSock = INVALID_SOCKET;
+        }
+    }
+
+    DownloadSegmentTask::Res DownloadSegmentTask::run(std::string &errorMsg)
+    {
+        Res res = this->connectAndLogin(errorMsg);
+        if (res == Res::SUCCEEDED)
+            res = this->dataConnect(errorMsg);
+        if (res == Res::SUCCEEDED)
+            res = this->requestRange(errorMsg);
+        if (res == Res::SUCCEEDED)
+            res = this->recvRange();
+        if (res == Res::SUCCEEDED)
+            res = this->finishTransfer(errorMsg);
+        this->closeSockets();
+        if (res != Res::SUCCEEDED && stopFlag)
+            return Res::STOPPED;
+        return res;
+    }
+
+    DownloadSegmentTask::Res
+    DownloadSegmentTask::connectAndLogin(std::string &errorMsg)
+    {
+        //池中的连接都已登录并切换为二进制模式
+        controlSock =
+            SessionPool::instance().acquire(hostname, port, username);
+        if (controlSock != INVALID_SOCKET)
+            return Res::SUCCEEDED;
+
+        auto connectRes =
+            connectToServer(controlSock, hostname, std::to_string(port),
+                            SOCKET_SEND_TIMEOUT, SOCKET_RECV_TIMEOUT);
+        if (connectRes != ConnectToServerRes::SUCCEEDED)
+            return Res::FAILED;
+
+        std::string recvMsg;
+        auto welcomeRes = recvWelcomMsg(controlSock, recvMsg);
+        if (welcomeRes != RecvMultRes::SUCCEEDED)
+        {
+            if (welcomeRes == RecvMultRes::FAILED_WITH_MSG)
+            {
+                errorMsg = std::move(recvMsg);
+                return Res::FAILED_WITH_MSG;
+            }
+            return Res::FAILED;
+        }
+
+        auto cmdRes = loginToServer(controlSock, username, password, errorMsg);
+        if (cmdRes == CmdToServerRet::SUCCEEDED)
+            cmdRes = setBinaryOrAsciiTransferMode(controlSock, true, errorMsg);
+        if (cmdRes == CmdToServerRet::SUCCEEDED)
+            return Res::SUCCEEDED;
+        else if (cmdRes == CmdToServerRet::FAILED_WITH_MSG)
+            return Res::FAILED_WITH_MSG;
+        else
+            return Res::FAILED;
+    }
+
+    DownloadSegmentTask::Res
+    DownloadSegmentTask::dataConnect(std::string &errorMsg)
+    {
+        std::string dataHostname;
+        int dataPort;
+        //按服务器能力选择 PASV 或 EPSV，各段共用同一条记录
+        auto ret =
+            enterPassiveMode(controlSock, dataHostname, dataPort, errorMsg);
+        if (ret == CmdToServerRet::FAILED_WITH_MSG)
+            return Res::FAILED_WITH_MSG;
+        else if (ret != CmdToServerRet::SUCCEEDED)
+            return Res::FAILED;
+
+        auto connectRes =
+            connectToServer(dataSock, dataHostname, std::to_string(dataPort),
+                            SOCKET_SEND_TIMEOUT, SOCKET_RECV_TIMEOUT,
+                            socketProfile);
+        if (connectRes != ConnectToServerRes::SUCCEEDED)
+            return Res::FAILED;
+        return Res::SUCCEEDED;
+    }
+
+    DownloadSegmentTask::Res
+    DownloadSegmentTask::requestRange(std::string &errorMsg)
+    {
+        auto ret = CmdToServerRet::SUCCEEDED;
+        if (begin > 0)
+            ret = requestRestFromServer(controlSock, begin, errorMsg);
+        if (ret == CmdToServerRet::SUCCEEDED)
+            ret = requestRetrFromFromServer(controlSock, remoteFilepath,
+                                            errorMsg);
+        if (ret == CmdToServerRet::SUCCEEDED)
+            return Res::SUCCEEDED;
+        else if (ret == CmdToServerRet::FAILED_WITH_MSG)
+            return Res::FAILED_WITH_MSG;
+        else
+            return Res::FAILED;
+    }
+
+    DownloadSegmentTask::Res DownloadSegmentTask::recvRange()
+    {
+        //攒满一块再写，各段的写入位置都按块对齐
+        utils::SequentialWriter writer(
+            file, begin, std::size_t(clampTransferBufferSize(bufferSize)),
+            filesize >= DROP_CACHE_MIN_FILESIZE, diskQueueDepth);
+        if (writer.isAllocFailed())
+            return Res::READ_FILE_ERROR;
+        long long pos = begin;
+        Res res = Res::SUCCEEDED;
+        while (pos < end)
+        {
+            if (stopFlag)
+            {
+                res = Res::STOPPED;
+                break;
+            }
+            char *space = writer.space();
+            int maxLen = int(throttle.chunkSize(
+                std::min<long long>(end - pos, (long long)writer.spaceSize())));
+            int iResult = recv(dataSock, space, maxLen, 0);
+            if (iResult == 0)
+                break;
+            else if (iResult < 0)
+            {
+                res = Res::FAILED;
+                break;
+            }
+            if (computeChecksum)
+                checksum.update(space, std::size_t(iResult));
+            if (!writer.commit(std::size_t(iResult)))
+                return Res::READ_FILE_ERROR;
+            pos += iResult;
+            progress.add(iResult);
+            throttle.consume(iResult);
+        }
+        //停止或断开时也把收到的数据写出去，续传时从这里接着下载
+        if (!writer.flush())
+            return Res::READ_FILE_ERROR;
+        receivedBytes = pos - begin;
+        if (res != Res::SUCCEEDED)
+            return res;
+        //没收满就断开说明文件在服务器上变短了
+        return pos == end ? Res::SUCCEEDED : Res::FAILED;
+    }
+
+    DownloadSegmentTask::Res
+    DownloadSegmentTask::finishTransfer(std::string &errorMsg)
+    {
+        closesocket(dataSock);
+        dataSock = INVALID_SOCKET;
+        //本段收满而服务器还没发完，直接关闭连接就相当于中止传输，
+        //不必再为 ABOR 多等一个来回
+        if (end < filesize)
+            return Res::SUCCEEDED;
+
+        //最后一段：正常接收 226，之后控制连接可以还回连接池
+        std::string recvMsg;
+        auto recvRes = recvTransferCompleteMsg(controlSock, recvMsg);
+        if (recvRes == RecvMultRes::FAILED_WITH_MSG)
+        {
+            errorMsg = std::move(recvMsg);
+            return Res::FAILED_WITH_MSG;
+        }
+        else if (recvRes != RecvMultRes::SUCCEEDED)
+            return Res::FAILED;
+        SessionPool::instance().release(hostname, port, username, controlSock);
+        controlSock = INVALID_SOCKET;
+        return Res::SUCCEEDED;
+    }
+
+} // namespace ftpclient
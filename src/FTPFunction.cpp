@@ -1,14 +1,32 @@
 #include "../include/FTPFunction.h"
+#include "../include/FtpReply.h"
 #include "../include/MyUtils.h"
+#include "../include/BufferPool.h"
+#include "../include/Deflate.h"
+#include "../include/LocalFile.h"
+#include "../include/Reactor.h"
+#include "../include/Resolver.h"
 #include "../include/ScopeGuard.h"
+#include "../include/ServerCapabilities.h"
 #include <QtDebug>
+#include <algorithm>
 #include <cstdio>
 #include <cstring>
+#include <condition_variable>
+#include <future>
 #include <memory>
-#include <regex>
-#include <ws2tcpip.h>
+#include <mutex>
+#include <thread>
+#include <vector>
+#ifdef _WIN32
+#include <mswsock.h>
+#elif defined(__linux__)
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/sendfile.h>
+#include <unistd.h>
+#endif
 
-using std::unique_ptr;
 using utils::ScopeGuard;
 
 namespace
@@ -22,13 +40,7 @@ namespace
      */
     bool setSendTimeout(SOCKET sock, int timeout)
     {
-        int iResult;
-        iResult = setsockopt(sock, SOL_SOCKET, SO_SNDTIMEO,
-                             (const char *)&timeout, sizeof(timeout));
-        if (iResult != 0)
-            return false;
-        else
-            return true;
+        return utils::setSocketTimeout(sock, SO_SNDTIMEO, timeout);
     }
 
     /**
@@ -40,143 +52,852 @@ namespace
      */
     bool setRecvTimeout(SOCKET sock, int timeout)
     {
-        int iResult;
-        iResult = setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO,
-                             (const char *)&timeout, sizeof(timeout));
-        if (iResult != 0)
-            return false;
-        else
-            return true;
+        return utils::setSocketTimeout(sock, SO_RCVTIMEO, timeout);
     }
-} // namespace
 
-namespace ftpclient
-{
+    /**
+     * @brief 发送全部数据，处理 send() 只发出一部分的情况
+     * @author zhb
+     * @param sock 数据连接
+     * @param buf 数据
+     * @param len 字节数
+     * @return 是否全部发送成功
+     */
+    bool sendAll(SOCKET sock, const char *buf, int len)
+    {
+        while (len > 0)
+        {
+            int iResult = send(sock, buf, len, utils::SEND_FLAGS);
+            if (iResult == SOCKET_ERROR)
+                return false;
+            buf += iResult;
+            len -= iResult;
+        }
+        return true;
+    }
 
-    ConnectToServerRes connectToServer(SOCKET &sock,
-                                       const std::string &hostname,
-                                       const std::string &port, int sendTimeout,
-                                       int recvTimeout)
+    /**
+     * @brief 上传流水线中读文件阶段与发送阶段之间的环形缓冲区
+     * @author zhb
+     *
+     * 读线程不断把文件内容读入空闲的块，发送线程按顺序取出已填满的块发送，
+     * 块全部填满时读线程等待，全部为空时发送线程等待
+     */
+    class ReadAheadRing
     {
-        WSADATA wsaData;
-        int iResult;
-        //初始化Winsock
-        iResult = WSAStartup(MAKEWORD(2, 2), &wsaData);
-        if (iResult != 0)
-            return ConnectToServerRes::WSAStartup_FAILED;
-        // WSACleanup()用于结束对WS2_32 DLL的使用
-        ScopeGuard guardCleanWSA([]() { WSACleanup(); });
-
-        addrinfo *result = nullptr;
-        addrinfo hints;
-        ZeroMemory(&hints, sizeof(hints)); //结构体初始化
-        hints.ai_family = AF_UNSPEC;       //未指定，IPv4和IPv6均可
-        hints.ai_socktype = SOCK_STREAM;
-        hints.ai_protocol = IPPROTO_TCP;
-        //设定服务器地址和端口号
-        iResult = getaddrinfo(hostname.c_str(), port.c_str(), &hints, &result);
-        if (iResult != 0)
-            return ConnectToServerRes::getaddrinfo_FAILED;
-        ScopeGuard guardFreeAddrinfo([=]() { freeaddrinfo(result); });
+    public:
+        struct Block
+        {
+            utils::BufferPool::Buffer buffer;
+            int len = 0;
+        };
 
-        sock = INVALID_SOCKET;
-        for (addrinfo *ptr = result; ptr != nullptr; ptr = ptr->ai_next)
+        /**
+         * @param depth 块的个数
+         * @param blockSize 每块的字节数
+         */
+        ReadAheadRing(int depth, int blockSize) : blocks(std::max(depth, 1))
         {
-            //创建用于连接服务器的socket
-            sock = socket(ptr->ai_family, ptr->ai_socktype, ptr->ai_protocol);
-            if (sock == INVALID_SOCKET)
-                return ConnectToServerRes::socket_FAILED;
+            for (Block &block : blocks)
+            {
+                block.buffer = utils::BufferPool::instance().acquire(blockSize);
+                if (block.buffer.data() == nullptr)
+                    allocFailed = true;
+            }
+        }
 
-            //尝试连接服务器
-            iResult = connect(sock, ptr->ai_addr, (int)ptr->ai_addrlen);
-            if (iResult == SOCKET_ERROR)
+        bool isAllocFailed() const { return allocFailed; }
+
+        /**
+         * @brief 读阶段：读到文件结尾、出错或被取消为止
+         * @param ifs 文件输入流
+         * @param checksum 非空时对读到的数据计算 CRC-32，与发送重叠
+         */
+        void readLoop(std::ifstream &ifs, utils::Crc32 *checksum)
+        {
+            while (true)
             {
-                closesocket(sock);
-                sock = INVALID_SOCKET;
-                continue;
+                Block *block;
+                {
+                    std::unique_lock<std::mutex> lock(mutex);
+                    notFull.wait(lock, [this]() {
+                        return cancelled || count < blocks.size();
+                    });
+                    if (cancelled)
+                        return;
+                    //[head, head + count) 归发送阶段所有，其余的块可以写
+                    block = &blocks[(head + count) % blocks.size()];
+                }
+                ifs.read(block->buffer.data(), int(block->buffer.size()));
+                block->len = int(ifs.gcount());
+                if (checksum != nullptr)
+                    checksum->update(block->buffer.data(),
+                                     std::size_t(block->len));
+
+                std::lock_guard<std::mutex> guard(mutex);
+                //读到结尾时 failbit 也会置位，所以先看 eof；
+                //没到结尾却读失败（badbit 或只有 failbit）都按读文件出错处理，
+                //否则下一轮读不到数据，会一直空转
+                if (ifs.bad() || (!ifs.eof() && ifs.fail()))
+                    readError = true;
+                else
+                {
+                    if (block->len > 0)
+                        ++count;
+                    if (ifs.eof())
+                        eof = true;
+                }
+                notEmpty.notify_one();
+                if (readError || eof)
+                    return;
             }
-            else
-                break; //连接服务器成功
         }
-        if (sock == INVALID_SOCKET)
-            return ConnectToServerRes::UNABLE_TO_CONNECT_TO_SERVER;
-        else
+
+        /**
+         * @brief 发送阶段：取出下一块
+         * @return 下一块，读完或出错时返回 nullptr
+         */
+        Block *front()
         {
-            if (sendTimeout >= 0)
-                setSendTimeout(sock, sendTimeout);
-            if (recvTimeout >= 0)
-                setRecvTimeout(sock, recvTimeout);
-            guardCleanWSA.dismiss();
-            return ConnectToServerRes::SUCCEEDED;
+            std::unique_lock<std::mutex> lock(mutex);
+            notEmpty.wait(lock,
+                          [this]() { return count > 0 || eof || readError; });
+            if (readError || count == 0)
+                return nullptr;
+            return &blocks[head];
         }
-    }
 
-    RecvMultRes recvMultipleMsg(SOCKET controlSock,
-                                const std::regex &matchRegex, std::string &msg)
+        /**
+         * @brief 发送阶段：归还已发送完的块
+         */
+        void pop()
+        {
+            std::lock_guard<std::mutex> guard(mutex);
+            head = (head + 1) % blocks.size();
+            --count;
+            notFull.notify_one();
+        }
+
+        /**
+         * @brief 发送失败时让读阶段停下来
+         */
+        void cancel()
+        {
+            std::lock_guard<std::mutex> guard(mutex);
+            cancelled = true;
+            notFull.notify_one();
+        }
+
+        bool hasReadError()
+        {
+            std::lock_guard<std::mutex> guard(mutex);
+            return readError;
+        }
+
+    private:
+        std::vector<Block> blocks;
+        bool allocFailed = false;
+
+        std::mutex mutex;
+        std::condition_variable notEmpty;
+        std::condition_variable notFull;
+        //下一个要发送的块
+        std::size_t head = 0;
+        //已填满、等待发送的块数
+        std::size_t count = 0;
+        bool eof = false;
+        bool readError = false;
+        bool cancelled = false;
+    };
+
+    /**
+     * @brief 同时向服务器的多个地址发起非阻塞连接，先连上的胜出（RFC 8305）
+     * @author zhb
+     *
+     * 地址按 IPv6、IPv4 交替排列（以 getaddrinfo() 返回的第一个地址族开头），
+     * 每隔 CONNECT_ATTEMPT_DELAY 多发起一个连接，某个连接失败时立即发起下一个；
+     * 一个连上后关闭其余的。不可达的 IPv6 地址最多耽误 CONNECT_ATTEMPT_DELAY，
+     * 整个过程不超过给定的超时时间。
+     * 所有状态只在 Reactor 线程中访问
+     */
+    class ConnectRace : public std::enable_shared_from_this<ConnectRace>
     {
-        msg.clear();
-        std::string recvMsg; //一条FTP消息
-        bool hasMsg = false;
-        int iResult;
-        while (true)
+    public:
+        using Done = std::function<void(ftpclient::ConnectToServerRes, SOCKET)>;
+
+        /**
+         * @brief 开始连接，done 在 Reactor 线程中调用
+         * @param addresses 解析出的地址
+         * @param timeout 整个过程的超时时间(ms)
+         */
+        static void start(const utils::Resolver::Addresses &addresses,
+                          int timeout, int sendTimeout, int recvTimeout,
+                          const utils::SocketProfile &profile, Done done)
+        {
+            std::shared_ptr<ConnectRace> race(new ConnectRace());
+            race->sendTimeout = sendTimeout;
+            race->recvTimeout = recvTimeout;
+            race->profile = profile;
+            race->done = std::move(done);
+            race->sortAddresses(addresses);
+            utils::Reactor &reactor = utils::Reactor::instance();
+            reactor.post([race, timeout]() {
+                race->deadlineTimer = utils::Reactor::instance().addTimer(
+                    timeout, [race]() {
+                        race->finish(ftpclient::ConnectToServerRes::
+                                         UNABLE_TO_CONNECT_TO_SERVER,
+                                     INVALID_SOCKET);
+                    });
+                race->startNext();
+            });
+        }
+
+    private:
+        ConnectRace() = default;
+
+        void sortAddresses(const utils::Resolver::Addresses &resolved)
         {
-            recvMsg.clear();
-            iResult = utils::recvFtpMsg(controlSock, recvMsg);
-            if (iResult > 0)
+            utils::Resolver::Addresses first, second;
+            const int firstFamily = resolved.empty() ? 0 : resolved[0].family;
+            for (const utils::ResolvedAddress &address : resolved)
+                (address.family == firstFamily ? first : second)
+                    .push_back(address);
+            for (std::size_t i = 0; i < first.size() || i < second.size(); ++i)
             {
-                //检查返回码
-                if (!std::regex_search(recvMsg, matchRegex))
+                if (i < first.size())
+                    addresses.push_back(first[i]);
+                if (i < second.size())
+                    addresses.push_back(second[i]);
+            }
+        }
+
+        //发起下一个地址的连接，直到有一个正在进行为止
+        void startNext()
+        {
+            if (isFinished)
+                return;
+            utils::Reactor &reactor = utils::Reactor::instance();
+            reactor.cancelTimer(staggerTimer);
+            staggerTimer = 0;
+            while (next < addresses.size())
+            {
+                const utils::ResolvedAddress &address = addresses[next++];
+                SOCKET sock = socket(address.family, SOCK_STREAM, IPPROTO_TCP);
+                if (sock == INVALID_SOCKET)
+                    continue;
+                isAttempted = true;
+                utils::prepareSocket(sock);
+                //缓冲区大小决定握手时通告的窗口缩放因子，要在连接前设置
+                utils::applySocketProfile(sock, profile);
+                utils::setNonBlocking(sock, true);
+                if (connect(sock, (const sockaddr *)&address.addr,
+                            (int)address.len) == 0)
                 {
-                    msg = std::move(recvMsg);
-                    return RecvMultRes::FAILED_WITH_MSG;
+                    this->finish(ftpclient::ConnectToServerRes::SUCCEEDED,
+                                 sock);
+                    return;
                 }
-                else
+                if (!utils::isConnectInProgress(utils::lastSocketError()))
                 {
-                    hasMsg = true;
-                    msg += recvMsg;
+                    closesocket(sock);
+                    continue;
                 }
+                //可写即连接结束，再从 SO_ERROR 取连接结果
+                auto self = this->shared_from_this();
+                if (!reactor.watch(sock, utils::Reactor::WRITABLE, -1,
+                                   [self, sock](utils::Reactor::WaitRes res) {
+                                       self->onWritable(sock, res);
+                                   }))
+                {
+                    closesocket(sock);
+                    continue;
+                }
+                pending.push_back(sock);
+                break;
+            }
+            if (next < addresses.size())
+            {
+                auto self = this->shared_from_this();
+                staggerTimer = reactor.addTimer(ftpclient::CONNECT_ATTEMPT_DELAY,
+                                                [self]() { self->startNext(); });
+            }
+            else if (pending.empty())
+                this->finish(isAttempted
+                                 ? ftpclient::ConnectToServerRes::
+                                       UNABLE_TO_CONNECT_TO_SERVER
+                                 : ftpclient::ConnectToServerRes::socket_FAILED,
+                             INVALID_SOCKET);
+        }
+
+        void onWritable(SOCKET sock, utils::Reactor::WaitRes res)
+        {
+            //胜负已分时其余的等待被取消，socket 由 finish() 关闭
+            if (isFinished)
+                return;
+            int error = 0;
+            socklen_t len = sizeof(error);
+            pending.erase(std::remove(pending.begin(), pending.end(), sock),
+                          pending.end());
+            if (res == utils::Reactor::WaitRes::READY &&
+                getsockopt(sock, SOL_SOCKET, SO_ERROR, (char *)&error, &len) ==
+                    0 &&
+                error == 0)
+            {
+                this->finish(ftpclient::ConnectToServerRes::SUCCEEDED, sock);
+                return;
             }
+            closesocket(sock);
+            //这个地址不通，不必等到下一个间隔
+            this->startNext();
+        }
+
+        void finish(ftpclient::ConnectToServerRes res, SOCKET sock)
+        {
+            if (isFinished)
+            {
+                if (sock != INVALID_SOCKET)
+                    closesocket(sock);
+                return;
+            }
+            isFinished = true;
+            utils::Reactor &reactor = utils::Reactor::instance();
+            reactor.cancelTimer(staggerTimer);
+            reactor.cancelTimer(deadlineTimer);
+            for (SOCKET other : pending)
+                if (other != sock)
+                {
+                    reactor.cancel(other);
+                    closesocket(other);
+                }
+            pending.clear();
+            if (sock != INVALID_SOCKET)
+            {
+                //连接成功后改回阻塞模式，数据传输仍用阻塞式函数
+                utils::setNonBlocking(sock, false);
+                if (sendTimeout >= 0)
+                    setSendTimeout(sock, sendTimeout);
+                if (recvTimeout >= 0)
+                    setRecvTimeout(sock, recvTimeout);
+                //新 socket 可能复用了旧句柄，清掉旧连接残留的数据
+                utils::discardFtpMsgBuffer(sock);
+            }
+            Done callback = std::move(done);
+            callback(res, sock);
+        }
+
+        utils::Resolver::Addresses addresses;
+        //下一个要尝试的地址
+        std::size_t next = 0;
+        //正在连接的 socket
+        std::vector<SOCKET> pending;
+        utils::TimerWheel::TimerId staggerTimer = 0;
+        utils::TimerWheel::TimerId deadlineTimer = 0;
+        bool isFinished = false;
+        //是否创建过 socket，一个也没创建成功时结果为 socket_FAILED
+        bool isAttempted = false;
+        int sendTimeout = -1;
+        int recvTimeout = -1;
+        utils::SocketProfile profile;
+        Done done;
+    };
+
+    using ftpclient::CapabilityCache;
+    using ftpclient::CmdToServerRet;
+    using ftpclient::ServerCapabilities;
+    using ftpclient::Support;
+    using PassiveDone =
+        std::function<void(CmdToServerRet, std::string, int, std::string)>;
+
+    // 500 / 502：服务器不认识或没有实现这条命令
+    bool isUnsupportedReply(const std::string &reply)
+    {
+        int code = ftpclient::parseReplyCode(reply);
+        return code == 500 || code == 502;
+    }
+
+    //控制连接的对端是否为 IPv6 地址，PASV 的回复只能表示 IPv4 地址
+    bool isIpv6Peer(SOCKET controlSock)
+    {
+        sockaddr_storage addr{};
+        socklen_t addrLen = sizeof(addr);
+        if (getpeername(controlSock, (sockaddr *)&addr, &addrLen) != 0 ||
+            addr.ss_family != AF_INET6)
+            return false;
+        const auto *v6 = reinterpret_cast<const sockaddr_in6 *>(&addr);
+        return !IN6_IS_ADDR_V4MAPPED(&v6->sin6_addr);
+    }
+
+    /**
+     * @brief 先用 EPSV 还是 PASV
+     * @return 已知 PASV 不可用或对端为 IPv6 时先用 EPSV，除非已知 EPSV 不可用
+     */
+    bool isEpsvFirst(SOCKET controlSock, const ServerCapabilities &caps)
+    {
+        if (caps.epsv == Support::NO)
+            return false;
+        return caps.pasv == Support::NO || isIpv6Peer(controlSock);
+    }
+
+    //把 PASV、EPSV 等命令的回复记入能力缓存，只有 500 / 502 记为不支持
+    void recordCmdReply(SOCKET controlSock,
+                            Support ServerCapabilities::*field,
+                            CmdToServerRet ret, const std::string &reply)
+    {
+        if (ret == CmdToServerRet::SUCCEEDED)
+            CapabilityCache::instance().set(controlSock, field, Support::YES);
+        else if (ret == CmdToServerRet::FAILED_WITH_MSG &&
+                 isUnsupportedReply(reply))
+            CapabilityCache::instance().set(controlSock, field, Support::NO);
+    }
+
+    void asyncEpsv(SOCKET controlSock, int timeout, bool canFallBack,
+                   PassiveDone done);
+
+    /**
+     * @brief 发送 PASV
+     * @param canFallBack 服务器不支持时是否改用 EPSV
+     */
+    void asyncPasv(SOCKET controlSock, int timeout, bool canFallBack,
+                   PassiveDone done)
+    {
+        //正常为"227 Entering passive mode (h1,h2,h3,h4,p1,p2)"
+        auto onReply = [controlSock, timeout, canFallBack,
+                        done](CmdToServerRet ret, std::string recvMsg) {
+            int host[4];
+            int port = 0;
+            if (ret == CmdToServerRet::SUCCEEDED &&
+                !ftpclient::parsePasvReply(recvMsg, host, port))
+                ret = CmdToServerRet::FAILED_WITH_MSG;
+            recordCmdReply(controlSock, &ServerCapabilities::pasv, ret,
+                               recvMsg);
+            if (ret == CmdToServerRet::SUCCEEDED)
+                done(ret,
+                     std::to_string(host[0]) + "." + std::to_string(host[1]) +
+                         "." + std::to_string(host[2]) + "." +
+                         std::to_string(host[3]),
+                     port, std::string());
+            //服务器不支持 PASV，必须要用EPSV模式
+            else if (ret == CmdToServerRet::FAILED_WITH_MSG && canFallBack &&
+                     isUnsupportedReply(recvMsg))
+                asyncEpsv(controlSock, timeout, false, done);
             else
+                done(ret, std::string(), 0, std::move(recvMsg));
+        };
+        ftpclient::asyncCmdToServer(controlSock, "PASV\r\n", {227}, timeout,
+                                    onReply);
+    }
+
+    /**
+     * @brief 发送 EPSV
+     * @param canFallBack 服务器不支持时是否改用 PASV
+     */
+    void asyncEpsv(SOCKET controlSock, int timeout, bool canFallBack,
+                   PassiveDone done)
+    {
+        //正常为"229 Entering Extended Passive Mode (|||port|)"
+        auto onReply = [controlSock, timeout, canFallBack,
+                        done](CmdToServerRet ret, std::string recvMsg) {
+            int port = 0;
+            if (ret == CmdToServerRet::SUCCEEDED &&
+                !ftpclient::parseEpsvReply(recvMsg, port))
+                ret = CmdToServerRet::FAILED_WITH_MSG;
+            recordCmdReply(controlSock, &ServerCapabilities::epsv, ret,
+                               recvMsg);
+            if (ret == CmdToServerRet::FAILED_WITH_MSG && canFallBack &&
+                isUnsupportedReply(recvMsg))
             {
-                int errorCode = WSAGetLastError();
-                if (iResult < 0 && errorCode != WSAETIMEDOUT)
-                    return RecvMultRes::FAILED;
-                else
-                    break;
+                asyncPasv(controlSock, timeout, false, done);
+                return;
             }
+            if (ret != CmdToServerRet::SUCCEEDED)
+            {
+                done(ret, std::string(), 0, std::move(recvMsg));
+                return;
+            }
+            // EPSV模式下，数据连接的地址与控制连接的相同
+            std::string hostname = utils::peerAddress(controlSock);
+            if (hostname.empty())
+                done(CmdToServerRet::RECV_FAILED, std::string(), 0,
+                     std::string());
+            else
+                done(ret, std::move(hostname), port, std::string());
+        };
+        ftpclient::asyncCmdToServer(controlSock, "EPSV\r\n", {229}, timeout,
+                                    onReply);
+    }
+
+    /**
+     * @brief 取服务器的 FEAT 结果，缓存中没有时才发送 FEAT
+     * @param done 参数为结果状态码和能力记录，服务器不支持 FEAT 时状态码
+     *             仍为 SUCCEEDED，记录中相应的特性为 NO
+     */
+    void asyncFeat(
+        SOCKET controlSock, int timeout,
+        std::function<void(CmdToServerRet, ServerCapabilities)> done)
+    {
+        ServerCapabilities caps = CapabilityCache::instance().get(controlSock);
+        if (caps.isFeatKnown)
+        {
+            done(CmdToServerRet::SUCCEEDED, std::move(caps));
+            return;
+        }
+        //正常为"211-Features:\r\n ...\r\n211 End"，不支持 FEAT 时多为 500
+        ftpclient::asyncCmdToServer(
+            controlSock, "FEAT\r\n", {211}, timeout,
+            [controlSock, done](CmdToServerRet ret, std::string recvMsg) {
+                if (ret != CmdToServerRet::SUCCEEDED &&
+                    ret != CmdToServerRet::FAILED_WITH_MSG)
+                {
+                    done(ret, ServerCapabilities());
+                    return;
+                }
+                auto &cache = CapabilityCache::instance();
+                cache.recordFeat(controlSock, recvMsg);
+                ServerCapabilities caps = cache.get(controlSock);
+                //取不到对端地址说明控制连接已经断开
+                if (!caps.isFeatKnown)
+                    ret = CmdToServerRet::RECV_FAILED;
+                else
+                    ret = CmdToServerRet::SUCCEEDED;
+                done(ret, std::move(caps));
+            });
+    }
+
+    // asyncFeat() 的阻塞版本
+    CmdToServerRet getFeatures(SOCKET controlSock, ServerCapabilities &caps)
+    {
+        auto &cache = CapabilityCache::instance();
+        caps = cache.get(controlSock);
+        if (caps.isFeatKnown)
+            return CmdToServerRet::SUCCEEDED;
+        std::string recvMsg;
+        auto ret =
+            ftpclient::cmdToServer(controlSock, "FEAT\r\n", {211}, recvMsg);
+        if (ret != CmdToServerRet::SUCCEEDED &&
+            ret != CmdToServerRet::FAILED_WITH_MSG)
+            return ret;
+        cache.recordFeat(controlSock, recvMsg);
+        caps = cache.get(controlSock);
+        return caps.isFeatKnown ? CmdToServerRet::SUCCEEDED
+                                : CmdToServerRet::RECV_FAILED;
+    }
+} // namespace
+
+namespace ftpclient
+{
+
+    ConnectToServerRes connectToServer(SOCKET &sock,
+                                       const std::string &hostname,
+                                       const std::string &port, int sendTimeout,
+                                       int recvTimeout,
+                                       const utils::SocketProfile &profile)
+    {
+        sock = INVALID_SOCKET;
+        //初始化套接字库，整个进程只做一次
+        if (!utils::initSockets())
+            return ConnectToServerRes::WSAStartup_FAILED;
+
+        //数字地址不经过解析器，主机名的解析结果会缓存一段时间
+        utils::Resolver::Addresses addresses;
+        if (!utils::Resolver::instance().resolve(hostname, port, addresses))
+            return ConnectToServerRes::getaddrinfo_FAILED;
+
+        //各地址的连接在 Reactor 上赛跑，这里只等结果
+        using Result = std::pair<ConnectToServerRes, SOCKET>;
+        auto promise = std::make_shared<std::promise<Result>>();
+        std::future<Result> future = promise->get_future();
+        ConnectRace::start(addresses, CONNECT_TIMEOUT, sendTimeout, recvTimeout,
+                           profile,
+                           [promise](ConnectToServerRes res, SOCKET connected) {
+                               promise->set_value(Result(res, connected));
+                           });
+        Result res = future.get();
+        sock = res.second;
+        return res.first;
+    }
+
+    void asyncConnectToServer(
+        const std::string &hostname, int port, int timeout, int sendTimeout,
+        int recvTimeout, const utils::SocketProfile &profile,
+        std::function<void(ConnectToServerRes, SOCKET)> done)
+    {
+        if (!utils::initSockets())
+        {
+            done(ConnectToServerRes::WSAStartup_FAILED, INVALID_SOCKET);
+            return;
         }
-        return hasMsg ? RecvMultRes::SUCCEEDED : RecvMultRes::FAILED;
+        //主机名在解析线程中解析，不阻塞 Reactor 线程
+        utils::Resolver::instance().asyncResolve(
+            hostname, std::to_string(port),
+            [timeout, sendTimeout, recvTimeout, profile,
+             done](bool isResolved, utils::Resolver::Addresses addresses) {
+                if (!isResolved)
+                    done(ConnectToServerRes::getaddrinfo_FAILED,
+                         INVALID_SOCKET);
+                else
+                    ConnectRace::start(addresses, timeout, sendTimeout,
+                                       recvTimeout, profile, done);
+            });
+    }
+
+    RecvMultRes recvMultipleMsg(SOCKET controlSock,
+                                int expectedCode, std::string &msg)
+    {
+        //一条回复可能有多行，收到最后一行就返回
+        int iResult = utils::recvFtpReply(controlSock, msg);
+        if (iResult <= 0)
+            return RecvMultRes::FAILED;
+        //检查返回码
+        if (parseReplyCode(msg) != expectedCode)
+            return RecvMultRes::FAILED_WITH_MSG;
+        return RecvMultRes::SUCCEEDED;
     }
 
     RecvMultRes recvWelcomMsg(SOCKET controlSock, std::string &msg)
     {
-        return recvMultipleMsg(controlSock, std::regex(R"(^220[-\s]+)"), msg);
+        return recvMultipleMsg(controlSock, 220, msg);
     }
 
     RecvMultRes recvLoginSucceededMsg(SOCKET controlSock, std::string &msg)
     {
-        return recvMultipleMsg(controlSock, std::regex(R"(^230[-\s])"), msg);
+        return recvMultipleMsg(controlSock, 230, msg);
+    }
+
+    RecvMultRes recvAborMsg(SOCKET controlSock, std::string &msg)
+    {
+        std::string reply;
+        msg.clear();
+        while (true)
+        {
+            int iResult = utils::recvFtpReply(controlSock, reply);
+            if (iResult <= 0)
+                return msg.empty() ? RecvMultRes::FAILED
+                                   : RecvMultRes::SUCCEEDED;
+            msg += reply;
+            // 426/451 之后还有一条 225/226
+            if (reply[0] != '4')
+                return RecvMultRes::SUCCEEDED;
+        }
+    }
+
+    RecvMultRes recvTransferCompleteMsg(SOCKET controlSock, std::string &msg)
+    {
+        int iResult = utils::recvFtpReply(controlSock, msg);
+        if (iResult <= 0)
+            return RecvMultRes::FAILED;
+        // 226 Successfully transferred "filename"
+        if (!replyCodeIn(msg, {226, 250}))
+            return RecvMultRes::FAILED_WITH_MSG;
+        return RecvMultRes::SUCCEEDED;
     }
 
     CmdToServerRet cmdToServer(SOCKET controlSock, const std::string &sendCmd,
-                               const std::regex &matchRegex,
+                               std::initializer_list<int> expectedCodes,
                                std::string &recvMsg)
     {
         int iResult;
         //向服务器发送命令
-        iResult = send(controlSock, sendCmd.c_str(), sendCmd.length(), 0);
+        iResult = send(controlSock, sendCmd.c_str(), sendCmd.length(),
+                       utils::SEND_FLAGS);
         if (iResult == SOCKET_ERROR)
             return CmdToServerRet::SEND_FAILED;
         //接收服务器响应码和信息
-        iResult = utils::recvFtpMsg(controlSock, recvMsg);
+        iResult = utils::recvFtpReply(controlSock, recvMsg);
         if (iResult <= 0)
             return CmdToServerRet::RECV_FAILED;
         //检查响应码和信息是否符合要求
-        if (!std::regex_search(recvMsg, matchRegex))
+        if (!replyCodeIn(recvMsg, expectedCodes))
             return CmdToServerRet::FAILED_WITH_MSG;
         return CmdToServerRet::SUCCEEDED;
     }
 
+    void asyncRecvFtpReply(SOCKET controlSock, int timeout,
+                           std::function<void(int, std::string)> done)
+    {
+        std::string reply;
+        //上次 recv() 可能已经收到了完整的回复
+        if (utils::takeFtpReply(controlSock, reply))
+        {
+            int len = int(reply.length());
+            done(len, std::move(reply));
+            return;
+        }
+        auto onReadable = [controlSock, timeout,
+                           done](utils::Reactor::WaitRes res) {
+            if (res != utils::Reactor::WaitRes::READY)
+            {
+                done(-1, std::string());
+                return;
+            }
+            // socket 已可读，recv() 不会阻塞
+            int iResult = utils::fillFtpMsgBuffer(controlSock);
+            if (iResult <= 0)
+                done(iResult, std::string());
+            else //可能还没收全，继续等
+                asyncRecvFtpReply(controlSock, timeout, done);
+        };
+        if (!utils::Reactor::instance().watch(controlSock,
+                                              utils::Reactor::READABLE,
+                                              timeout, onReadable))
+            done(-1, std::string());
+    }
+
+    void asyncCmdToServer(SOCKET controlSock, const std::string &sendCmd,
+                          std::vector<int> expectedCodes, int timeout,
+                          std::function<void(CmdToServerRet, std::string)> done)
+    {
+        int iResult = send(controlSock, sendCmd.c_str(), sendCmd.length(),
+                           utils::SEND_FLAGS);
+        if (iResult == SOCKET_ERROR)
+        {
+            done(CmdToServerRet::SEND_FAILED, std::string());
+            return;
+        }
+        asyncRecvFtpReply(
+            controlSock, timeout,
+            [expectedCodes = std::move(expectedCodes),
+             done = std::move(done)](int iResult, std::string recvMsg) {
+                if (iResult <= 0)
+                    done(CmdToServerRet::RECV_FAILED, std::move(recvMsg));
+                else if (std::find(expectedCodes.begin(), expectedCodes.end(),
+                                   parseReplyCode(recvMsg)) ==
+                         expectedCodes.end())
+                    done(CmdToServerRet::FAILED_WITH_MSG, std::move(recvMsg));
+                else
+                    done(CmdToServerRet::SUCCEEDED, std::move(recvMsg));
+            });
+    }
+
+    void asyncEnterPassiveMode(
+        SOCKET controlSock, int timeout,
+        std::function<void(CmdToServerRet, std::string, int, std::string)>
+            done)
+    {
+        //之前的连接已经试出该用哪个命令，不再多一次来回
+        ServerCapabilities caps = CapabilityCache::instance().get(controlSock);
+        if (isEpsvFirst(controlSock, caps))
+            asyncEpsv(controlSock, timeout, caps.pasv != Support::NO,
+                      std::move(done));
+        else
+            asyncPasv(controlSock, timeout, caps.epsv != Support::NO,
+                      std::move(done));
+    }
+
+    void asyncRequestCrc32(
+        SOCKET controlSock, RemoteChecksum method,
+        const std::string &remoteFilepath, int timeout,
+        std::function<void(CmdToServerRet, std::uint32_t, std::string)> done)
+    {
+        auto onReply = [controlSock, method, done](CmdToServerRet ret,
+                                                   std::string recvMsg) {
+            recordCmdReply(controlSock,
+                           method == RemoteChecksum::XCRC
+                               ? &ServerCapabilities::xcrc
+                               : &ServerCapabilities::hash,
+                           ret, recvMsg);
+            std::uint32_t crc = 0;
+            if (ret == CmdToServerRet::SUCCEEDED &&
+                !parseCrc32Reply(recvMsg, crc))
+                ret = CmdToServerRet::FAILED_WITH_MSG;
+            done(ret, crc, ret == CmdToServerRet::FAILED_WITH_MSG
+                               ? std::move(recvMsg)
+                               : std::string());
+        };
+        //正常为"250 1A2B3C4D"
+        if (method == RemoteChecksum::XCRC)
+        {
+            asyncCmdToServer(controlSock, "XCRC " + remoteFilepath + "\r\n",
+                             {250}, CHECKSUM_TIMEOUT, onReply);
+            return;
+        }
+        //先选择算法，正常为"200 CRC32"，再请求"213 CRC32 0-size crc path"
+        std::string hashCmd = "HASH " + remoteFilepath + "\r\n";
+        asyncCmdToServer(
+            controlSock, "OPTS HASH CRC32\r\n", {200}, timeout,
+            [controlSock, hashCmd, done, onReply](CmdToServerRet ret,
+                                                  std::string recvMsg) {
+                if (ret != CmdToServerRet::SUCCEEDED)
+                    done(ret, 0,
+                         ret == CmdToServerRet::FAILED_WITH_MSG
+                             ? std::move(recvMsg)
+                             : std::string());
+                else
+                    asyncCmdToServer(controlSock, hashCmd, {213},
+                                     CHECKSUM_TIMEOUT, onReply);
+            });
+    }
+
+    void asyncVerifyCrc32(
+        SOCKET controlSock, const std::string &remoteFilepath,
+        std::uint32_t localCrc, int timeout,
+        std::function<void(VerifyChecksumRes, std::uint32_t)> done)
+    {
+        auto onCrc = [localCrc, done](CmdToServerRet ret, std::uint32_t crc,
+                                      std::string) {
+            if (ret == CmdToServerRet::SUCCEEDED)
+                done(crc == localCrc ? VerifyChecksumRes::MATCHED
+                                     : VerifyChecksumRes::MISMATCHED,
+                     crc);
+            //服务器拒绝（如"550 Cannot compute"）不代表文件有问题
+            else if (ret == CmdToServerRet::FAILED_WITH_MSG)
+                done(VerifyChecksumRes::UNSUPPORTED, 0);
+            else
+                done(VerifyChecksumRes::FAILED, 0);
+        };
+        asyncFeat(controlSock, timeout,
+                  [controlSock, remoteFilepath, timeout, done,
+                   onCrc](CmdToServerRet ret, ServerCapabilities caps) {
+                      if (ret != CmdToServerRet::SUCCEEDED)
+                      {
+                          done(VerifyChecksumRes::FAILED, 0);
+                          return;
+                      }
+                      RemoteChecksum method = caps.checksumMethod();
+                      if (method == RemoteChecksum::NONE)
+                          done(VerifyChecksumRes::UNSUPPORTED, 0);
+                      else
+                          asyncRequestCrc32(controlSock, method,
+                                            remoteFilepath, timeout, onCrc);
+                  });
+    }
+
+    void asyncEnterDeflateMode(
+        SOCKET controlSock, int level, int timeout,
+        std::function<void(CmdToServerRet, std::string)> done)
+    {
+        auto onMode = [controlSock, done](CmdToServerRet ret,
+                                          std::string recvMsg) {
+            recordCmdReply(controlSock, &ServerCapabilities::modeZ, ret,
+                           recvMsg);
+            done(ret, ret == CmdToServerRet::FAILED_WITH_MSG ? std::move(recvMsg)
+                                                             : std::string());
+        };
+        //与 enterDeflateMode() 相同：FEAT -> OPTS MODE Z LEVEL n -> MODE Z
+        auto onOpts = [controlSock, timeout, done,
+                       onMode](CmdToServerRet ret, std::string) {
+            if (ret != CmdToServerRet::SUCCEEDED &&
+                ret != CmdToServerRet::FAILED_WITH_MSG)
+                done(ret, std::string());
+            else
+                asyncCmdToServer(controlSock, "MODE Z\r\n", {200}, timeout,
+                                 onMode);
+        };
+        asyncFeat(controlSock, timeout,
+                  [controlSock, level, timeout, done,
+                   onOpts](CmdToServerRet ret, ServerCapabilities caps) {
+                      if (ret != CmdToServerRet::SUCCEEDED)
+                          done(ret, std::string());
+                      else if (caps.modeZ != Support::YES)
+                          done(CmdToServerRet::FAILED_WITH_MSG,
+                               std::move(caps.featReply));
+                      else
+                          asyncCmdToServer(controlSock,
+                                           "OPTS MODE Z LEVEL " +
+                                               std::to_string(level) + "\r\n",
+                                           {200}, timeout, onOpts);
+                  });
+    }
+
     CmdToServerRet loginToServer(SOCKET controlSock,
                                  const std::string &username,
                                  const std::string &password,
@@ -187,15 +908,14 @@ namespace ftpclient
         std::string recvMsg;
         //正常为"331 User name okay, need password."
         //返回码是否为331
-        std::regex userRegex(R"(331\s.*)");
-        auto ret = cmdToServer(controlSock, userCmd, userRegex, recvMsg);
+        auto ret = cmdToServer(controlSock, userCmd, {331}, recvMsg);
         if (ret == CmdToServerRet::SUCCEEDED)
         {
             // 命令 "PASS password\r\n"
             std::string passCmd = "PASS " + password + "\r\n";
             //向服务器发送命令
-            int iResult =
-                send(controlSock, passCmd.c_str(), passCmd.length(), 0);
+            int iResult = send(controlSock, passCmd.c_str(),
+                               passCmd.length(), utils::SEND_FLAGS);
             if (iResult == SOCKET_ERROR)
                 return CmdToServerRet::SEND_FAILED;
             //返回的消息可能有多条
@@ -228,10 +948,17 @@ namespace ftpclient
         std::string recvMsg;
         //正常为"227 Entering passive mode (h1,h2,h3,h4,p1,p2)"
         //检查返回码是否为227
-        std::regex e(R"(^227\s.*\(\d+,\d+,\d+,\d+,\d+,\d+\))");
-        auto ret = cmdToServer(controlSock, sendCmd, e, recvMsg);
+        auto ret = cmdToServer(controlSock, sendCmd, {227}, recvMsg);
+        int host[4];
+        if (ret == CmdToServerRet::SUCCEEDED &&
+            !parsePasvReply(recvMsg, host, port))
+            ret = CmdToServerRet::FAILED_WITH_MSG;
+        recordCmdReply(controlSock, &ServerCapabilities::pasv, ret,
+                           recvMsg);
         if (ret == CmdToServerRet::SUCCEEDED)
-            std::tie(hostname, port) = utils::getIPAndPortForPSAV(recvMsg);
+            hostname = std::to_string(host[0]) + "." + std::to_string(host[1]) +
+                       "." + std::to_string(host[2]) + "." +
+                       std::to_string(host[3]);
         else if (ret == CmdToServerRet::FAILED_WITH_MSG)
             errorMsg = std::move(recvMsg);
         return ret;
@@ -245,15 +972,46 @@ namespace ftpclient
         std::string recvMsg;
         //正常为"229 Entering Extended Passive Mode (|||port|)"
         //检查返回码是否为229
-        std::regex e(R"(^229\s.*\(\|\|\|\d+\|\))");
-        auto ret = cmdToServer(controlSock, sendCmd, e, recvMsg);
-        if (ret == CmdToServerRet::SUCCEEDED)
-            port = utils::getPortForEPSV(recvMsg);
-        else if (ret == CmdToServerRet::FAILED_WITH_MSG)
+        auto ret = cmdToServer(controlSock, sendCmd, {229}, recvMsg);
+        if (ret == CmdToServerRet::SUCCEEDED && !parseEpsvReply(recvMsg, port))
+            ret = CmdToServerRet::FAILED_WITH_MSG;
+        recordCmdReply(controlSock, &ServerCapabilities::epsv, ret,
+                           recvMsg);
+        if (ret == CmdToServerRet::FAILED_WITH_MSG)
             errorMsg = std::move(recvMsg);
         return ret;
     }
 
+    CmdToServerRet enterPassiveMode(SOCKET controlSock, std::string &hostname,
+                                    int &port, std::string &errorMsg)
+    {
+        //之前的连接已经试出该用哪个命令，不再多一次来回
+        ServerCapabilities caps = CapabilityCache::instance().get(controlSock);
+        bool isEpsv = isEpsvFirst(controlSock, caps);
+        auto sendCmd = [&](bool isEpsv) {
+            return isEpsv ? putServerIntoEpsvMode(controlSock, port, errorMsg)
+                          : putServerIntoPasvMode(controlSock, port, hostname,
+                                                  errorMsg);
+        };
+        auto ret = sendCmd(isEpsv);
+        //服务器不支持先发的命令，改用另一个
+        if (ret == CmdToServerRet::FAILED_WITH_MSG &&
+            isUnsupportedReply(errorMsg) &&
+            (isEpsv ? caps.pasv : caps.epsv) != Support::NO)
+        {
+            isEpsv = !isEpsv;
+            ret = sendCmd(isEpsv);
+        }
+        // EPSV模式下，数据连接的地址与控制连接的相同
+        if (ret == CmdToServerRet::SUCCEEDED && isEpsv)
+        {
+            hostname = utils::peerAddress(controlSock);
+            if (hostname.empty())
+                ret = CmdToServerRet::RECV_FAILED;
+        }
+        return ret;
+    }
+
     CmdToServerRet requestToUploadToServer(SOCKET controlSock, bool isAppend,
                                            const std::string &remoteFilepath,
                                            std::string &errorMsg)
@@ -264,8 +1022,7 @@ namespace ftpclient
         std::string recvMsg;
         //正常为"150 Opening data connection."
         //检查返回码是否为150或125
-        std::regex e(R"(^(150|125)\s+)");
-        auto ret = cmdToServer(controlSock, sendCmd, e, recvMsg);
+        auto ret = cmdToServer(controlSock, sendCmd, {150, 125}, recvMsg);
         if (ret == CmdToServerRet::FAILED_WITH_MSG)
             errorMsg = std::move(recvMsg);
         return ret;
@@ -279,8 +1036,7 @@ namespace ftpclient
         std::string recvMsg;
         //正常为"150 Opening data connection."
         //检查返回码是否为150或125
-        std::regex e(R"(^(150|125)\s+)");
-        auto ret = cmdToServer(controlSock, sendCmd, e, recvMsg);
+        auto ret = cmdToServer(controlSock, sendCmd, {150, 125}, recvMsg);
         if (ret == CmdToServerRet::FAILED_WITH_MSG)
             errorMsg = std::move(recvMsg);
         return ret;
@@ -292,13 +1048,28 @@ namespace ftpclient
         std::string sendCmd = "REST " + std::to_string(offset) + "\r\n";
         std::string recvMsg;
         //检查返回码是否为350
-        std::regex e(R"(^350\s+)");
-        auto ret = cmdToServer(controlSock, sendCmd, e, recvMsg);
+        auto ret = cmdToServer(controlSock, sendCmd, {350}, recvMsg);
+        recordCmdReply(controlSock, &ServerCapabilities::restStream, ret,
+                       recvMsg);
         if (ret == CmdToServerRet::FAILED_WITH_MSG)
             errorMsg = std::move(recvMsg);
         return ret;
     }
 
+    void asyncRequestRest(SOCKET controlSock, long long offset, int timeout,
+                          std::function<void(CmdToServerRet, std::string)> done)
+    {
+        asyncCmdToServer(
+            controlSock, "REST " + std::to_string(offset) + "\r\n", {350},
+            timeout,
+            [controlSock, done = std::move(done)](CmdToServerRet ret,
+                                                  std::string recvMsg) {
+                recordCmdReply(controlSock, &ServerCapabilities::restStream,
+                               ret, recvMsg);
+                done(ret, std::move(recvMsg));
+            });
+    }
+
     CmdToServerRet getFilesizeOnServer(SOCKET controlSock,
                                        const std::string &filename,
                                        long long &filesize,
@@ -307,12 +1078,15 @@ namespace ftpclient
         //命令"SIZE filename\r\n"
         std::string sendCmd = "SIZE " + filename + "\r\n";
         //检查返回码是否为"213 size"
-        std::regex e(R"(^213\s+\d+)");
         std::string recvMsg;
-        auto ret = cmdToServer(controlSock, sendCmd, e, recvMsg);
-        if (ret == CmdToServerRet::SUCCEEDED)
-            filesize = utils::getSizeFromMsg(recvMsg);
-        else if (ret == CmdToServerRet::FAILED_WITH_MSG)
+        auto ret = cmdToServer(controlSock, sendCmd, {213}, recvMsg);
+        if (ret == CmdToServerRet::SUCCEEDED &&
+            !parseSizeReply(recvMsg, filesize))
+            ret = CmdToServerRet::FAILED_WITH_MSG;
+        //"550 No such file"之类的回复不说明 SIZE 不可用
+        recordCmdReply(controlSock, &ServerCapabilities::size, ret,
+                           recvMsg);
+        if (ret == CmdToServerRet::FAILED_WITH_MSG)
             errorMsg = std::move(recvMsg);
         return ret;
     }
@@ -325,11 +1099,14 @@ namespace ftpclient
         std::string recvMsg;
         //正常为 257 "dir" is current directory.
         //检查返回码是否为257
-        std::regex e(R"(^257\s+".+")");
-        auto ret = cmdToServer(controlSock, sendCmd, e, recvMsg);
+        auto ret = cmdToServer(controlSock, sendCmd, {257}, recvMsg);
         if (ret == CmdToServerRet::SUCCEEDED)
+        {
             dir = utils::getDirFromMsg(recvMsg);
-        else if (ret == CmdToServerRet::FAILED_WITH_MSG)
+            if (dir.empty())
+                ret = CmdToServerRet::FAILED_WITH_MSG;
+        }
+        if (ret == CmdToServerRet::FAILED_WITH_MSG)
             errorMsg = std::move(recvMsg);
         return ret;
     }
@@ -343,8 +1120,7 @@ namespace ftpclient
         std::string recvMsg;
         //正常为"250 CWD successful"
         //检查返回码是否为250
-        std::regex e(R"(^250\s+)");
-        auto ret = cmdToServer(controlSock, sendCmd, e, recvMsg);
+        auto ret = cmdToServer(controlSock, sendCmd, {250}, recvMsg);
         if (ret == CmdToServerRet::FAILED_WITH_MSG)
             errorMsg = std::move(recvMsg);
         return ret;
@@ -360,8 +1136,46 @@ namespace ftpclient
         std::string recvMsg;
         //正常为"200 Type set to mode"
         //检查返回码是否为200
-        std::regex e(R"(^200\s+)");
-        auto ret = cmdToServer(controlSock, sendCmd, e, recvMsg);
+        auto ret = cmdToServer(controlSock, sendCmd, {200}, recvMsg);
+        if (ret == CmdToServerRet::FAILED_WITH_MSG)
+            errorMsg = std::move(recvMsg);
+        return ret;
+    }
+
+    CmdToServerRet enterDeflateMode(SOCKET controlSock, int level,
+                                    std::string &errorMsg)
+    {
+        ServerCapabilities caps;
+        auto ret = getFeatures(controlSock, caps);
+        if (ret != CmdToServerRet::SUCCEEDED)
+            return ret;
+        if (caps.modeZ != Support::YES)
+        {
+            errorMsg = std::move(caps.featReply);
+            return CmdToServerRet::FAILED_WITH_MSG;
+        }
+        std::string recvMsg;
+        //正常为"200 MODE Z LEVEL set to n"，服务器拒绝时用它的默认级别
+        ret = cmdToServer(controlSock,
+                          "OPTS MODE Z LEVEL " + std::to_string(level) +
+                              "\r\n",
+                          {200}, recvMsg);
+        if (ret != CmdToServerRet::SUCCEEDED &&
+            ret != CmdToServerRet::FAILED_WITH_MSG)
+            return ret;
+        //正常为"200 Mode set to Z"
+        ret = cmdToServer(controlSock, "MODE Z\r\n", {200}, recvMsg);
+        recordCmdReply(controlSock, &ServerCapabilities::modeZ, ret, recvMsg);
+        if (ret == CmdToServerRet::FAILED_WITH_MSG)
+            errorMsg = std::move(recvMsg);
+        return ret;
+    }
+
+    CmdToServerRet enterStreamMode(SOCKET controlSock, std::string &errorMsg)
+    {
+        std::string recvMsg;
+        //正常为"200 Mode set to S"
+        auto ret = cmdToServer(controlSock, "MODE S\r\n", {200}, recvMsg);
         if (ret == CmdToServerRet::FAILED_WITH_MSG)
             errorMsg = std::move(recvMsg);
         return ret;
@@ -374,8 +1188,7 @@ namespace ftpclient
         std::string recvMsg;
         //正常为"200 OK"
         //检查返回码是否为200
-        std::regex e(R"(^200\s+)");
-        auto ret = cmdToServer(controlSock, sendCmd, e, recvMsg);
+        auto ret = cmdToServer(controlSock, sendCmd, {200}, recvMsg);
         if (ret == CmdToServerRet::FAILED_WITH_MSG)
             errorMsg = std::move(recvMsg);
         return ret;
@@ -390,8 +1203,7 @@ namespace ftpclient
         std::string recvMsg;
         //正常为"250 File deleted successfully"
         //检查返回码是否为250
-        std::regex e(R"(^250\s+)");
-        auto ret = cmdToServer(controlSock, sendCmd, e, recvMsg);
+        auto ret = cmdToServer(controlSock, sendCmd, {250}, recvMsg);
         if (ret == CmdToServerRet::FAILED_WITH_MSG)
             errorMsg = std::move(recvMsg);
         return ret;
@@ -406,8 +1218,7 @@ namespace ftpclient
         std::string recvMsg;
         //正常为 257 "dir" created successfully
         //检查返回码是否为257
-        std::regex e(R"(^257\s+)");
-        auto ret = cmdToServer(controlSock, sendCmd, e, recvMsg);
+        auto ret = cmdToServer(controlSock, sendCmd, {257}, recvMsg);
         if (ret == CmdToServerRet::FAILED_WITH_MSG)
             errorMsg = std::move(recvMsg);
         return ret;
@@ -422,8 +1233,7 @@ namespace ftpclient
         std::string recvMsg;
         //正常为"250 Directory deleted successfully"
         //检查返回码是否为250
-        std::regex e(R"(^250\s+)");
-        auto ret = cmdToServer(controlSock, sendCmd, e, recvMsg);
+        auto ret = cmdToServer(controlSock, sendCmd, {250}, recvMsg);
         if (ret == CmdToServerRet::FAILED_WITH_MSG)
             errorMsg = std::move(recvMsg);
         return ret;
@@ -438,15 +1248,13 @@ namespace ftpclient
         //命令"RNFR filename\r\n"
         std::string rnfrCmd = "RNFR " + oldName + "\r\n";
         //正常为"350 File exists, ready for destination name."
-        std::regex rnfrE(R"(^350\s+)");
-        auto ret = cmdToServer(controlSock, rnfrCmd, rnfrE, recvMsg);
+        auto ret = cmdToServer(controlSock, rnfrCmd, {350}, recvMsg);
         if (ret == CmdToServerRet::SUCCEEDED)
         {
             //命令"RNTO filename\r\n"
             std::string rntoCmd = "RNTO " + newName + "\r\n";
             //正常为"250 file renamed successfully"
-            std::regex rntoE(R"(^250\s+)");
-            ret = cmdToServer(controlSock, rntoCmd, rntoE, errorMsg);
+            ret = cmdToServer(controlSock, rntoCmd, {250}, errorMsg);
             if (ret == CmdToServerRet::FAILED_WITH_MSG)
                 errorMsg = std::move(recvMsg);
             return ret;
@@ -469,68 +1277,378 @@ namespace ftpclient
         std::string recvMsg;
         //正常为 150 Opening data channel for directory listing of "dir"
         //检查返回码是否为150或125
-        std::regex e(R"(^(150|125)\s+)");
-        auto ret = cmdToServer(controlSock, sendCmd, e, recvMsg);
+        auto ret = cmdToServer(controlSock, sendCmd, {150, 125}, recvMsg);
         if (ret == CmdToServerRet::FAILED_WITH_MSG)
             errorMsg = std::move(recvMsg);
         return ret;
     }
 
+    int clampTransferBufferSize(int bufferSize)
+    {
+        if (bufferSize < MIN_TRANSFER_BUFFER_SIZE)
+            return MIN_TRANSFER_BUFFER_SIZE;
+        if (bufferSize > MAX_TRANSFER_BUFFER_SIZE)
+            return MAX_TRANSFER_BUFFER_SIZE;
+        return bufferSize;
+    }
+
     UploadFileDataRes uploadFileDataToServer(SOCKET dataSock,
-                                             std::ifstream &ifs, int &percent)
+                                             std::ifstream &ifs,
+                                             utils::TransferProgress &progress,
+                                             const utils::Throttle &throttle,
+                                             utils::Crc32 *checksum,
+                                             int bufferSize, int pipelineDepth)
     {
         if (!ifs.is_open())
             return UploadFileDataRes::READ_FILE_ERROR;
-        long long filesize = utils::getFilesize(ifs);
-        long long totalSend = ifs.tellg(); //已发送的字节总数
-        const int sendBufLen = 1024;
-        unique_ptr<char[]> sendBuffer(new char[sendBufLen]);
-        int iResult;
+        //从缓冲区池借若干块缓冲区，无需清零
+        ReadAheadRing ring(pipelineDepth, clampTransferBufferSize(bufferSize));
+        if (ring.isAllocFailed())
+            return UploadFileDataRes::READ_FILE_ERROR;
+
+        //读文件在另一个线程中进行，与 send() 重叠
+        std::thread reader(
+            [&ring, &ifs, checksum]() { ring.readLoop(ifs, checksum); });
+        ScopeGuard guardJoinReader([&ring, &reader]() {
+            ring.cancel();
+            reader.join();
+        });
+
         //开始上传文件
-        while (!ifs.eof())
+        while (ReadAheadRing::Block *block = ring.front())
         {
-            ifs.read(sendBuffer.get(), sendBufLen); //客户端读文件，读取一块
-            int readLen = int(ifs.gcount());        //刚刚读取的字节数
-            iResult = send(dataSock, sendBuffer.get(), readLen, 0);
-            if (iResult == SOCKET_ERROR)
+            //限速时把一块拆小发送，每次等待都不会太久
+            const char *data = block->buffer.data();
+            int left = block->len;
+            while (left > 0)
+            {
+                int len = int(throttle.chunkSize(left));
+                if (!sendAll(dataSock, data, len))
+                    return UploadFileDataRes::SEND_FAILED;
+                data += len;
+                left -= len;
+                progress.add(len);
+                throttle.consume(len);
+            }
+            ring.pop();
+        }
+        if (ring.hasReadError())
+            return UploadFileDataRes::READ_FILE_ERROR;
+
+        return UploadFileDataRes::SUCCEEDED;
+    }
+
+    UploadFileDataRes uploadFileDataDeflate(SOCKET dataSock, std::ifstream &ifs,
+                                            utils::TransferProgress &progress,
+                                            const utils::Throttle &throttle,
+                                            utils::Crc32 *checksum, int level,
+                                            int bufferSize, int pipelineDepth)
+    {
+        if (!ifs.is_open())
+            return UploadFileDataRes::READ_FILE_ERROR;
+        utils::Deflater deflater(level);
+        ReadAheadRing ring(pipelineDepth, clampTransferBufferSize(bufferSize));
+        if (deflater.isInitFailed() || ring.isAllocFailed())
+            return UploadFileDataRes::READ_FILE_ERROR;
+
+        //读文件在另一个线程中进行，与压缩、send() 重叠
+        std::thread reader(
+            [&ring, &ifs, checksum]() { ring.readLoop(ifs, checksum); });
+        ScopeGuard guardJoinReader([&ring, &reader]() {
+            ring.cancel();
+            reader.join();
+        });
+
+        //压缩数据按限速拆小发送
+        auto sendCompressed = [dataSock, &throttle](const char *data,
+                                                    std::size_t size) {
+            int left = int(size);
+            while (left > 0)
+            {
+                int len = int(throttle.chunkSize(left));
+                if (!sendAll(dataSock, data, len))
+                    return false;
+                data += len;
+                left -= len;
+                throttle.consume(len);
+            }
+            return true;
+        };
+        while (ReadAheadRing::Block *block = ring.front())
+        {
+            if (!deflater.compress(block->buffer.data(),
+                                   std::size_t(block->len), false,
+                                   sendCompressed))
                 return UploadFileDataRes::SEND_FAILED;
-            else
+            progress.add(block->len);
+            ring.pop();
+        }
+        if (ring.hasReadError())
+            return UploadFileDataRes::READ_FILE_ERROR;
+        //写出压缩流的结尾，服务器据此知道数据已完整
+        if (!deflater.compress(nullptr, 0, true, sendCompressed))
+            return UploadFileDataRes::SEND_FAILED;
+
+        return UploadFileDataRes::SUCCEEDED;
+    }
+
+    UploadFileDataRes uploadFileDataQueued(SOCKET dataSock,
+                                           const std::string &localFilepath,
+                                           long long offset,
+                                           utils::TransferProgress &progress,
+                                           const utils::Throttle &throttle,
+                                           utils::Crc32 *checksum,
+                                           int bufferSize, int ioDepth)
+    {
+        utils::LocalFile file;
+        if (!file.openForRead(localFilepath))
+            return UploadFileDataRes::READ_FILE_ERROR;
+        utils::SequentialReader reader(
+            file, offset, std::size_t(clampTransferBufferSize(bufferSize)),
+            ioDepth);
+        if (!reader.isQueued())
+            return UploadFileDataRes::DISK_QUEUE_UNSUPPORTED;
+
+        while (true)
+        {
+            //取下一块时，刚发送完的那块开始读后面的数据
+            const char *data;
+            std::size_t size;
+            if (!reader.next(data, size))
+                return UploadFileDataRes::READ_FILE_ERROR;
+            if (size == 0)
+                break;
+            if (checksum != nullptr)
+                checksum->update(data, size);
+            int left = int(size);
+            while (left > 0)
             {
-                totalSend += readLen;
-                percent = int(totalSend * 100 / filesize);
+                int len = int(throttle.chunkSize(left));
+                if (!sendAll(dataSock, data, len))
+                    return UploadFileDataRes::SEND_FAILED;
+                data += len;
+                left -= len;
+                progress.add(len);
+                throttle.consume(len);
             }
         }
+        return UploadFileDataRes::SUCCEEDED;
+    }
 
+    UploadFileDataRes uploadFileDataZeroCopy(SOCKET dataSock,
+                                             const std::string &localFilepath,
+                                             long long offset,
+                                             utils::TransferProgress &progress,
+                                             const utils::Throttle &throttle)
+    {
+#if defined(_WIN32) || defined(__linux__)
+        utils::LocalFile file;
+        if (!file.openForRead(localFilepath) || !file.isRegularFile())
+            return UploadFileDataRes::ZERO_COPY_UNSUPPORTED;
+        long long filesize = file.size();
+        if (filesize < 0)
+            return UploadFileDataRes::ZERO_COPY_UNSUPPORTED;
+        long long totalSend = offset; //已发送的字节总数
+        //分块发送，每块结束后更新一次进度
+        while (totalSend < filesize)
+        {
+            long long chunk = throttle.chunkSize(std::min<long long>(
+                filesize - totalSend, ZERO_COPY_CHUNK_SIZE));
+#ifdef _WIN32
+            LARGE_INTEGER pos;
+            pos.QuadPart = totalSend;
+            if (!SetFilePointerEx(file.nativeHandle(), pos, nullptr,
+                                  FILE_BEGIN))
+                return UploadFileDataRes::READ_FILE_ERROR;
+            //从文件指针处发送 chunk 个字节，内核直接从文件缓存发送
+            if (!TransmitFile(dataSock, file.nativeHandle(), DWORD(chunk), 0,
+                              nullptr, nullptr, 0))
+                return UploadFileDataRes::SEND_FAILED;
+            totalSend += chunk;
+            progress.add(chunk);
+            throttle.consume(chunk);
+#else
+            off_t pos = off_t(totalSend);
+            ssize_t sent =
+                sendfile(dataSock, file.nativeHandle(), &pos, size_t(chunk));
+            if (sent < 0)
+            {
+                if (errno == EINTR)
+                    continue;
+                //文件系统不支持 sendfile，且尚未发送任何数据，可以退回普通方式
+                if ((errno == EINVAL || errno == ENOSYS) && totalSend == offset)
+                    return UploadFileDataRes::ZERO_COPY_UNSUPPORTED;
+                return UploadFileDataRes::SEND_FAILED;
+            }
+            if (sent == 0) //文件在上传过程中变短了
+                return UploadFileDataRes::READ_FILE_ERROR;
+            totalSend += sent;
+            progress.add(sent);
+            throttle.consume(sent);
+#endif
+        }
         return UploadFileDataRes::SUCCEEDED;
+#else
+        (void)dataSock;
+        (void)localFilepath;
+        (void)offset;
+        (void)progress;
+        (void)throttle;
+        return UploadFileDataRes::ZERO_COPY_UNSUPPORTED;
+#endif
     }
 
-    DownloadFileDataRes downloadFileDataFromServer(SOCKET dataSock,
-                                                   std::ofstream &ofs,
-                                                   long long remoteFilesize,
-                                                   int &percent)
+    DownloadFileDataRes
+    downloadFileDataFromServer(SOCKET dataSock, utils::SequentialWriter &writer,
+                               utils::TransferProgress &progress,
+                               const utils::Throttle &throttle,
+                               utils::Crc32 *checksum)
     {
-        if (!ofs.is_open())
+        if (writer.isAllocFailed())
             return DownloadFileDataRes::READ_FILE_ERROR;
-        long long totalRecv = ofs.tellp(); //已接收的字节总数
-        const int recvBufLen = 1024;
-        unique_ptr<char[]> recvBuffer(new char[recvBufLen]);
-        int iResult;
         while (true)
         {
-            memset(recvBuffer.get(), 0, recvBufLen);
-            iResult = recv(dataSock, recvBuffer.get(), recvBufLen, 0);
-            if (iResult > 0)
+            //限速时少收一些，接收窗口随之变小，对方自然放慢
+            char *space = writer.space();
+            int iResult =
+                recv(dataSock, space,
+                     int(throttle.chunkSize((long long)writer.spaceSize())), 0);
+            if (iResult == 0)
+                break;
+            else if (iResult < 0)
+            {
+                //已收到的部分照常写入，续传时不必重新下载
+                writer.flush();
+                return DownloadFileDataRes::RECV_FAILED;
+            }
+            if (checksum != nullptr)
+                checksum->update(space, std::size_t(iResult));
+            if (!writer.commit(std::size_t(iResult)))
+                return DownloadFileDataRes::READ_FILE_ERROR;
+            progress.add(iResult);
+            throttle.consume(iResult);
+        }
+        if (!writer.flush())
+            return DownloadFileDataRes::READ_FILE_ERROR;
+        return DownloadFileDataRes::SUCCEEDED;
+    }
+
+    DownloadFileDataRes
+    downloadFileDataInflate(SOCKET dataSock, utils::SequentialWriter &writer,
+                            utils::TransferProgress &progress,
+                            const utils::Throttle &throttle,
+                            utils::Crc32 *checksum, int bufferSize)
+    {
+        utils::Inflater inflater;
+        auto recvBuffer = utils::BufferPool::instance().acquire(
+            clampTransferBufferSize(bufferSize));
+        if (writer.isAllocFailed() || inflater.isInitFailed() ||
+            recvBuffer.data() == nullptr)
+            return DownloadFileDataRes::READ_FILE_ERROR;
+        const int recvBufLen = int(recvBuffer.size());
+
+        //解压出的数据写入文件；写文件失败与数据损坏都会让解压返回 FAILED
+        bool isWriteFailed = false;
+        auto writeFile = [&](const char *data, std::size_t len) {
+            if (!writer.write(data, len))
+            {
+                isWriteFailed = true;
+                return false;
+            }
+            if (checksum != nullptr)
+                checksum->update(data, len);
+            progress.add((long long)len);
+            return true;
+        };
+        auto inflateRes = utils::Inflater::Res::NEED_MORE;
+        while (true)
+        {
+            int iResult = recv(dataSock, recvBuffer.data(),
+                               int(throttle.chunkSize(recvBufLen)), 0);
+            if (iResult == 0)
+                break;
+            else if (iResult < 0)
             {
-                totalRecv += iResult;
-                ofs.write(recvBuffer.get(), iResult);
-                percent = int(totalRecv * 100 / remoteFilesize);
+                writer.flush();
+                return DownloadFileDataRes::RECV_FAILED;
             }
-            else if (iResult == 0)
+            throttle.consume(iResult);
+            inflateRes = inflater.decompress(
+                recvBuffer.data(), std::size_t(iResult), writeFile);
+            if (inflateRes == utils::Inflater::Res::FAILED)
+                return isWriteFailed ? DownloadFileDataRes::READ_FILE_ERROR
+                                     : DownloadFileDataRes::RECV_FAILED;
+        }
+        if (!writer.flush())
+            return DownloadFileDataRes::READ_FILE_ERROR;
+        //连接断开时压缩流还没结束，文件不完整
+        if (inflateRes != utils::Inflater::Res::STREAM_END)
+            return DownloadFileDataRes::RECV_FAILED;
+        return DownloadFileDataRes::SUCCEEDED;
+    }
+
+    DownloadFileDataRes downloadFileDataZeroCopy(
+        SOCKET dataSock, const std::string &localFilepath, long long offset,
+        utils::TransferProgress &progress, const utils::Throttle &throttle)
+    {
+#ifdef __linux__
+        utils::LocalFile file;
+        if (!file.openForWrite(localFilepath))
+            return DownloadFileDataRes::READ_FILE_ERROR;
+        // socket -> 管道 -> 文件，数据只在内核中移动
+        int pipeFds[2];
+        if (pipe2(pipeFds, O_CLOEXEC) != 0)
+            return DownloadFileDataRes::ZERO_COPY_UNSUPPORTED;
+        ScopeGuard guardClosePipe([&pipeFds]() {
+            close(pipeFds[0]);
+            close(pipeFds[1]);
+        });
+        //调大管道容量，减少 splice() 次数，失败也无妨
+        fcntl(pipeFds[1], F_SETPIPE_SZ, ZERO_COPY_PIPE_SIZE);
+
+        loff_t writePos = offset;
+        long long totalRecv = offset; //已接收的字节总数
+        while (true)
+        {
+            ssize_t inPipe =
+                splice(dataSock, nullptr, pipeFds[1], nullptr,
+                       size_t(throttle.chunkSize(ZERO_COPY_PIPE_SIZE)),
+                       SPLICE_F_MOVE);
+            if (inPipe == 0) //对方关闭连接
                 break;
-            else
+            if (inPipe < 0)
+            {
+                if (errno == EINTR)
+                    continue;
+                if (errno == EINVAL && totalRecv == offset)
+                    return DownloadFileDataRes::ZERO_COPY_UNSUPPORTED;
                 return DownloadFileDataRes::RECV_FAILED;
+            }
+            throttle.consume(inPipe);
+            //把管道中的数据全部写入文件
+            while (inPipe > 0)
+            {
+                ssize_t written =
+                    splice(pipeFds[0], nullptr, file.nativeHandle(), &writePos,
+                           size_t(inPipe), SPLICE_F_MOVE);
+                if (written < 0 && errno == EINTR)
+                    continue;
+                if (written <= 0)
+                    return DownloadFileDataRes::READ_FILE_ERROR;
+                inPipe -= written;
+                totalRecv += written;
+                progress.add(written);
+            }
         }
         return DownloadFileDataRes::SUCCEEDED;
+#else
+        (void)dataSock;
+        (void)localFilepath;
+        (void)offset;
+        (void)progress;
+        (void)throttle;
+        return DownloadFileDataRes::ZERO_COPY_UNSUPPORTED;
+#endif
     }
 
 } // namespace ftpclient
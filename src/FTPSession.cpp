@@ -2,8 +2,9 @@
 #include "../include/FTPFunction.h"
 #include "../include/ListTask.h"
 #include "../include/MyUtils.h"
+#include "../include/Reactor.h"
 #include "../include/RunAsyncAwait.h"
-#include <QApplication>
+#include "../include/SessionPool.h"
 #include <QFuture>
 #include <QtConcurrent/QtConcurrent>
 #include <cstring>
@@ -11,8 +12,6 @@
 
 namespace ftpclient
 {
-    using LockGuard = std::lock_guard<std::mutex>;
-
     const int FTPSession::SOCKET_SEND_TIMEOUT;
     const int FTPSession::SOCKET_RECV_TIMEOUT;
     const int FTPSession::SEND_NOOP_TIME;
@@ -20,14 +19,16 @@ namespace ftpclient
     FTPSession::FTPSession(const std::string &hostname,
                            const std::string &username,
                            const std::string password, int port,
-                           bool autoKeepAlive)
+                           bool autoKeepAlive, bool pooled)
         : hostname(hostname),
           port(port),
           username(username),
           password(password),
           controlSock(INVALID_SOCKET),
           isConnected(false),
-          autoKeepAlive(autoKeepAlive)
+          autoKeepAlive(autoKeepAlive),
+          pooled(pooled),
+          sendNoopTimer(this)
     {
         this->initialize();
     }
@@ -57,25 +58,45 @@ namespace ftpclient
     {
         if (isConnected)
         {
-            utils::asyncAwait([this]() {
-                if (sockMutex.try_lock())
-                {
-                    std::string noopCmd = "NOOP\r\n";
-                    std::string recvMsg;
-                    send(controlSock, noopCmd.c_str(), noopCmd.length(), 0);
-                    //正常为"200 OK"
-                    //不校验返回码，只是把收到的消息吃掉
-                    utils::recvFtpMsg(controlSock, recvMsg);
-                    sockMutex.unlock();
-                }
-                else //此时别的线程正在发命令，因此无需用 NOOP 保活
-                    return;
-            });
+            //别的线程正在发命令时，无需用 NOOP 保活
+            if (sockMutex.try_lock())
+            {
+                //正常为"200 OK"
+                //不校验返回码，只是把收到的消息吃掉，也不必等待回复
+                asyncCmdToServer(controlSock, "NOOP\r\n", {200},
+                                 SOCKET_RECV_TIMEOUT,
+                                 [this](CmdToServerRet, std::string) {
+                                     sockMutex.unlock();
+                                 });
+            }
             sendNoopTimer.start(SEND_NOOP_TIME);
         }
     }
 
-    void FTPSession::connectAndLogin() { this->connect(); }
+    void FTPSession::connectAndLogin()
+    {
+        if (pooled)
+        {
+            SOCKET sock = utils::asyncAwait<SOCKET>([this]() {
+                return SessionPool::instance().acquire(hostname, port,
+                                                       username);
+            });
+            if (sock != INVALID_SOCKET)
+            {
+                {
+                    LockGuard guard(sockMutex);
+                    controlSock = sock;
+                    isConnected = true;
+                }
+                if (autoKeepAlive)
+                    sendNoopTimer.start(SEND_NOOP_TIME);
+                //池中的连接都已登录并切换为二进制模式
+                emit setTransferModeSucceeded(true);
+                return;
+            }
+        }
+        this->connect();
+    }
 
     void FTPSession::connect()
     {
@@ -180,13 +201,11 @@ namespace ftpclient
 
     void FTPSession::changeDir(const std::string &dir)
     {
-        runProcedure(
-            [this, &dir](std::string &msg) {
-                LockGuard guard(sockMutex);
-                return changeWorkingDirectory(controlSock, dir, msg);
-            },
-            &FTPSession::changeDirSucceeded,
-            &FTPSession::changeDirFailedWithMsg, &FTPSession::changeDirFailed);
+        //正常为"250 CWD successful"
+        runCommand("CWD " + dir + "\r\n", {250},
+                   &FTPSession::changeDirSucceeded,
+                   &FTPSession::changeDirFailedWithMsg,
+                   &FTPSession::changeDirFailed);
     }
 
     void FTPSession::setTransferMode(bool binaryMode)
@@ -214,36 +233,33 @@ namespace ftpclient
 
     void FTPSession::deleteFile(const std::string &filename)
     {
-        runProcedure(
-            [this, &filename](std::string &msg) {
-                LockGuard guard(sockMutex);
-                return deleteFileOnServer(controlSock, filename, msg);
-            },
-            &FTPSession::deleteFileSucceeded,
-            &FTPSession::deleteFileFailedWithMsg,
-            &FTPSession::deleteFileFailed);
+        //正常为"250 File deleted successfully"
+        //连续删除多个文件时，同一轮事件中的 DELE 由一个流水线发出
+        pipelineCommand("DELE " + filename + "\r\n", {250},
+                        [this](CmdToServerRet ret, std::string recvMsg) {
+                            this->emitProcedureResult(
+                                ret, std::move(recvMsg),
+                                &FTPSession::deleteFileSucceeded,
+                                &FTPSession::deleteFileFailedWithMsg,
+                                &FTPSession::deleteFileFailed);
+                        });
     }
 
     void FTPSession::makeDir(const std::string &dir)
     {
-        runProcedure(
-            [this, &dir](std::string &msg) {
-                LockGuard guard(sockMutex);
-                return makeDirectoryOnServer(controlSock, dir, msg);
-            },
-            &FTPSession::makeDirSucceeded, &FTPSession::makeDirFailedWithMsg,
-            &FTPSession::makeDirFailed);
+        //正常为 257 "dir" created successfully
+        runCommand("MKD " + dir + "\r\n", {257}, &FTPSession::makeDirSucceeded,
+                   &FTPSession::makeDirFailedWithMsg,
+                   &FTPSession::makeDirFailed);
     }
 
     void FTPSession::removeDir(const std::string &dir)
     {
-        runProcedure(
-            [this, &dir](std::string &msg) {
-                LockGuard guard(sockMutex);
-                return removeDirectoryOnServer(controlSock, dir, msg);
-            },
-            &FTPSession::removeDirSucceeded,
-            &FTPSession::removeDirFailedWithMsg, &FTPSession::removeDirFailed);
+        //正常为"250 Directory deleted successfully"
+        runCommand("RMD " + dir + "\r\n", {250},
+                   &FTPSession::removeDirSucceeded,
+                   &FTPSession::removeDirFailedWithMsg,
+                   &FTPSession::removeDirFailed);
     }
 
     void FTPSession::renameFile(const std::string &oldName,
@@ -259,6 +275,43 @@ namespace ftpclient
             &FTPSession::renameFileFailed);
     }
 
+    void FTPSession::pipelineCommand(
+        const std::string &cmd, std::vector<int> expectedCodes,
+        std::function<void(CmdToServerRet, std::string)> done)
+    {
+        //这一轮事件中的第一条命令，回到事件循环后统一发出
+        if (!pendingPipeline)
+        {
+            pendingPipeline =
+                CommandPipeline::create(controlSock, SOCKET_RECV_TIMEOUT);
+            QTimer::singleShot(0, this, [this]() { this->flushPipeline(); });
+        }
+        pendingPipeline->add(
+            cmd, std::move(expectedCodes),
+            [this, done](CmdToServerRet ret, std::string recvMsg) {
+                //回复在 Reactor 线程中收到，回到 GUI 线程再交给调用者
+                QMetaObject::invokeMethod(
+                    this,
+                    [done, ret, recvMsg = std::move(recvMsg)]() {
+                        done(ret, recvMsg);
+                    },
+                    Qt::QueuedConnection);
+            });
+    }
+
+    void FTPSession::flushPipeline()
+    {
+        std::shared_ptr<CommandPipeline> pipeline = std::move(pendingPipeline);
+        pendingPipeline.reset();
+        if (!pipeline || pipeline->empty())
+            return;
+        //控制连接正被别的操作占用时，到子线程中排队，不阻塞 GUI 线程
+        if (!sockMutex.try_lock())
+            utils::asyncAwait([this]() { sockMutex.lock(); });
+        //最后一条回复收到后就放开控制连接
+        pipeline->run([this]() { sockMutex.unlock(); });
+    }
+
     void FTPSession::listWorkingDir(bool isNameList)
     {
         std::string errorMsg;
@@ -266,7 +319,7 @@ namespace ftpclient
         auto res = utils::asyncAwait<ListTask::Res>(
             [this, isNameList, &errorMsg, &listStrings]() {
                 LockGuard guard(sockMutex);
-                ListTask task(*this, ".", isNameList);
+                ListTask task(*this, ".", isNameList, compressionLevel);
                 return task.getListStrings(listStrings, errorMsg);
             });
         if (res == ListTask::Res::SUCCEEDED)
@@ -281,7 +334,25 @@ namespace ftpclient
     {
         // 把控制连接关闭
         if (this->isConnected)
+        {
+            //结束 Reactor 上还在等待的命令，否则要等到超时
+            utils::Reactor::instance().cancel(controlSock);
+            utils::discardFtpMsgBuffer(controlSock);
             closesocket(controlSock);
+        }
+        isConnected = false;
+        controlSock = INVALID_SOCKET;
+    }
+
+    void FTPSession::releaseToPool()
+    {
+        if (this->isConnected)
+        {
+            sendNoopTimer.stop();
+            LockGuard guard(sockMutex);
+            SessionPool::instance().release(hostname, port, username,
+                                            controlSock);
+        }
         isConnected = false;
         controlSock = INVALID_SOCKET;
     }
@@ -294,6 +365,43 @@ namespace ftpclient
     {
         std::string errorMsg;
         auto res = utils::asyncAwait<CmdToServerRet>(func, errorMsg);
+        this->emitProcedureResult(res, std::move(errorMsg), succeededSignal,
+                                  failedWithMsgSignal, failedSignal);
+    }
+
+    void FTPSession::runCommand(
+        const std::string &cmd, std::vector<int> expectedCodes,
+        void (FTPSession::*succeededSignal)(),
+        void (FTPSession::*failedWithMsgSignal)(std::string),
+        void (FTPSession::*failedSignal)())
+    {
+        //控制连接正被别的操作占用时，到子线程中排队，不阻塞 GUI 线程
+        if (!sockMutex.try_lock())
+            utils::asyncAwait([this]() { sockMutex.lock(); });
+        using Result = std::pair<CmdToServerRet, std::string>;
+        auto res = utils::reactorAwait<Result>(
+            [this, &cmd, &expectedCodes](std::function<void(Result)> finish) {
+                asyncCmdToServer(controlSock, cmd, std::move(expectedCodes),
+                                 SOCKET_RECV_TIMEOUT,
+                                 [this, finish](CmdToServerRet ret,
+                                                std::string recvMsg) {
+                                     //收到回复就放开控制连接，
+                                     //不必等 GUI 线程回到这里
+                                     sockMutex.unlock();
+                                     finish({ret, std::move(recvMsg)});
+                                 });
+            });
+        this->emitProcedureResult(res.first, std::move(res.second),
+                                  succeededSignal, failedWithMsgSignal,
+                                  failedSignal);
+    }
+
+    void FTPSession::emitProcedureResult(
+        CmdToServerRet res, std::string errorMsg,
+        void (FTPSession::*succeededSignal)(),
+        void (FTPSession::*failedWithMsgSignal)(std::string),
+        void (FTPSession::*failedSignal)())
+    {
         if (res == CmdToServerRet::SUCCEEDED)
             emit(this->*succeededSignal)();
         else if (res == CmdToServerRet::FAILED_WITH_MSG)
@@ -0,0 +1,292 @@
+#include "../include/FtpReply.h"
+
+namespace
+{
+    bool isDigit(char c) { return c >= '0' && c <= '9'; }
+
+    /**
+     * @brief 从 pos 开始读取一个不超过 maxValue 的十进制数
+     * @author zhb
+     * @return 是否至少读到一位数字且没有溢出
+     */
+    bool readNumber(std::string_view text, std::string_view::size_type &pos,
+                    long long maxValue, long long &value)
+    {
+        std::string_view::size_type start = pos;
+        value = 0;
+        while (pos < text.size() && isDigit(text[pos]))
+        {
+            int digit = text[pos] - '0';
+            if (value > (maxValue - digit) / 10)
+                return false;
+            value = value * 10 + digit;
+            ++pos;
+        }
+        return pos > start;
+    }
+
+    bool readInt(std::string_view text, std::string_view::size_type &pos,
+                 int maxValue, int &value)
+    {
+        long long v;
+        if (!readNumber(text, pos, maxValue, v))
+            return false;
+        value = int(v);
+        return true;
+    }
+
+    void skipSpaces(std::string_view text, std::string_view::size_type &pos)
+    {
+        while (pos < text.size() && (text[pos] == ' ' || text[pos] == '\t'))
+            ++pos;
+    }
+
+    char toUpper(char c) { return c >= 'a' && c <= 'z' ? char(c - 32) : c; }
+
+    //忽略大小写比较
+    bool equalsIgnoreCase(std::string_view a, std::string_view b)
+    {
+        if (a.size() != b.size())
+            return false;
+        for (std::string_view::size_type i = 0; i < a.size(); ++i)
+            if (toUpper(a[i]) != toUpper(b[i]))
+                return false;
+        return true;
+    }
+
+    int hexValue(char c)
+    {
+        if (isDigit(c))
+            return c - '0';
+        c = toUpper(c);
+        return c >= 'A' && c <= 'F' ? c - 'A' + 10 : -1;
+    }
+
+    //读取 pos 开始、以空白或行尾结束的一个词
+    std::string_view readWord(std::string_view text,
+                              std::string_view::size_type &pos)
+    {
+        std::string_view::size_type start = pos;
+        while (pos < text.size() && text[pos] != ' ' && text[pos] != '\t' &&
+               text[pos] != '\r' && text[pos] != '\n')
+            ++pos;
+        return text.substr(start, pos - start);
+    }
+} // namespace
+
+namespace ftpclient
+{
+
+    int parseReplyCode(std::string_view line)
+    {
+        if (line.size() < 3 || !isDigit(line[0]) || !isDigit(line[1]) ||
+            !isDigit(line[2]))
+            return -1;
+        if (line.size() > 3 && line[3] != ' ' && line[3] != '-' &&
+            line[3] != '\r')
+            return -1;
+        return (line[0] - '0') * 100 + (line[1] - '0') * 10 + (line[2] - '0');
+    }
+
+    bool isMultiLineReplyStart(std::string_view line)
+    {
+        return parseReplyCode(line) >= 0 && line.size() > 3 && line[3] == '-';
+    }
+
+    bool isLastReplyLine(std::string_view line, int code)
+    {
+        return parseReplyCode(line) == code &&
+               (line.size() == 3 || line[3] != '-');
+    }
+
+    bool replyCodeIn(std::string_view reply, std::initializer_list<int> codes)
+    {
+        int code = parseReplyCode(reply);
+        if (code < 0)
+            return false;
+        for (int c : codes)
+            if (c == code)
+                return true;
+        return false;
+    }
+
+    bool parsePasvReply(std::string_view reply, int (&host)[4], int &port)
+    {
+        if (parseReplyCode(reply) != 227)
+            return false;
+        // 有的服务器不带括号，所以从回复码后面找第一个数字
+        std::string_view::size_type pos = reply.find('(', 4);
+        if (pos == std::string_view::npos)
+        {
+            pos = 4;
+            while (pos < reply.size() && !isDigit(reply[pos]))
+                ++pos;
+        }
+        else
+            ++pos;
+
+        int fields[6];
+        for (int i = 0; i < 6; ++i)
+        {
+            if (i > 0)
+            {
+                if (pos >= reply.size() || reply[pos] != ',')
+                    return false;
+                ++pos;
+            }
+            if (!readInt(reply, pos, 255, fields[i]))
+                return false;
+        }
+        for (int i = 0; i < 4; ++i)
+            host[i] = fields[i];
+        port = fields[4] * 256 + fields[5];
+        return true;
+    }
+
+    bool parseEpsvReply(std::string_view reply, int &port)
+    {
+        if (parseReplyCode(reply) != 229)
+            return false;
+        std::string_view::size_type pos = reply.find('(', 4);
+        if (pos == std::string_view::npos || pos + 4 >= reply.size())
+            return false;
+        // (<d><d><d>port<d>)
+        char delim = reply[pos + 1];
+        if (reply[pos + 2] != delim || reply[pos + 3] != delim)
+            return false;
+        pos += 4;
+        if (!readInt(reply, pos, 65535, port))
+            return false;
+        return pos + 1 < reply.size() && reply[pos] == delim &&
+               reply[pos + 1] == ')';
+    }
+
+    bool parseSizeReply(std::string_view reply, long long &size)
+    {
+        if (parseReplyCode(reply) != 213 || reply.size() < 4 ||
+            reply[3] != ' ')
+            return false;
+        std::string_view::size_type pos = 4;
+        skipSpaces(reply, pos);
+        //文件大小不超过 2^62，避免溢出
+        return readNumber(reply, pos, (1LL << 62), size);
+    }
+
+    bool hasFeature(std::string_view reply, std::string_view feature)
+    {
+        if (parseReplyCode(reply) != 211)
+            return false;
+        std::string_view::size_type lineStart = reply.find('\n');
+        while (lineStart != std::string_view::npos)
+        {
+            std::string_view::size_type pos = lineStart + 1;
+            lineStart = reply.find('\n', pos);
+            skipSpaces(reply, pos);
+            if (reply.size() - pos < feature.size() ||
+                !equalsIgnoreCase(reply.substr(pos, feature.size()), feature))
+                continue;
+            pos += feature.size();
+            if (pos == reply.size() || reply[pos] == ' ' ||
+                reply[pos] == '\t' || reply[pos] == '\r' ||
+                reply[pos] == '\n')
+                return true;
+        }
+        return false;
+    }
+
+    RemoteChecksum parseChecksumFeature(std::string_view reply)
+    {
+        if (parseReplyCode(reply) != 211)
+            return RemoteChecksum::NONE;
+        bool hasHashCrc32 = false;
+        //第一行和最后一行是"211-..."、"211 End"，特性在中间各行
+        std::string_view::size_type lineStart = reply.find('\n');
+        while (lineStart != std::string_view::npos)
+        {
+            std::string_view::size_type pos = lineStart + 1;
+            lineStart = reply.find('\n', pos);
+            skipSpaces(reply, pos);
+            std::string_view feature = readWord(reply, pos);
+            if (equalsIgnoreCase(feature, "XCRC"))
+                return RemoteChecksum::XCRC;
+            if (!equalsIgnoreCase(feature, "HASH"))
+                continue;
+            //"HASH SHA-1;SHA-256*;MD5;CRC32"，'*'标记当前选中的算法
+            skipSpaces(reply, pos);
+            std::string_view algos = readWord(reply, pos);
+            while (!algos.empty())
+            {
+                auto end = algos.find(';');
+                std::string_view algo = algos.substr(0, end);
+                if (!algo.empty() && algo.back() == '*')
+                    algo.remove_suffix(1);
+                if (equalsIgnoreCase(algo, "CRC32"))
+                    hasHashCrc32 = true;
+                algos.remove_prefix(end == std::string_view::npos ? algos.size()
+                                                                  : end + 1);
+            }
+        }
+        return hasHashCrc32 ? RemoteChecksum::HASH_CRC32 : RemoteChecksum::NONE;
+    }
+
+    bool parseCrc32Reply(std::string_view reply, std::uint32_t &crc)
+    {
+        int code = parseReplyCode(reply);
+        if ((code != 250 && code != 213) || reply.size() < 4 ||
+            reply[3] != ' ')
+            return false;
+        std::string_view::size_type pos = 4;
+        while (pos < reply.size() && reply[pos] != '\r' && reply[pos] != '\n')
+        {
+            skipSpaces(reply, pos);
+            std::string_view word = readWord(reply, pos);
+            if (word.size() != 8)
+                continue;
+            std::uint32_t value = 0;
+            bool isHex = true;
+            for (char c : word)
+            {
+                int digit = hexValue(c);
+                if (digit < 0)
+                {
+                    isHex = false;
+                    break;
+                }
+                value = value << 4 | std::uint32_t(digit);
+            }
+            if (isHex)
+            {
+                crc = value;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    bool parsePathReply(std::string_view reply, std::string_view &path)
+    {
+        if (parseReplyCode(reply) != 257)
+            return false;
+        std::string_view::size_type begin = reply.find('"', 4);
+        if (begin == std::string_view::npos)
+            return false;
+        ++begin;
+        //路径中的引号写作""
+        for (std::string_view::size_type pos = begin; pos < reply.size(); ++pos)
+        {
+            if (reply[pos] != '"')
+                continue;
+            if (pos + 1 < reply.size() && reply[pos + 1] == '"')
+                ++pos;
+            else
+            {
+                if (pos == begin)
+                    return false;
+                path = reply.substr(begin, pos - begin);
+                return true;
+            }
+        }
+        return false;
+    }
+
+} // namespace ftpclient
@@ -0,0 +1,268 @@
+#include "../include/IoUring.h"
+#ifdef __linux__
+#include <cerrno>
+#include <cstring>
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#endif
+
+namespace utils
+{
+
+#ifdef __linux__
+
+    //内核映射出来的两个环形队列
+    struct IoUring::Rings
+    {
+        int fd = -1;
+        void *sqRing = MAP_FAILED;
+        std::size_t sqRingSize = 0;
+        void *cqRing = MAP_FAILED;
+        std::size_t cqRingSize = 0;
+        io_uring_sqe *sqes = static_cast<io_uring_sqe *>(MAP_FAILED);
+        std::size_t sqesSize = 0;
+
+        unsigned *sqHead = nullptr;
+        unsigned *sqTail = nullptr;
+        unsigned sqMask = 0;
+        unsigned sqEntries = 0;
+        unsigned *sqArray = nullptr;
+        unsigned *cqHead = nullptr;
+        unsigned *cqTail = nullptr;
+        unsigned cqMask = 0;
+        io_uring_cqe *cqes = nullptr;
+
+        //已放入提交队列、还没交给内核的请求数
+        unsigned toSubmit = 0;
+        bool isBuffersRegistered = false;
+
+        ~Rings()
+        {
+            if (sqes != MAP_FAILED)
+                munmap(sqes, sqesSize);
+            if (cqRing != MAP_FAILED && cqRing != sqRing)
+                munmap(cqRing, cqRingSize);
+            if (sqRing != MAP_FAILED)
+                munmap(sqRing, sqRingSize);
+            if (fd >= 0)
+                close(fd);
+        }
+
+        bool setup(unsigned entries)
+        {
+            io_uring_params params;
+            std::memset(&params, 0, sizeof(params));
+            fd = int(syscall(__NR_io_uring_setup, entries, &params));
+            if (fd < 0)
+                return false;
+
+            sqRingSize =
+                params.sq_off.array + params.sq_entries * sizeof(unsigned);
+            cqRingSize =
+                params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+            // 5.4 以后的内核两个队列可以一次映射
+            const bool isSingleMmap = params.features & IORING_FEAT_SINGLE_MMAP;
+            if (isSingleMmap)
+                sqRingSize = cqRingSize =
+                    sqRingSize > cqRingSize ? sqRingSize : cqRingSize;
+            sqRing = mmap(nullptr, sqRingSize, PROT_READ | PROT_WRITE,
+                          MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+            if (sqRing == MAP_FAILED)
+                return false;
+            if (isSingleMmap)
+                cqRing = sqRing;
+            else
+            {
+                cqRing = mmap(nullptr, cqRingSize, PROT_READ | PROT_WRITE,
+                              MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+                if (cqRing == MAP_FAILED)
+                    return false;
+            }
+            sqesSize = params.sq_entries * sizeof(io_uring_sqe);
+            sqes = static_cast<io_uring_sqe *>(
+                mmap(nullptr, sqesSize, PROT_READ | PROT_WRITE,
+                     MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES));
+            if (sqes == MAP_FAILED)
+                return false;
+
+            char *sq = static_cast<char *>(sqRing);
+            sqHead = reinterpret_cast<unsigned *>(sq + params.sq_off.head);
+            sqTail = reinterpret_cast<unsigned *>(sq + params.sq_off.tail);
+            sqMask = *reinterpret_cast<unsigned *>(sq + params.sq_off.ring_mask);
+            sqEntries =
+                *reinterpret_cast<unsigned *>(sq + params.sq_off.ring_entries);
+            sqArray = reinterpret_cast<unsigned *>(sq + params.sq_off.array);
+            char *cq = static_cast<char *>(cqRing);
+            cqHead = reinterpret_cast<unsigned *>(cq + params.cq_off.head);
+            cqTail = reinterpret_cast<unsigned *>(cq + params.cq_off.tail);
+            cqMask = *reinterpret_cast<unsigned *>(cq + params.cq_off.ring_mask);
+            cqes = reinterpret_cast<io_uring_cqe *>(cq + params.cq_off.cqes);
+            return true;
+        }
+
+        bool prepare(std::uint8_t opcode, int fileFd, int bufIndex,
+                     const char *data, unsigned len, long long offset,
+                     std::uint64_t tag)
+        {
+            if (!isBuffersRegistered)
+                return false;
+            //只有本线程写 tail，内核写 head
+            const unsigned tail = *sqTail;
+            if (tail - __atomic_load_n(sqHead, __ATOMIC_ACQUIRE) >= sqEntries)
+                return false;
+            const unsigned index = tail & sqMask;
+            io_uring_sqe &sqe = sqes[index];
+            std::memset(&sqe, 0, sizeof(sqe));
+            sqe.opcode = opcode;
+            sqe.fd = fileFd;
+            sqe.off = std::uint64_t(offset);
+            sqe.addr = std::uint64_t(reinterpret_cast<std::uintptr_t>(data));
+            sqe.len = len;
+            sqe.buf_index = std::uint16_t(bufIndex);
+            sqe.user_data = tag;
+            sqArray[index] = index;
+            //先写好请求再移动 tail，内核看到新的 tail 时请求已完整
+            __atomic_store_n(sqTail, tail + 1, __ATOMIC_RELEASE);
+            ++toSubmit;
+            return true;
+        }
+    };
+
+    IoUring::IoUring(unsigned entries) : rings(new Rings())
+    {
+        if (!rings->setup(entries == 0 ? 1 : entries))
+            rings.reset();
+    }
+
+    IoUring::~IoUring() = default;
+
+    bool IoUring::isAvailable() const { return rings != nullptr; }
+
+    bool IoUring::registerBuffers(
+        const std::vector<std::pair<char *, std::size_t>> &buffers)
+    {
+        if (!rings || buffers.empty())
+            return false;
+        std::vector<iovec> iovecs(buffers.size());
+        for (std::size_t i = 0; i < buffers.size(); ++i)
+        {
+            iovecs[i].iov_base = buffers[i].first;
+            iovecs[i].iov_len = buffers[i].second;
+        }
+        rings->isBuffersRegistered =
+            syscall(__NR_io_uring_register, rings->fd, IORING_REGISTER_BUFFERS,
+                    iovecs.data(), unsigned(iovecs.size())) == 0;
+        return rings->isBuffersRegistered;
+    }
+
+    bool IoUring::prepareRead(int fd, int bufIndex, char *data, unsigned len,
+                              long long offset, std::uint64_t tag)
+    {
+        return rings && rings->prepare(IORING_OP_READ_FIXED, fd, bufIndex,
+                                       data, len, offset, tag);
+    }
+
+    bool IoUring::prepareWrite(int fd, int bufIndex, const char *data,
+                               unsigned len, long long offset,
+                               std::uint64_t tag)
+    {
+        return rings && rings->prepare(IORING_OP_WRITE_FIXED, fd, bufIndex,
+                                       data, len, offset, tag);
+    }
+
+    bool IoUring::enter(unsigned minComplete)
+    {
+        while (true)
+        {
+            int ret = int(syscall(__NR_io_uring_enter, rings->fd,
+                                  rings->toSubmit, minComplete,
+                                  minComplete > 0 ? IORING_ENTER_GETEVENTS : 0,
+                                  nullptr, 0));
+            if (ret < 0)
+            {
+                if (errno == EINTR)
+                    continue;
+                return false;
+            }
+            //没提交完的留到下次
+            rings->toSubmit -= unsigned(ret);
+            return true;
+        }
+    }
+
+    bool IoUring::submit()
+    {
+        if (!rings)
+            return false;
+        return rings->toSubmit == 0 || this->enter(0);
+    }
+
+    bool IoUring::peek(Completion &completion)
+    {
+        if (!rings)
+            return false;
+        //只有本线程写 head，内核写 tail
+        const unsigned head = *rings->cqHead;
+        if (head == __atomic_load_n(rings->cqTail, __ATOMIC_ACQUIRE))
+            return false;
+        const io_uring_cqe &cqe = rings->cqes[head & rings->cqMask];
+        completion.tag = cqe.user_data;
+        completion.res = cqe.res;
+        __atomic_store_n(rings->cqHead, head + 1, __ATOMIC_RELEASE);
+        return true;
+    }
+
+    bool IoUring::wait(Completion &completion)
+    {
+        if (!rings)
+            return false;
+        while (!this->peek(completion))
+            if (!this->enter(1))
+                return false;
+        return this->submit();
+    }
+
+#else // !__linux__
+
+    struct IoUring::Rings
+    {
+    };
+
+    IoUring::IoUring(unsigned) {}
+
+    IoUring::~IoUring() = default;
+
+    bool IoUring::isAvailable() const { return false; }
+
+    bool IoUring::registerBuffers(
+        const std::vector<std::pair<char *, std::size_t>> &)
+    {
+        return false;
+    }
+
+    bool IoUring::prepareRead(int, int, char *, unsigned, long long,
+                              std::uint64_t)
+    {
+        return false;
+    }
+
+    bool IoUring::prepareWrite(int, int, const char *, unsigned, long long,
+                               std::uint64_t)
+    {
+        return false;
+    }
+
+    bool IoUring::enter(unsigned) { return false; }
+
+    bool IoUring::submit() { return false; }
+
+    bool IoUring::peek(Completion &) { return false; }
+
+    bool IoUring::wait(Completion &) { return false; }
+
+#endif
+
+} // namespace utils
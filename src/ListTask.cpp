@@ -1,4 +1,6 @@
 #include "../include/ListTask.h"
+#include "../include/Deflate.h"
+#include "../include/FtpReply.h"
 #include "../include/MyUtils.h"
 #include <QtDebug>
 
@@ -17,41 +19,45 @@ namespace ftpclient
 
     ListTask::Res ListTask::start(std::string &errorMsg)
     {
-        return this->enterPassiveMode(errorMsg);
+        isDeflate = false;
+        if (compressionLevel > 0)
+        {
+            //服务器不支持 MODE Z 时照常不压缩
+            std::string recvErrorMsg;
+            auto ret = enterDeflateMode(session.getControlSock(),
+                                        compressionLevel, recvErrorMsg);
+            if (ret == CmdToServerRet::SUCCEEDED)
+                isDeflate = true;
+            else if (ret != CmdToServerRet::FAILED_WITH_MSG)
+                return Res::FAILED;
+        }
+        Res res = this->enterPassiveMode(errorMsg);
+        if (isDeflate)
+        {
+            //之后的命令和传输都按 MODE S 进行
+            std::string recvErrorMsg;
+            auto ret = enterStreamMode(session.getControlSock(), recvErrorMsg);
+            if (ret != CmdToServerRet::SUCCEEDED && res == Res::SUCCEEDED)
+                res = Res::FAILED;
+        }
+        return res;
     }
 
     ListTask::Res ListTask::enterPassiveMode(std::string &errorMsg)
     {
-        std::string ipv4Hostname;
+        std::string dataHostname;
         int port;
         std::string recvErrorMsg;
-        auto pasvRet = putServerIntoPasvMode(session.getControlSock(), port,
-                                             ipv4Hostname, recvErrorMsg);
-        if (pasvRet == CmdToServerRet::SUCCEEDED)
-            return this->dataConnect(ipv4Hostname, port, errorMsg);
-        else if (pasvRet == CmdToServerRet::FAILED_WITH_MSG)
+        //按服务器能力选择 PASV 或 EPSV
+        auto ret = ftpclient::enterPassiveMode(session.getControlSock(),
+                                               dataHostname, port,
+                                               recvErrorMsg);
+        if (ret == CmdToServerRet::SUCCEEDED)
+            return this->dataConnect(dataHostname, port, errorMsg);
+        else if (ret == CmdToServerRet::FAILED_WITH_MSG)
         {
-            //返回码为500，必须要用EPSV模式
-            if (std::regex_search(recvErrorMsg, std::regex(R"(^500.*)")))
-            {
-                auto epsvRet = putServerIntoEpsvMode(session.getControlSock(),
-                                                     port, recvErrorMsg);
-                if (epsvRet == CmdToServerRet::SUCCEEDED)
-                    return this->dataConnect(session.getHostname(), port,
-                                             errorMsg);
-                else if (epsvRet == CmdToServerRet::FAILED_WITH_MSG)
-                {
-                    errorMsg = std::move(recvErrorMsg);
-                    return Res::FAILED_WITH_MSG;
-                }
-                else
-                    return Res::FAILED;
-            }
-            else
-            {
-                errorMsg = std::move(recvErrorMsg);
-                return Res::FAILED_WITH_MSG;
-            }
+            errorMsg = std::move(recvErrorMsg);
+            return Res::FAILED_WITH_MSG;
         }
         else
             return Res::FAILED;
@@ -62,7 +68,8 @@ namespace ftpclient
     {
         auto res = connectToServer(dataSock, hostname, std::to_string(port),
                                    ListTask::SOCKET_SEND_TIMEOUT,
-                                   ListTask::SOCKET_RECV_TIMEOUT);
+                                   ListTask::SOCKET_RECV_TIMEOUT,
+                                   utils::dataSocketProfile());
         //数据连接建立失败
         if (res != ConnectToServerRes::SUCCEEDED)
             return Res::FAILED;
@@ -98,7 +105,12 @@ namespace ftpclient
             isConnect = false;
         };
         recvListString.clear();
-        int recvLen = utils::recvUntilClose(dataSock, recvListString);
+        std::string compressed;
+        int recvLen = utils::recvUntilClose(
+            dataSock, isDeflate ? compressed : recvListString);
+        if (recvLen >= 0 && isDeflate &&
+            !utils::inflateAll(compressed, recvListString))
+            recvLen = -1;
         if (recvLen >= 0)
         {
             closeDataSock();
@@ -115,12 +127,12 @@ namespace ftpclient
     {
         // 目录传输结束，用控制连接接收服务器消息
         std::string recvMsg;
-        int recvLen = utils::recvFtpMsg(session.getControlSock(), recvMsg);
+        int recvLen = utils::recvFtpReply(session.getControlSock(), recvMsg);
         if (recvLen <= 0)
             return Res::FAILED;
         //正常为 226 Successfully transferred "dir"
         //检查返回码是否为226或250
-        if (!std::regex_search(recvMsg, std::regex(R"(^(226|250).*)")))
+        if (!replyCodeIn(recvMsg, {226, 250}))
         {
             errorMsg = std::move(recvMsg);
             return Res::FAILED_WITH_MSG;
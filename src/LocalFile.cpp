@@ -0,0 +1,523 @@
+#include "../include/LocalFile.h"
+#include <algorithm>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace
+{
+#ifdef _WIN32
+    const utils::LocalFile::NativeHandle INVALID_HANDLE = INVALID_HANDLE_VALUE;
+#else
+    const utils::LocalFile::NativeHandle INVALID_HANDLE = -1;
+#endif
+} // namespace
+
+namespace utils
+{
+
+    LocalFile::LocalFile() : handle(INVALID_HANDLE) {}
+
+    LocalFile::LocalFile(LocalFile &&other) noexcept : handle(other.handle)
+    {
+        other.handle = INVALID_HANDLE;
+    }
+
+    LocalFile &LocalFile::operator=(LocalFile &&other) noexcept
+    {
+        if (this != &other)
+        {
+            this->close();
+            handle = other.handle;
+            other.handle = INVALID_HANDLE;
+        }
+        return *this;
+    }
+
+    bool LocalFile::isOpen() const { return handle != INVALID_HANDLE; }
+
+    bool LocalFile::openForRead(const std::string &path)
+    {
+        this->close();
+#ifdef _WIN32
+        handle = CreateFileA(path.c_str(), GENERIC_READ,
+                             FILE_SHARE_READ | FILE_SHARE_WRITE, nullptr,
+                             OPEN_EXISTING,
+                             FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN,
+                             nullptr);
+#else
+        handle = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+#endif
+        return this->isOpen();
+    }
+
+    bool LocalFile::openForWrite(const std::string &path)
+    {
+        this->close();
+#ifdef _WIN32
+        handle = CreateFileA(path.c_str(), GENERIC_WRITE,
+                             FILE_SHARE_READ | FILE_SHARE_WRITE, nullptr,
+                             OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+#else
+        handle = ::open(path.c_str(), O_WRONLY | O_CREAT | O_CLOEXEC, 0644);
+#endif
+        return this->isOpen();
+    }
+
+    void LocalFile::close()
+    {
+        if (!this->isOpen())
+            return;
+#ifdef _WIN32
+        CloseHandle(handle);
+#else
+        ::close(handle);
+#endif
+        handle = INVALID_HANDLE;
+    }
+
+    bool LocalFile::isRegularFile() const
+    {
+        if (!this->isOpen())
+            return false;
+#ifdef _WIN32
+        return GetFileType(handle) == FILE_TYPE_DISK;
+#else
+        struct stat st;
+        return fstat(handle, &st) == 0 && S_ISREG(st.st_mode);
+#endif
+    }
+
+    long long LocalFile::size() const
+    {
+        if (!this->isOpen())
+            return -1;
+#ifdef _WIN32
+        LARGE_INTEGER size;
+        if (!GetFileSizeEx(handle, &size))
+            return -1;
+        return size.QuadPart;
+#else
+        struct stat st;
+        if (fstat(handle, &st) != 0)
+            return -1;
+        return st.st_size;
+#endif
+    }
+
+    bool LocalFile::resize(long long size)
+    {
+        if (!this->isOpen())
+            return false;
+#ifdef _WIN32
+        LARGE_INTEGER pos;
+        pos.QuadPart = size;
+        return SetFilePointerEx(handle, pos, nullptr, FILE_BEGIN) &&
+               SetEndOfFile(handle);
+#else
+        return ftruncate(handle, off_t(size)) == 0;
+#endif
+    }
+
+    bool LocalFile::preallocate(long long size)
+    {
+        if (!this->isOpen() || size <= 0)
+            return false;
+#ifdef _WIN32
+        FILE_ALLOCATION_INFO info;
+        info.AllocationSize.QuadPart = size;
+        return SetFileInformationByHandle(handle, FileAllocationInfo, &info,
+                                          sizeof(info));
+#elif defined(__linux__)
+        int ret;
+        do
+            ret = fallocate(handle, FALLOC_FL_KEEP_SIZE, 0, off_t(size));
+        while (ret != 0 && errno == EINTR);
+        return ret == 0;
+#else
+        return false;
+#endif
+    }
+
+    void LocalFile::startWriteback(long long offset, long long len)
+    {
+#ifdef __linux__
+        if (this->isOpen())
+            sync_file_range(handle, off_t(offset), off_t(len),
+                            SYNC_FILE_RANGE_WRITE);
+#else
+        (void)offset;
+        (void)len;
+#endif
+    }
+
+    void LocalFile::dropCache(long long offset, long long len)
+    {
+#ifdef __linux__
+        if (!this->isOpen())
+            return;
+        //脏页不会被丢弃，先等它们写回
+        sync_file_range(handle, off_t(offset), off_t(len),
+                        SYNC_FILE_RANGE_WAIT_BEFORE | SYNC_FILE_RANGE_WRITE |
+                            SYNC_FILE_RANGE_WAIT_AFTER);
+        posix_fadvise(handle, off_t(offset), off_t(len), POSIX_FADV_DONTNEED);
+#else
+        (void)offset;
+        (void)len;
+#endif
+    }
+
+    bool LocalFile::writeAt(const char *data, std::size_t len,
+                            long long offset)
+    {
+        while (len > 0)
+        {
+#ifdef _WIN32
+            // 同步句柄上带 OVERLAPPED 的 WriteFile 写到指定位置
+            OVERLAPPED overlapped = {};
+            overlapped.Offset = DWORD(offset & 0xFFFFFFFF);
+            overlapped.OffsetHigh = DWORD(offset >> 32);
+            DWORD toWrite = len > 0x40000000 ? 0x40000000 : DWORD(len);
+            DWORD written = 0;
+            if (!WriteFile(handle, data, toWrite, &written, &overlapped) ||
+                written == 0)
+                return false;
+#else
+            ssize_t written = pwrite(handle, data, len, off_t(offset));
+            if (written < 0 && errno == EINTR)
+                continue;
+            if (written <= 0)
+                return false;
+#endif
+            data += written;
+            len -= std::size_t(written);
+            offset += written;
+        }
+        return true;
+    }
+
+    long long LocalFile::readAt(char *data, std::size_t len,
+                                long long offset)
+    {
+#ifdef _WIN32
+        OVERLAPPED overlapped = {};
+        overlapped.Offset = DWORD(offset & 0xFFFFFFFF);
+        overlapped.OffsetHigh = DWORD(offset >> 32);
+        DWORD toRead = len > 0x40000000 ? 0x40000000 : DWORD(len);
+        DWORD read = 0;
+        if (!ReadFile(handle, data, toRead, &read, &overlapped))
+            return GetLastError() == ERROR_HANDLE_EOF ? 0 : -1;
+        return read;
+#else
+        while (true)
+        {
+            ssize_t read = pread(handle, data, len, off_t(offset));
+            if (read < 0 && errno == EINTR)
+                continue;
+            return read;
+        }
+#endif
+    }
+
+    namespace
+    {
+        /**
+         * @brief 借 depth 块缓冲区并注册到新建的 io_uring 中
+         * @author zhb
+         * @param buffers 已借好的第一块，成功时补足到 depth 块
+         * @return 成功时返回 io_uring，depth 小于 2、借不到缓冲区或不支持
+         * io_uring 时返回空，buffers 仍只有第一块
+         */
+        template <typename Slot>
+        std::unique_ptr<IoUring> setUpRing(std::vector<Slot> &slots,
+                                           int depth, std::size_t blockSize)
+        {
+            if (depth < 2 || slots.empty())
+                return nullptr;
+            std::unique_ptr<IoUring> ring(new IoUring(unsigned(depth)));
+            if (!ring->isAvailable())
+                return nullptr;
+            slots.resize(std::size_t(depth));
+            std::vector<std::pair<char *, std::size_t>> buffers;
+            for (Slot &slot : slots)
+            {
+                if (slot.buffer.data() == nullptr)
+                    slot.buffer = BufferPool::instance().acquire(blockSize);
+                if (slot.buffer.data() == nullptr)
+                    break;
+                buffers.emplace_back(slot.buffer.data(), slot.buffer.size());
+            }
+            if (buffers.size() != slots.size() ||
+                !ring->registerBuffers(buffers))
+            {
+                slots.resize(1);
+                return nullptr;
+            }
+            return ring;
+        }
+
+        // io_uring 只在 Linux 下可用，其余平台不会走到这里
+        int ringFd(const LocalFile &file)
+        {
+#ifdef _WIN32
+            (void)file;
+            return -1;
+#else
+            return file.nativeHandle();
+#endif
+        }
+    } // namespace
+
+    const long long SequentialWriter::DROP_CACHE_WINDOW;
+
+    SequentialWriter::SequentialWriter(LocalFile &file, long long offset,
+                                       std::size_t blockSize, bool dropCache,
+                                       int ioDepth)
+        : file(file),
+          pos(offset),
+          isDropCache(dropCache),
+          cachedFrom(offset)
+    {
+        slots.resize(1);
+        slots[0].buffer = BufferPool::instance().acquire(blockSize);
+        if (slots[0].buffer.data() == nullptr)
+            slots.clear();
+        ring = setUpRing(slots, ioDepth, blockSize);
+        limit = slots.empty() ? 0 : slots[0].buffer.size();
+        //续传时第一块只写到下一个块边界，之后的写入都是对齐的
+        if (limit > 0 && offset % (long long)limit != 0)
+            limit -= std::size_t(offset % (long long)limit);
+    }
+
+    SequentialWriter::~SequentialWriter() { this->drain(); }
+
+    bool SequentialWriter::commit(std::size_t len)
+    {
+        used += len;
+        return used < limit || this->writeBuffer();
+    }
+
+    bool SequentialWriter::write(const char *data, std::size_t len)
+    {
+        while (len > 0)
+        {
+            std::size_t n = std::min(len, this->spaceSize());
+            std::copy(data, data + n, this->space());
+            if (!this->commit(n))
+                return false;
+            data += n;
+            len -= n;
+        }
+        return true;
+    }
+
+    bool SequentialWriter::flush()
+    {
+        if (used > 0 && !this->writeBuffer())
+            return false;
+        if (!this->drain())
+            return false;
+        if (isDropCache && pos > cachedFrom)
+        {
+            file.dropCache(cachedFrom, pos - cachedFrom);
+            cachedFrom = pos;
+        }
+        return true;
+    }
+
+    bool SequentialWriter::writeBuffer()
+    {
+        Slot &slot = slots[current];
+        if (ring == nullptr)
+        {
+            if (!file.writeAt(slot.buffer.data(), used, pos))
+                return false;
+            if (isDropCache)
+                file.startWriteback(pos, (long long)used);
+        }
+        else
+        {
+            //提交后换下一块缓冲区接收，下一块还在写时等它写完
+            slot.pos = pos;
+            slot.len = used;
+            if (!ring->prepareWrite(ringFd(file), int(current),
+                                    slot.buffer.data(), unsigned(used), pos,
+                                    current) ||
+                !ring->submit())
+                return false;
+            slot.busy = true;
+            ++inFlight;
+            current = (current + 1) % slots.size();
+            while (slots[current].busy)
+            {
+                IoUring::Completion completion;
+                if (!ring->wait(completion) || !this->complete(completion))
+                    return false;
+            }
+        }
+        pos += (long long)used;
+        used = 0;
+        limit = slots[current].buffer.size();
+        //再早一个窗口的数据此时多半已写回，丢弃它们
+        if (isDropCache && pos - cachedFrom >= 2 * DROP_CACHE_WINDOW)
+        {
+            if (!this->drain())
+                return false;
+            file.dropCache(cachedFrom, DROP_CACHE_WINDOW);
+            cachedFrom += DROP_CACHE_WINDOW;
+        }
+        return true;
+    }
+
+    bool SequentialWriter::complete(const IoUring::Completion &completion)
+    {
+        Slot &slot = slots[std::size_t(completion.tag)];
+        slot.busy = false;
+        --inFlight;
+        if (completion.res < 0)
+            return false;
+        //只写了一部分（如磁盘快满），剩下的同步写，以便得到确切的结果
+        const std::size_t written = std::size_t(completion.res);
+        if (written < slot.len &&
+            !file.writeAt(slot.buffer.data() + written, slot.len - written,
+                          slot.pos + (long long)written))
+            return false;
+        if (isDropCache)
+            file.startWriteback(slot.pos, (long long)slot.len);
+        return true;
+    }
+
+    bool SequentialWriter::drain()
+    {
+        bool isSucceeded = true;
+        while (inFlight > 0)
+        {
+            IoUring::Completion completion;
+            //等待本身失败时已无法得知各块的结果
+            if (!ring->wait(completion))
+                return false;
+            if (!this->complete(completion))
+                isSucceeded = false;
+        }
+        return isSucceeded;
+    }
+
+    SequentialReader::SequentialReader(LocalFile &file, long long offset,
+                                       std::size_t blockSize, int ioDepth)
+        : file(file), nextPos(offset), end(file.size()), blockSize(blockSize)
+    {
+        slots.resize(1);
+        slots[0].buffer = BufferPool::instance().acquire(blockSize);
+        if (slots[0].buffer.data() == nullptr || blockSize == 0)
+            slots.clear();
+        ring = setUpRing(slots, ioDepth, blockSize);
+        if (ring == nullptr)
+            return;
+        //一开始就让所有块都去读
+        for (std::size_t i = 0; i < slots.size(); ++i)
+            if (!this->startRead(i))
+            {
+                slots[i].res = -1;
+                slots[i].done = true;
+            }
+        ring->submit();
+    }
+
+    SequentialReader::~SequentialReader()
+    {
+        while (inFlight > 0)
+        {
+            IoUring::Completion completion;
+            if (!ring->wait(completion))
+                break;
+            --inFlight;
+        }
+    }
+
+    bool SequentialReader::startRead(std::size_t index)
+    {
+        Slot &slot = slots[index];
+        //第一块只读到下一个块边界，之后的读都是对齐的
+        slot.pos = nextPos;
+        slot.len = std::size_t(std::min<long long>(
+            (long long)blockSize - nextPos % (long long)blockSize,
+            std::max(0LL, end - nextPos)));
+        slot.res = 0;
+        slot.done = slot.len == 0;
+        if (slot.done)
+            return true;
+        if (!ring->prepareRead(ringFd(file), int(index),
+                               slot.buffer.data(), unsigned(slot.len),
+                               slot.pos, index))
+            return false;
+        ++inFlight;
+        nextPos += (long long)slot.len;
+        return true;
+    }
+
+    bool SequentialReader::fill(Slot &slot, std::size_t got)
+    {
+        while (got < slot.len)
+        {
+            long long read = file.readAt(slot.buffer.data() + got,
+                                         slot.len - got,
+                                         slot.pos + (long long)got);
+            if (read <= 0)
+                return false;
+            got += std::size_t(read);
+        }
+        return true;
+    }
+
+    bool SequentialReader::next(const char *&data, std::size_t &len)
+    {
+        if (slots.empty() || end < 0)
+            return false;
+        if (ring == nullptr)
+        {
+            Slot &slot = slots[0];
+            slot.pos = nextPos;
+            slot.len = std::size_t(std::min<long long>(
+                (long long)blockSize - nextPos % (long long)blockSize,
+                std::max(0LL, end - nextPos)));
+            if (!this->fill(slot, 0))
+                return false;
+            nextPos += (long long)slot.len;
+            data = slot.buffer.data();
+            len = slot.len;
+            return true;
+        }
+
+        //上一块已经用完，让它去读后面的数据
+        if (isHeadTaken)
+        {
+            if (!this->startRead(head) || !ring->submit())
+                return false;
+            head = (head + 1) % slots.size();
+            isHeadTaken = false;
+        }
+        Slot &slot = slots[head];
+        while (!slot.done)
+        {
+            IoUring::Completion completion;
+            if (!ring->wait(completion))
+                return false;
+            Slot &finished = slots[std::size_t(completion.tag)];
+            finished.res = completion.res;
+            finished.done = true;
+            --inFlight;
+        }
+        if (slot.res < 0 || !this->fill(slot, std::size_t(slot.res)))
+            return false;
+        isHeadTaken = true;
+        data = slot.buffer.data();
+        len = slot.len;
+        return true;
+    }
+
+} // namespace utils
@@ -1,57 +1,148 @@
 #include "../include/MyUtils.h"
+#include "../include/FtpReply.h"
+#include <algorithm>
+#include <cstring>
 #include <memory>
-#include <regex>
+#include <mutex>
 #include <sstream>
+#include <unordered_map>
 
 using std::unique_ptr;
 
-namespace utils
+namespace
 {
+    /**
+     * @brief 控制连接的接收缓冲区
+     * @author zhb
+     *
+     * data 中 [begin, data.size()) 为尚未取走的数据
+     * scanned 之前的部分已确认不含"\r\n"，避免重复扫描
+     */
+    struct MsgBuffer
+    {
+        std::string data;
+        std::string::size_type begin = 0;
+        std::string::size_type scanned = 0;
+    };
 
-    std::pair<std::string, int> getIPAndPortForPSAV(const std::string &msg)
+    //每次 recv() 最多收取的字节数
+    const int MSG_RECV_CHUNK = 4096;
+
+    std::mutex msgBuffersMutex;
+    std::unordered_map<SOCKET, std::shared_ptr<MsgBuffer>> msgBuffers;
+
+    /**
+     * @brief 获取某个控制连接的接收缓冲区，不存在则创建
+     * @author zhb
+     *
+     * 同一个 socket 同一时刻只会被一个线程读，所以只需保护 map 本身。
+     * 返回 shared_ptr：另一个线程 discardFtpMsgBuffer() 时（如 quit()），
+     * 正在读的一方仍持有缓冲区，不会访问已释放的内存
+     */
+    std::shared_ptr<MsgBuffer> msgBufferOf(SOCKET sock)
+    {
+        std::lock_guard<std::mutex> guard(msgBuffersMutex);
+        std::shared_ptr<MsgBuffer> &buffer = msgBuffers[sock];
+        if (!buffer)
+            buffer = std::make_shared<MsgBuffer>();
+        return buffer;
+    }
+
+    /**
+     * @brief 从缓冲区中取出一行
+     * @author zhb
+     * @return 缓冲区中是否有完整的一行
+     */
+    bool takeLine(MsgBuffer &buffer, std::string &line)
+    {
+        const char *data = buffer.data.data();
+        std::string::size_type size = buffer.data.size();
+        std::string::size_type pos = std::max(buffer.scanned, buffer.begin);
+        while (pos < size)
+        {
+            const void *lf = std::memchr(data + pos, '\n', size - pos);
+            if (lf == nullptr)
+                break;
+            pos = std::string::size_type(static_cast<const char *>(lf) - data);
+            if (pos > buffer.begin && data[pos - 1] == '\r')
+            {
+                line.assign(data + buffer.begin, pos + 1 - buffer.begin);
+                buffer.begin = pos + 1;
+                buffer.scanned = buffer.begin;
+                return true;
+            }
+            ++pos; //单独的'\n'不算行尾
+        }
+        // 末尾的'\r'可能与下次收到的'\n'组成行尾，需要重新扫描
+        buffer.scanned = size > buffer.begin ? size - 1 : size;
+        return false;
+    }
+
+    /**
+     * @brief 把已取走的部分移出缓冲区，再调用一次 recv() 收取新数据
+     * @author zhb
+     * @return recv() 的返回值
+     */
+    int recvIntoBuffer(SOCKET sock, MsgBuffer &buffer)
     {
-        std::regex e(R"(\((\d+),(\d+),(\d+),(\d+),(\d+),(\d+)\))");
-        std::sregex_iterator iter(msg.begin(), msg.end(), e);
+        if (buffer.begin > 0)
+        {
+            buffer.data.erase(0, buffer.begin);
+            buffer.scanned -= buffer.begin;
+            buffer.begin = 0;
+        }
+        std::string::size_type oldSize = buffer.data.size();
+        buffer.data.resize(oldSize + MSG_RECV_CHUNK);
+        int iResult = recv(sock, &buffer.data[oldSize], MSG_RECV_CHUNK, 0);
+        buffer.data.resize(oldSize + (iResult > 0 ? iResult : 0));
+        return iResult;
+    }
 
-        std::string h1, h2, h3, h4;
-        h1 = (*iter)[1].str();
-        h2 = (*iter)[2].str();
-        h3 = (*iter)[3].str();
-        h4 = (*iter)[4].str();
-        std::string hostname = h1 + "." + h2 + "." + h3 + "." + h4;
+} // namespace
 
-        int p1, p2;
-        p1 = std::stoi((*iter)[5].str());
-        p2 = std::stoi((*iter)[6].str());
-        int port = p1 * 256 + p2;
+namespace utils
+{
 
+    std::pair<std::string, int> getIPAndPortForPSAV(const std::string &msg)
+    {
+        int host[4] = {0, 0, 0, 0};
+        int port = 0;
+        ftpclient::parsePasvReply(msg, host, port);
+        std::string hostname = std::to_string(host[0]) + "." +
+                               std::to_string(host[1]) + "." +
+                               std::to_string(host[2]) + "." +
+                               std::to_string(host[3]);
         return {hostname, port};
     }
 
     int getPortForEPSV(const std::string &msg)
     {
-        std::regex e(R"(\(\|\|\|(\d+)\|\))");
-        std::sregex_iterator iter(msg.begin(), msg.end(), e);
-
-        int port = std::stoi((*iter)[1]);
+        int port = 0;
+        ftpclient::parseEpsvReply(msg, port);
         return port;
     }
 
     long long getSizeFromMsg(const std::string &msg)
     {
-        std::regex e(R"(^213\s+(\d+))");
-        std::sregex_iterator iter(msg.begin(), msg.end(), e);
-
-        long long filesize = std::stoll((*iter)[1]);
+        long long filesize = 0;
+        ftpclient::parseSizeReply(msg, filesize);
         return filesize;
     }
 
     std::string getDirFromMsg(const std::string &msg)
     {
-        // "(.+)"
-        std::regex e("\"(.+)\"");
-        std::sregex_iterator iter(msg.begin(), msg.end(), e);
-        std::string dir = (*iter)[1].str();
+        std::string_view quoted;
+        if (!ftpclient::parsePathReply(msg, quoted))
+            return std::string();
+        //把""还原成"
+        std::string dir;
+        dir.reserve(quoted.size());
+        for (std::string_view::size_type i = 0; i < quoted.size(); ++i)
+        {
+            dir.push_back(quoted[i]);
+            if (quoted[i] == '"')
+                ++i;
+        }
         return dir;
     }
 
@@ -84,26 +175,93 @@ namespace utils
     int recvFtpMsg(SOCKET controlSock, std::string &recvMsg)
     {
         recvMsg.clear();
-        char buf[1];
+        const std::shared_ptr<MsgBuffer> holder = msgBufferOf(controlSock);
+        MsgBuffer &buffer = *holder;
         int iResult;
         while (true)
         {
-            iResult = recv(controlSock, buf, 1, 0);
-            if (iResult > 0)
+            if (takeLine(buffer, recvMsg))
+                return int(recvMsg.length());
+
+            iResult = recvIntoBuffer(controlSock, buffer);
+            if (iResult == 0)
             {
-                recvMsg.push_back(buf[0]);
-                std::string::size_type len = recvMsg.length();
-                if (len >= 2 && recvMsg[len - 2] == '\r' &&
-                    recvMsg[len - 1] == '\n')
-                    return int(len);
-            }
-            else if (iResult == 0)
+                //对方关闭连接，把剩余的数据作为最后一条消息
+                recvMsg = std::move(buffer.data);
+                buffer.data.clear();
+                buffer.scanned = 0;
                 return int(recvMsg.length());
-            else // iResult < 0
+            }
+            else if (iResult < 0)
+                return iResult; //未取走的数据留到下次
+        }
+    }
+
+    int recvFtpReply(SOCKET controlSock, std::string &reply)
+    {
+        reply.clear();
+        std::string line;
+        int iResult = recvFtpMsg(controlSock, line);
+        if (iResult <= 0)
+            return iResult;
+        reply = line;
+        //单行回复"NNN text"
+        if (!ftpclient::isMultiLineReplyStart(line))
+            return int(reply.length());
+
+        //多行回复，直到出现"NNN "为止
+        const int code = ftpclient::parseReplyCode(line);
+        while (true)
+        {
+            iResult = recvFtpMsg(controlSock, line);
+            if (iResult <= 0)
                 return iResult;
+            reply += line;
+            if (ftpclient::isLastReplyLine(line, code))
+                return int(reply.length());
         }
     }
 
+    bool takeFtpReply(SOCKET controlSock, std::string &reply)
+    {
+        reply.clear();
+        const std::shared_ptr<MsgBuffer> holder = msgBufferOf(controlSock);
+        MsgBuffer &buffer = *holder;
+        //多行回复没收全时要把取走的行放回去
+        const std::string::size_type oldBegin = buffer.begin;
+        const std::string::size_type oldScanned = buffer.scanned;
+        std::string line;
+        if (takeLine(buffer, line))
+        {
+            reply = line;
+            if (!ftpclient::isMultiLineReplyStart(line))
+                return true;
+            const int code = ftpclient::parseReplyCode(line);
+            while (takeLine(buffer, line))
+            {
+                reply += line;
+                if (ftpclient::isLastReplyLine(line, code))
+                    return true;
+            }
+        }
+        buffer.begin = oldBegin;
+        buffer.scanned = oldScanned;
+        reply.clear();
+        return false;
+    }
+
+    int fillFtpMsgBuffer(SOCKET controlSock)
+    {
+        //临时的 shared_ptr 保证 recv() 期间缓冲区不被释放
+        return recvIntoBuffer(controlSock, *msgBufferOf(controlSock));
+    }
+
+    void discardFtpMsgBuffer(SOCKET controlSock)
+    {
+        std::lock_guard<std::mutex> guard(msgBuffersMutex);
+        msgBuffers.erase(controlSock);
+    }
+
     long long getFilesize(std::ifstream &ifs)
     {
         auto currentPos = ifs.tellg(); //当前位置
@@ -0,0 +1,104 @@
+#include "../include/RateLimiter.h"
+#include <algorithm>
+#include <thread>
+
+namespace utils
+{
+
+    const int RateLimiter::BURST_MS;
+    const long long RateLimiter::MIN_CHUNK_SIZE;
+
+    namespace
+    {
+        //限速 rate 时桶的容量
+        double burstSize(long long rate)
+        {
+            return std::max<double>(rate * RateLimiter::BURST_MS / 1000.0,
+                                    RateLimiter::MIN_CHUNK_SIZE);
+        }
+    } // namespace
+
+    RateLimiter::RateLimiter(long long bytesPerSecond)
+        : bytesPerSecond(std::max<long long>(bytesPerSecond, 0)),
+          tokens(burstSize(bytesPerSecond)),
+          lastRefill(Clock::now())
+    {
+    }
+
+    RateLimiter &RateLimiter::globalUpload()
+    {
+        static RateLimiter limiter;
+        return limiter;
+    }
+
+    RateLimiter &RateLimiter::globalDownload()
+    {
+        static RateLimiter limiter;
+        return limiter;
+    }
+
+    void RateLimiter::setLimit(long long bytesPerSecond)
+    {
+        bytesPerSecond = std::max<long long>(bytesPerSecond, 0);
+        std::lock_guard<std::mutex> guard(mutex);
+        long long oldRate = this->bytesPerSecond.exchange(bytesPerSecond);
+        //从不限速改为限速时桶是满的；改小限速时多余的令牌作废
+        if (oldRate == 0)
+        {
+            tokens = burstSize(bytesPerSecond);
+            lastRefill = Clock::now();
+        }
+        else
+            tokens = std::min(tokens, burstSize(bytesPerSecond));
+    }
+
+    std::chrono::nanoseconds RateLimiter::reserve(long long bytes)
+    {
+        long long rate = this->limit();
+        if (rate == 0)
+            return std::chrono::nanoseconds(0);
+
+        std::lock_guard<std::mutex> guard(mutex);
+        //补充上次以来生成的令牌
+        Clock::time_point now = Clock::now();
+        double elapsed =
+            std::chrono::duration<double>(now - lastRefill).count();
+        lastRefill = now;
+        tokens = std::min(tokens + elapsed * rate, burstSize(rate));
+
+        tokens -= bytes;
+        if (tokens >= 0)
+            return std::chrono::nanoseconds(0);
+        //透支的令牌要等这么久才能补上
+        return std::chrono::nanoseconds((long long)(-tokens * 1e9 / rate));
+    }
+
+    long long RateLimiter::chunkSize(long long wanted) const
+    {
+        long long rate = this->limit();
+        if (rate == 0)
+            return wanted;
+        return std::min(wanted, (long long)burstSize(rate));
+    }
+
+    long long Throttle::chunkSize(long long wanted) const
+    {
+        if (own != nullptr)
+            wanted = own->chunkSize(wanted);
+        if (global != nullptr)
+            wanted = global->chunkSize(wanted);
+        return wanted;
+    }
+
+    void Throttle::consume(long long bytes) const
+    {
+        std::chrono::nanoseconds wait(0);
+        if (own != nullptr)
+            wait = own->reserve(bytes);
+        if (global != nullptr)
+            wait = std::max(wait, global->reserve(bytes));
+        if (wait.count() > 0)
+            std::this_thread::sleep_for(wait);
+    }
+
+} // namespace utils
@@ -0,0 +1,361 @@
+#include "../include/Reactor.h"
+#include <algorithm>
+#include <chrono>
+#ifdef __linux__
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#elif !defined(_WIN32)
+#include <poll.h>
+#endif
+
+namespace
+{
+    using LockGuard = std::lock_guard<std::mutex>;
+
+    //单调时钟，单位 ms
+    long long steadyNowMs()
+    {
+        using namespace std::chrono;
+        return duration_cast<milliseconds>(
+                   steady_clock::now().time_since_epoch())
+            .count();
+    }
+
+    //一次 epoll_wait() 最多取出的事件数
+    const int MAX_EVENTS = 64;
+
+#ifndef __linux__
+    int pollSockets(std::vector<pollfd> &fds, int timeout)
+    {
+#ifdef _WIN32
+        return WSAPoll(fds.data(), ULONG(fds.size()), timeout);
+#else
+        return poll(fds.data(), nfds_t(fds.size()), timeout);
+#endif
+    }
+#endif
+
+} // namespace
+
+namespace utils
+{
+
+    const int TimerWheel::TICK_MS;
+    const int TimerWheel::SLOT_COUNT;
+
+    TimerWheel::TimerWheel() : wheel(SLOT_COUNT), lastTickMs(steadyNowMs()) {}
+
+    TimerWheel::TimerId TimerWheel::add(int delayMs,
+                                        std::function<void()> callback)
+    {
+        //从指针上次移动的时刻算起，向上取整，保证不会提前到时
+        long long elapsed = steadyNowMs() - lastTickMs + std::max(delayMs, 0);
+        long long ticks = std::max((elapsed + TICK_MS - 1) / TICK_MS, 1LL);
+        int slot = int((current + ticks) % SLOT_COUNT);
+        int rounds = int((ticks - 1) / SLOT_COUNT);
+        TimerId id = nextId++;
+        Slot &target = wheel[slot];
+        target.push_back(Timer{id, rounds, std::move(callback)});
+        timers[id] = {slot, std::prev(target.end())};
+        return id;
+    }
+
+    void TimerWheel::cancel(TimerId id)
+    {
+        auto iter = timers.find(id);
+        if (iter == timers.end())
+            return;
+        wheel[iter->second.first].erase(iter->second.second);
+        timers.erase(iter);
+    }
+
+    void TimerWheel::advance(std::vector<std::function<void()>> &expired)
+    {
+        long long ticks = (steadyNowMs() - lastTickMs) / TICK_MS;
+        lastTickMs += ticks * TICK_MS;
+        //没有定时器时指针照转，只是不必逐格检查
+        if (timers.empty())
+        {
+            current = int((current + ticks) % SLOT_COUNT);
+            return;
+        }
+        for (long long i = 0; i < ticks; ++i)
+        {
+            current = (current + 1) % SLOT_COUNT;
+            Slot &slot = wheel[current];
+            for (auto iter = slot.begin(); iter != slot.end();)
+            {
+                if (iter->rounds > 0)
+                {
+                    --iter->rounds;
+                    ++iter;
+                    continue;
+                }
+                expired.push_back(std::move(iter->callback));
+                timers.erase(iter->id);
+                iter = slot.erase(iter);
+            }
+        }
+    }
+
+    int TimerWheel::nextTimeout() const
+    {
+        if (timers.empty())
+            return -1;
+        long long wait = lastTickMs + TICK_MS - steadyNowMs();
+        return int(std::max(wait, 0LL));
+    }
+
+    Reactor &Reactor::instance()
+    {
+        static Reactor reactor;
+        return reactor;
+    }
+
+    Reactor::Reactor()
+    {
+#ifdef __linux__
+        epollFd = epoll_create1(EPOLL_CLOEXEC);
+        wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        epoll_event ev{};
+        ev.events = EPOLLIN;
+        ev.data.fd = wakeFd;
+        epoll_ctl(epollFd, EPOLL_CTL_ADD, wakeFd, &ev);
+#else
+        initSockets();
+        //绑定到回环地址的 UDP socket，连接到自己，发一个字节即可唤醒 poll
+        wakeSock = socket(AF_INET, SOCK_DGRAM, 0);
+        sockaddr_in addr{};
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        socklen_t addrLen = sizeof(addr);
+        bind(wakeSock, (sockaddr *)&addr, sizeof(addr));
+        getsockname(wakeSock, (sockaddr *)&addr, &addrLen);
+        connect(wakeSock, (sockaddr *)&addr, sizeof(addr));
+        //唤醒字节可能积压多个，一次收完，不能阻塞
+        setNonBlocking(wakeSock, true);
+#endif
+        thread = std::thread(&Reactor::run, this);
+    }
+
+    Reactor::~Reactor()
+    {
+        {
+            LockGuard guard(mutex);
+            isStopping = true;
+        }
+        this->wakeUp();
+        if (thread.joinable())
+            thread.join();
+#ifdef __linux__
+        close(wakeFd);
+        close(epollFd);
+#else
+        closesocket(wakeSock);
+#endif
+    }
+
+    bool Reactor::watch(SOCKET sock, int events, int timeoutMs,
+                        Callback callback)
+    {
+        {
+            LockGuard guard(mutex);
+            if (isStopping || watches.count(sock) > 0)
+                return false;
+            Watch &watch = watches[sock];
+            watch.events = events;
+            watch.callback = std::move(callback);
+            watch.serial = nextSerial++;
+            if (timeoutMs >= 0)
+            {
+                unsigned long long serial = watch.serial;
+                watch.timerId =
+                    timerWheel.add(timeoutMs, [this, sock, serial]() {
+                        Callback callback = this->takeWatch(sock, serial);
+                        if (callback)
+                            callback(WaitRes::TIMEOUT);
+                    });
+            }
+#ifdef __linux__
+            epoll_event ev{};
+            ev.events = EPOLLONESHOT;
+            if (events & READABLE)
+                ev.events |= EPOLLIN | EPOLLRDHUP;
+            if (events & WRITABLE)
+                ev.events |= EPOLLOUT;
+            ev.data.fd = sock;
+            if (epoll_ctl(epollFd, EPOLL_CTL_ADD, sock, &ev) != 0)
+            {
+                timerWheel.cancel(watch.timerId);
+                watches.erase(sock);
+                return false;
+            }
+#else
+            watchesChanged = true;
+#endif
+        }
+        //新的超时或新的 socket 要让 Reactor 线程重新计算等待时间
+        if (std::this_thread::get_id() != thread.get_id())
+            this->wakeUp();
+        return true;
+    }
+
+    void Reactor::cancel(SOCKET sock)
+    {
+        Callback callback = this->takeWatch(sock, 0);
+        if (callback)
+            callback(WaitRes::FAILED);
+    }
+
+    void Reactor::post(std::function<void()> func)
+    {
+        {
+            LockGuard guard(mutex);
+            posted.push_back(std::move(func));
+        }
+        this->wakeUp();
+    }
+
+    TimerWheel::TimerId Reactor::addTimer(int delayMs,
+                                          std::function<void()> callback)
+    {
+        TimerWheel::TimerId id;
+        {
+            LockGuard guard(mutex);
+            id = timerWheel.add(delayMs, std::move(callback));
+        }
+        if (std::this_thread::get_id() != thread.get_id())
+            this->wakeUp();
+        return id;
+    }
+
+    void Reactor::cancelTimer(TimerWheel::TimerId id)
+    {
+        LockGuard guard(mutex);
+        timerWheel.cancel(id);
+    }
+
+    Reactor::Callback Reactor::takeWatch(SOCKET sock, unsigned long long serial)
+    {
+        LockGuard guard(mutex);
+        auto iter = watches.find(sock);
+        //serial 不同说明这是同一 socket 上更新的一次等待
+        if (iter == watches.end() ||
+            (serial != 0 && iter->second.serial != serial))
+            return Callback();
+        Callback callback = std::move(iter->second.callback);
+        timerWheel.cancel(iter->second.timerId);
+        watches.erase(iter);
+#ifdef __linux__
+        epoll_ctl(epollFd, EPOLL_CTL_DEL, sock, nullptr);
+#else
+        watchesChanged = true;
+#endif
+        return callback;
+    }
+
+    void Reactor::wakeUp()
+    {
+#ifdef __linux__
+        unsigned long long one = 1;
+        ssize_t n = write(wakeFd, &one, sizeof(one));
+        (void)n;
+#else
+        char byte = 0;
+        send(wakeSock, &byte, 1, 0);
+#endif
+    }
+
+    void Reactor::run()
+    {
+        std::vector<std::function<void()>> ready;
+#ifdef __linux__
+        epoll_event events[MAX_EVENTS];
+#else
+        std::vector<pollfd> fds;
+        //与 fds[1..] 一一对应的等待序号
+        std::vector<unsigned long long> serials;
+#endif
+        while (true)
+        {
+            int timeout;
+            {
+                LockGuard guard(mutex);
+                if (isStopping)
+                    break;
+                timeout = posted.empty() ? timerWheel.nextTimeout() : 0;
+#ifndef __linux__
+                if (watchesChanged)
+                {
+                    fds.assign(1, pollfd{wakeSock, POLLIN, 0});
+                    serials.assign(1, 0);
+                    for (auto &item : watches)
+                    {
+                        short events = 0;
+                        if (item.second.events & READABLE)
+                            events |= POLLIN;
+                        if (item.second.events & WRITABLE)
+                            events |= POLLOUT;
+                        fds.push_back(pollfd{item.first, events, 0});
+                        serials.push_back(item.second.serial);
+                    }
+                    watchesChanged = false;
+                }
+#endif
+            }
+
+#ifdef __linux__
+            int count = epoll_wait(epollFd, events, MAX_EVENTS, timeout);
+            for (int i = 0; i < count; ++i)
+            {
+                if (events[i].data.fd == wakeFd)
+                {
+                    unsigned long long value;
+                    ssize_t n = read(wakeFd, &value, sizeof(value));
+                    (void)n;
+                    continue;
+                }
+                WaitRes res = (events[i].events & EPOLLERR) ? WaitRes::FAILED
+                                                             : WaitRes::READY;
+                Callback callback = this->takeWatch(events[i].data.fd, 0);
+                if (callback)
+                    callback(res);
+            }
+#else
+            if (fds.empty())
+            {
+                fds.assign(1, pollfd{wakeSock, POLLIN, 0});
+                serials.assign(1, 0);
+            }
+            int count = pollSockets(fds, timeout);
+            if (count > 0 && fds[0].revents != 0)
+            {
+                char buf[64];
+                while (recv(wakeSock, buf, sizeof(buf), 0) > 0)
+                    continue;
+            }
+            for (std::size_t i = 1; count > 0 && i < fds.size(); ++i)
+            {
+                if (fds[i].revents == 0)
+                    continue;
+                WaitRes res = (fds[i].revents & (POLLERR | POLLNVAL))
+                                  ? WaitRes::FAILED
+                                  : WaitRes::READY;
+                Callback callback = this->takeWatch(fds[i].fd, serials[i]);
+                if (callback)
+                    callback(res);
+            }
+#endif
+
+            {
+                LockGuard guard(mutex);
+                ready.swap(posted);
+                timerWheel.advance(ready);
+            }
+            for (auto &func : ready)
+                func();
+            ready.clear();
+        }
+    }
+
+} // namespace utils
@@ -0,0 +1,232 @@
+#include "../include/Resolver.h"
+#include "../include/Reactor.h"
+#include "../include/ScopeGuard.h"
+#include <cstdlib>
+#include <cstring>
+
+namespace
+{
+    using LockGuard = std::lock_guard<std::mutex>;
+
+    std::string cacheKey(const std::string &host, const std::string &port)
+    {
+        return host + '\n' + port;
+    }
+
+    /**
+     * @brief 端口号是否为 1 ~ 65535 的数字
+     */
+    bool parsePort(const std::string &port, unsigned short &value)
+    {
+        if (port.empty() || port.length() > 5 ||
+            port.find_first_not_of("0123456789") != std::string::npos)
+            return false;
+        long number = std::strtol(port.c_str(), nullptr, 10);
+        if (number <= 0 || number > 65535)
+            return false;
+        value = (unsigned short)number;
+        return true;
+    }
+} // namespace
+
+namespace utils
+{
+
+    const std::size_t Resolver::MAX_LOOKUP_THREADS;
+
+    Resolver &Resolver::instance()
+    {
+        static Resolver resolver;
+        return resolver;
+    }
+
+    Resolver::~Resolver()
+    {
+        {
+            LockGuard guard(mutex);
+            isStopping = true;
+        }
+        queueChanged.notify_all();
+        for (std::thread &thread : threads)
+            thread.join();
+    }
+
+    bool Resolver::parseNumeric(const std::string &host,
+                                const std::string &port, Addresses &addresses)
+    {
+        unsigned short portValue;
+        if (!parsePort(port, portValue))
+            return false;
+        ResolvedAddress address;
+        std::memset(&address, 0, sizeof(address));
+        auto *v4 = reinterpret_cast<sockaddr_in *>(&address.addr);
+        auto *v6 = reinterpret_cast<sockaddr_in6 *>(&address.addr);
+        if (inet_pton(AF_INET, host.c_str(), &v4->sin_addr) == 1)
+        {
+            v4->sin_family = AF_INET;
+            v4->sin_port = htons(portValue);
+            address.len = sizeof(sockaddr_in);
+            address.family = AF_INET;
+        }
+        //带 %scope 的链路本地地址交给 getaddrinfo()
+        else if (inet_pton(AF_INET6, host.c_str(), &v6->sin6_addr) == 1)
+        {
+            v6->sin6_family = AF_INET6;
+            v6->sin6_port = htons(portValue);
+            address.len = sizeof(sockaddr_in6);
+            address.family = AF_INET6;
+        }
+        else
+            return false;
+        addresses.assign(1, address);
+        return true;
+    }
+
+    bool Resolver::lookup(const std::string &host, const std::string &port,
+                          Addresses &addresses)
+    {
+        if (!initSockets())
+            return false;
+        addrinfo *result = nullptr;
+        addrinfo hints{};
+        hints.ai_family = AF_UNSPEC; //未指定，IPv4和IPv6均可
+        hints.ai_socktype = SOCK_STREAM;
+        hints.ai_protocol = IPPROTO_TCP;
+        if (getaddrinfo(host.c_str(), port.c_str(), &hints, &result) != 0)
+            return false;
+        ScopeGuard guardFreeAddrinfo([=]() { freeaddrinfo(result); });
+        addresses.clear();
+        for (addrinfo *ptr = result; ptr != nullptr; ptr = ptr->ai_next)
+        {
+            if (ptr->ai_addrlen > sizeof(sockaddr_storage))
+                continue;
+            ResolvedAddress address;
+            std::memset(&address, 0, sizeof(address));
+            std::memcpy(&address.addr, ptr->ai_addr, ptr->ai_addrlen);
+            address.len = socklen_t(ptr->ai_addrlen);
+            address.family = ptr->ai_family;
+            addresses.push_back(address);
+        }
+        return !addresses.empty();
+    }
+
+    bool Resolver::findCached(const std::string &key, Addresses &addresses)
+    {
+        LockGuard guard(mutex);
+        auto iter = cache.find(key);
+        if (iter == cache.end())
+            return false;
+        if (iter->second.expiry <= Clock::now())
+        {
+            cache.erase(iter);
+            return false;
+        }
+        addresses = iter->second.addresses;
+        return true;
+    }
+
+    void Resolver::store(const std::string &key, const Addresses &addresses)
+    {
+        LockGuard guard(mutex);
+        if (ttl <= 0)
+            return;
+        Entry &entry = cache[key];
+        entry.addresses = addresses;
+        entry.expiry = Clock::now() + std::chrono::milliseconds(ttl);
+    }
+
+    bool Resolver::resolve(const std::string &host, const std::string &port,
+                           Addresses &addresses)
+    {
+        if (parseNumeric(host, port, addresses))
+            return true;
+        const std::string key = cacheKey(host, port);
+        if (this->findCached(key, addresses))
+            return true;
+        if (!lookup(host, port, addresses))
+            return false;
+        this->store(key, addresses);
+        return true;
+    }
+
+    void Resolver::asyncResolve(const std::string &host,
+                                const std::string &port, Done done)
+    {
+        Addresses addresses;
+        const std::string key = cacheKey(host, port);
+        if (parseNumeric(host, port, addresses) ||
+            this->findCached(key, addresses))
+        {
+            done(true, std::move(addresses));
+            return;
+        }
+        {
+            LockGuard guard(mutex);
+            std::vector<Done> &list = waiters[key];
+            list.push_back(std::move(done));
+            //已经在解析，等同一个结果即可
+            if (list.size() > 1)
+                return;
+            queue.emplace_back(host, port);
+            //空闲的线程不够时再启动一个，其余的排队
+            if (queue.size() > idleCount && threads.size() < MAX_LOOKUP_THREADS)
+                threads.emplace_back([this]() { this->run(); });
+        }
+        queueChanged.notify_one();
+    }
+
+    void Resolver::setTtl(int ttl)
+    {
+        LockGuard guard(mutex);
+        this->ttl = ttl;
+        if (ttl <= 0)
+            cache.clear();
+    }
+
+    void Resolver::clear()
+    {
+        LockGuard guard(mutex);
+        cache.clear();
+    }
+
+    void Resolver::run()
+    {
+        while (true)
+        {
+            std::pair<std::string, std::string> item;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                ++idleCount;
+                queueChanged.wait(
+                    lock, [this]() { return isStopping || !queue.empty(); });
+                --idleCount;
+                if (isStopping)
+                    return;
+                item = std::move(queue.front());
+                queue.pop_front();
+            }
+            const std::string key = cacheKey(item.first, item.second);
+            Addresses addresses;
+            bool isSucceeded = lookup(item.first, item.second, addresses);
+            if (isSucceeded)
+                this->store(key, addresses);
+
+            std::vector<Done> list;
+            {
+                LockGuard guard(mutex);
+                auto iter = waiters.find(key);
+                if (iter != waiters.end())
+                {
+                    list = std::move(iter->second);
+                    waiters.erase(iter);
+                }
+            }
+            //回调与其他网络事件一样在 Reactor 线程中执行
+            Reactor::instance().post([list, isSucceeded, addresses]() {
+                for (const Done &done : list)
+                    done(isSucceeded, addresses);
+            });
+        }
+    }
+
+} // namespace utils
@@ -0,0 +1,222 @@
+#include "../include/ServerCapabilities.h"
+#include <fstream>
+#include <sstream>
+#include <vector>
+
+namespace
+{
+    using LockGuard = std::lock_guard<std::mutex>;
+    using ftpclient::ServerCapabilities;
+    using ftpclient::Support;
+
+    using FieldList = std::vector<Support ServerCapabilities::*>;
+
+    //文件的第一行，格式改变时增加版本号
+    const char FORMAT_HEADER[] = "ftpclient-capabilities 2";
+
+    //文件中每行的列顺序，地址和端口之后依次为这些成员和 isFeatKnown
+    const FieldList FIELDS = {
+        &ServerCapabilities::epsv,       &ServerCapabilities::pasv,
+        &ServerCapabilities::restStream, &ServerCapabilities::size,
+        &ServerCapabilities::hash,       &ServerCapabilities::xcrc,
+        &ServerCapabilities::modeZ,      &ServerCapabilities::pipelining};
+
+    //没有版本行的旧格式的列顺序，空指针为已不再记录的 MLSD 和 UTF8；
+    //最后的 pipelining 是后加的，更早写入的行没有这一列
+    const FieldList LEGACY_FIELDS = {
+        &ServerCapabilities::epsv,       &ServerCapabilities::pasv,
+        &ServerCapabilities::restStream, &ServerCapabilities::size,
+        nullptr,                         &ServerCapabilities::hash,
+        &ServerCapabilities::xcrc,       &ServerCapabilities::modeZ,
+        nullptr,                         &ServerCapabilities::pipelining};
+    const std::size_t LEGACY_OPTIONAL_FIELDS = 1;
+
+    /**
+     * @brief 按列顺序填写一行中地址和端口之后的各列
+     * @param values 各列的值，最后一列为 isFeatKnown
+     * @param optionalCount fields 末尾可以没有的列数，没有的保持 UNKNOWN
+     * @return 列数不对或值超出范围时返回 false
+     */
+    bool fillFields(const std::vector<int> &values, const FieldList &fields,
+                    std::size_t optionalCount, ServerCapabilities &caps)
+    {
+        if (values.empty())
+            return false;
+        const std::size_t columnCount = values.size() - 1;
+        if (columnCount > fields.size() ||
+            columnCount + optionalCount < fields.size())
+            return false;
+        for (std::size_t i = 0; i < columnCount; ++i)
+        {
+            if (values[i] < 0 || values[i] > 2)
+                return false;
+            if (fields[i] != nullptr)
+                caps.*fields[i] = Support(values[i]);
+        }
+        caps.isFeatKnown = values.back() != 0;
+        return true;
+    }
+
+    Support toSupport(bool isSupported)
+    {
+        return isSupported ? Support::YES : Support::NO;
+    }
+
+    //已经试出结果的不用 FEAT 覆盖，有的服务器 FEAT 列得不全
+    void mergeFeature(Support &field, Support value)
+    {
+        if (field == Support::UNKNOWN)
+            field = value;
+    }
+} // namespace
+
+namespace ftpclient
+{
+
+    RemoteChecksum ServerCapabilities::checksumMethod() const
+    {
+        if (xcrc == Support::YES)
+            return RemoteChecksum::XCRC;
+        if (hash == Support::YES)
+            return RemoteChecksum::HASH_CRC32;
+        return RemoteChecksum::NONE;
+    }
+
+    CapabilityCache &CapabilityCache::instance()
+    {
+        static CapabilityCache cache;
+        return cache;
+    }
+
+    std::string CapabilityCache::keyOf(SOCKET controlSock)
+    {
+        sockaddr_storage addr{};
+        socklen_t addrLen = sizeof(addr);
+        if (getpeername(controlSock, (sockaddr *)&addr, &addrLen) != 0)
+            return std::string();
+        char host[NI_MAXHOST];
+        char port[NI_MAXSERV];
+        if (getnameinfo((sockaddr *)&addr, addrLen, host, sizeof(host), port,
+                        sizeof(port), NI_NUMERICHOST | NI_NUMERICSERV) != 0)
+            return std::string();
+        return std::string(host) + ' ' + port;
+    }
+
+    ServerCapabilities CapabilityCache::get(SOCKET controlSock)
+    {
+        const std::string key = keyOf(controlSock);
+        LockGuard guard(mutex);
+        auto iter = entries.find(key);
+        if (key.empty() || iter == entries.end())
+            return ServerCapabilities();
+        return iter->second;
+    }
+
+    void CapabilityCache::recordFeat(SOCKET controlSock,
+                                     const std::string &reply)
+    {
+        const std::string key = keyOf(controlSock);
+        if (key.empty())
+            return;
+        const RemoteChecksum method = parseChecksumFeature(reply);
+        const bool hasXcrc = method == RemoteChecksum::XCRC;
+        // XCRC 和 HASH 都有时 parseChecksumFeature() 只报告 XCRC
+        const bool hasHash = method == RemoteChecksum::HASH_CRC32 ||
+                             (hasXcrc && hasFeature(reply, "HASH"));
+
+        LockGuard guard(mutex);
+        ServerCapabilities &caps = entries[key];
+        //以下几项只靠 FEAT 判断，不支持 FEAT 的服务器按都不支持处理
+        mergeFeature(caps.hash, toSupport(hasHash));
+        mergeFeature(caps.xcrc, toSupport(hasXcrc));
+        mergeFeature(caps.modeZ, toSupport(hasFeature(reply, "MODE Z")));
+        if (parseReplyCode(reply) == 211)
+        {
+            // EPSV 不一定出现在 FEAT 中，没列出不代表不支持
+            if (hasFeature(reply, "EPSV"))
+                mergeFeature(caps.epsv, Support::YES);
+            mergeFeature(caps.restStream,
+                         toSupport(hasFeature(reply, "REST STREAM")));
+            mergeFeature(caps.size, toSupport(hasFeature(reply, "SIZE")));
+        }
+        caps.isFeatKnown = true;
+        caps.featReply = reply;
+    }
+
+    void CapabilityCache::set(SOCKET controlSock,
+                              Support ServerCapabilities::*field,
+                              Support value)
+    {
+        const std::string key = keyOf(controlSock);
+        if (key.empty())
+            return;
+        LockGuard guard(mutex);
+        entries[key].*field = value;
+    }
+
+    void CapabilityCache::clear()
+    {
+        LockGuard guard(mutex);
+        entries.clear();
+    }
+
+    bool CapabilityCache::load(const std::string &path)
+    {
+        std::ifstream ifs(path);
+        if (!ifs)
+            return false;
+        std::string line;
+        //没有版本行的是旧格式，第一行就是记录
+        const FieldList *fields = &LEGACY_FIELDS;
+        std::size_t optionalCount = LEGACY_OPTIONAL_FIELDS;
+        bool isFirstLine = true;
+        LockGuard guard(mutex);
+        while (std::getline(ifs, line))
+        {
+            if (isFirstLine)
+            {
+                isFirstLine = false;
+                if (line == FORMAT_HEADER)
+                {
+                    fields = &FIELDS;
+                    optionalCount = 0;
+                    continue;
+                }
+            }
+            //"地址 端口 epsv pasv ... pipelining isFeatKnown"，每项为 Support 的值
+            std::istringstream iss(line);
+            std::string host, port;
+            if (!(iss >> host >> port))
+                continue;
+            std::vector<int> values;
+            int value = 0;
+            while (iss >> value)
+                values.push_back(value);
+            ServerCapabilities caps;
+            if (!iss.eof() ||
+                !fillFields(values, *fields, optionalCount, caps))
+                continue;
+            //本次运行中已经得到的记录更新，不覆盖
+            entries.emplace(host + ' ' + port, std::move(caps));
+        }
+        return true;
+    }
+
+    bool CapabilityCache::save(const std::string &path)
+    {
+        std::ofstream ofs(path, std::ios::trunc);
+        if (!ofs)
+            return false;
+        LockGuard guard(mutex);
+        ofs << FORMAT_HEADER << '\n';
+        for (const auto &entry : entries)
+        {
+            ofs << entry.first;
+            for (auto field : FIELDS)
+                ofs << ' ' << int(entry.second.*field);
+            ofs << ' ' << int(entry.second.isFeatKnown) << '\n';
+        }
+        return bool(ofs.flush());
+    }
+
+} // namespace ftpclient
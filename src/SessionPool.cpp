@@ -0,0 +1,102 @@
+#include "../include/SessionPool.h"
+#include "../include/FTPFunction.h"
+#include "../include/MyUtils.h"
+
+namespace
+{
+    void closeControlSock(SOCKET sock)
+    {
+        utils::discardFtpMsgBuffer(sock);
+        closesocket(sock);
+    }
+} // namespace
+
+namespace ftpclient
+{
+
+    const std::size_t SessionPool::MAX_IDLE_PER_HOST;
+    const int SessionPool::MAX_IDLE_SECONDS;
+
+    SessionPool &SessionPool::instance()
+    {
+        static SessionPool pool;
+        return pool;
+    }
+
+    SessionPool::~SessionPool()
+    {
+        //程序退出时其他全局对象可能已析构，只关闭 socket
+        for (auto &item : idle)
+            for (auto &session : item.second)
+                closesocket(session.sock);
+    }
+
+    std::string SessionPool::keyOf(const std::string &hostname, int port,
+                                   const std::string &username)
+    {
+        return username + '@' + hostname + ':' + std::to_string(port);
+    }
+
+    SOCKET SessionPool::acquire(const std::string &hostname, int port,
+                                const std::string &username)
+    {
+        const std::string key = keyOf(hostname, port, username);
+        while (true)
+        {
+            IdleSession session;
+            {
+                std::lock_guard<std::mutex> guard(mutex);
+                auto iter = idle.find(key);
+                if (iter == idle.end() || iter->second.empty())
+                    return INVALID_SOCKET;
+                //取最近归还的，它最可能还活着
+                session = iter->second.back();
+                iter->second.pop_back();
+            }
+            auto idleTime = std::chrono::steady_clock::now() - session.since;
+            if (idleTime > std::chrono::seconds(MAX_IDLE_SECONDS))
+            {
+                closeControlSock(session.sock);
+                continue;
+            }
+            //用 NOOP 检查连接是否还能用
+            std::string errorMsg;
+            if (sendNoopToServer(session.sock, errorMsg) ==
+                CmdToServerRet::SUCCEEDED)
+                return session.sock;
+            closeControlSock(session.sock);
+        }
+    }
+
+    void SessionPool::release(const std::string &hostname, int port,
+                              const std::string &username, SOCKET controlSock)
+    {
+        if (controlSock == INVALID_SOCKET)
+            return;
+        //控制连接上不应再有未读的回复，缓存的残留数据一并丢掉
+        utils::discardFtpMsgBuffer(controlSock);
+        {
+            std::lock_guard<std::mutex> guard(mutex);
+            auto &list = idle[keyOf(hostname, port, username)];
+            if (list.size() < MAX_IDLE_PER_HOST)
+            {
+                list.push_back({controlSock, std::chrono::steady_clock::now()});
+                return;
+            }
+        }
+        closeControlSock(controlSock);
+    }
+
+    void SessionPool::clear()
+    {
+        std::unordered_map<std::string, std::vector<IdleSession>> sessions;
+        {
+            std::lock_guard<std::mutex> guard(mutex);
+            sessions.swap(idle);
+        }
+        for (auto &item : sessions)
+            for (auto &session : item.second)
+                closeControlSock(session.sock);
+    }
+
+} // namespace ftpclient
@@ -0,0 +1,160 @@
+#include "../include/Socket.h"
+#include <algorithm>
+#include <mutex>
+#ifndef _WIN32
+#include <cerrno>
+#include <csignal>
+#include <fcntl.h>
+#include <sys/time.h>
+#endif
+
+namespace utils
+{
+
+    bool initSockets()
+    {
+        static std::once_flag initFlag;
+        static bool succeeded = false;
+        std::call_once(initFlag, []() {
+#ifdef _WIN32
+            WSADATA wsaData;
+            succeeded = WSAStartup(MAKEWORD(2, 2), &wsaData) == 0;
+#else
+            std::signal(SIGPIPE, SIG_IGN);
+            succeeded = true;
+#endif
+        });
+        return succeeded;
+    }
+
+    int lastSocketError()
+    {
+#ifdef _WIN32
+        return WSAGetLastError();
+#else
+        return errno;
+#endif
+    }
+
+    bool isConnectInProgress(int error)
+    {
+#ifdef _WIN32
+        return error == WSAEWOULDBLOCK;
+#else
+        return error == EINPROGRESS;
+#endif
+    }
+
+    std::string peerAddress(SOCKET sock)
+    {
+        sockaddr_storage addr{};
+        socklen_t addrLen = sizeof(addr);
+        if (getpeername(sock, (sockaddr *)&addr, &addrLen) != 0)
+            return std::string();
+        char host[NI_MAXHOST];
+        if (getnameinfo((sockaddr *)&addr, addrLen, host, sizeof(host),
+                        nullptr, 0, NI_NUMERICHOST) != 0)
+            return std::string();
+        return host;
+    }
+
+    bool setSocketTimeout(SOCKET sock, int optname, int timeout)
+    {
+#ifdef _WIN32
+        DWORD value = DWORD(timeout);
+#else
+        timeval value;
+        value.tv_sec = timeout / 1000;
+        value.tv_usec = (timeout % 1000) * 1000;
+#endif
+        return setsockopt(sock, SOL_SOCKET, optname, (const char *)&value,
+                          sizeof(value)) == 0;
+    }
+
+    bool setNonBlocking(SOCKET sock, bool nonBlocking)
+    {
+#ifdef _WIN32
+        u_long mode = nonBlocking ? 1 : 0;
+        return ioctlsocket(sock, FIONBIO, &mode) == 0;
+#else
+        int flags = fcntl(sock, F_GETFL, 0);
+        if (flags < 0)
+            return false;
+        flags = nonBlocking ? (flags | O_NONBLOCK) : (flags & ~O_NONBLOCK);
+        return fcntl(sock, F_SETFL, flags) == 0;
+#endif
+    }
+
+    void prepareSocket(SOCKET sock)
+    {
+#ifndef _WIN32
+        fcntl(sock, F_SETFD, FD_CLOEXEC);
+#endif
+#if defined(SO_NOSIGPIPE) && !defined(MSG_NOSIGNAL)
+        int on = 1;
+        setsockopt(sock, SOL_SOCKET, SO_NOSIGPIPE, &on, sizeof(on));
+#endif
+        (void)sock;
+    }
+
+    SocketProfile controlSocketProfile()
+    {
+        SocketProfile profile;
+        //命令与回复都很短，不等待攒满一个报文段
+        profile.noDelay = true;
+        return profile;
+    }
+
+    SocketProfile dataSocketProfile(long long bytesPerSecond, int rtt,
+                                    const std::string &congestion)
+    {
+        SocketProfile profile;
+        profile.bufferSize = bdpBufferSize(bytesPerSecond, rtt);
+        profile.congestion = congestion;
+        return profile;
+    }
+
+    int bdpBufferSize(long long bytesPerSecond, int rtt)
+    {
+        if (bytesPerSecond <= 0 || rtt <= 0)
+            return 0;
+        const long long granularity = 64 * 1024;
+        long long bdp = bytesPerSecond / 1000 * rtt;
+        bdp = (bdp + granularity - 1) / granularity * granularity;
+        return int(std::max<long long>(
+            MIN_SOCKET_BUFFER_SIZE,
+            std::min<long long>(bdp, MAX_SOCKET_BUFFER_SIZE)));
+    }
+
+    bool applySocketProfile(SOCKET sock, const SocketProfile &profile)
+    {
+        bool isSucceeded = true;
+        int on = profile.noDelay ? 1 : 0;
+        if (setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, (const char *)&on,
+                       sizeof(on)) != 0)
+            isSucceeded = false;
+        if (profile.bufferSize > 0)
+        {
+            int size = profile.bufferSize;
+            if (setsockopt(sock, SOL_SOCKET, SO_SNDBUF, (const char *)&size,
+                           sizeof(size)) != 0)
+                isSucceeded = false;
+            if (setsockopt(sock, SOL_SOCKET, SO_RCVBUF, (const char *)&size,
+                           sizeof(size)) != 0)
+                isSucceeded = false;
+        }
+        if (!profile.congestion.empty())
+        {
+#ifdef TCP_CONGESTION
+            if (setsockopt(sock, IPPROTO_TCP, TCP_CONGESTION,
+                           profile.congestion.c_str(),
+                           socklen_t(profile.congestion.length())) != 0)
+                isSucceeded = false;
+#else
+            isSucceeded = false;
+#endif
+        }
+        return isSucceeded;
+    }
+
+} // namespace utils
@@ -0,0 +1,62 @@
+#include "../include/TransferProgress.h"
+#include <algorithm>
+#include <cmath>
+
+namespace utils
+{
+
+    const int TransferProgress::RATE_SMOOTHING_MS;
+
+    void TransferProgress::reset(long long totalBytes, long long doneBytes)
+    {
+        total.store(totalBytes, std::memory_order_relaxed);
+        done.store(doneBytes, std::memory_order_relaxed);
+        startTime = lastSampleTime = Clock::now();
+        lastSampleBytes = doneBytes;
+        rate = 0;
+        hasRate = false;
+    }
+
+    TransferProgress::Snapshot TransferProgress::sample()
+    {
+        using std::chrono::duration;
+        using std::chrono::duration_cast;
+        using std::chrono::milliseconds;
+
+        Snapshot snapshot;
+        snapshot.doneBytes = done.load(std::memory_order_relaxed);
+        snapshot.totalBytes = total.load(std::memory_order_relaxed);
+        Clock::time_point now = Clock::now();
+        snapshot.elapsedMs =
+            duration_cast<milliseconds>(now - startTime).count();
+
+        double intervalMs =
+            duration<double, std::milli>(now - lastSampleTime).count();
+        //两次采样太近时瞬时速率误差大，沿用上次的结果
+        if (intervalMs >= 1)
+        {
+            double current =
+                (snapshot.doneBytes - lastSampleBytes) * 1000.0 / intervalMs;
+            //按间隔长短决定新样本的权重，定时器不准时也能得到一致的平滑效果
+            double weight = 1 - std::exp(-intervalMs / RATE_SMOOTHING_MS);
+            rate = hasRate ? rate + weight * (current - rate) : current;
+            hasRate = true;
+            lastSampleTime = now;
+            lastSampleBytes = snapshot.doneBytes;
+        }
+        snapshot.bytesPerSecond = rate;
+
+        if (snapshot.totalBytes > 0)
+        {
+            snapshot.percent =
+                int(std::min<long long>(
+                    snapshot.doneBytes * 100 / snapshot.totalBytes, 100));
+            long long remaining = std::max<long long>(
+                snapshot.totalBytes - snapshot.doneBytes, 0);
+            if (rate > 0)
+                snapshot.etaMs = (long long)(remaining * 1000.0 / rate);
+        }
+        return snapshot;
+    }
+
+} // namespace utils
@@ -0,0 +1,570 @@
+#include "../include/TransferScheduler.h"
+#include <QThread>
+#include <QTimer>
+#include <algorithm>
+
+namespace
+{
+    std::string makeHostKey(const std::string &username,
+                            const std::string &hostname, int port)
+    {
+        return username + '@' + hostname + ':' + std::to_string(port);
+    }
+} // namespace
+
+namespace ftpclient
+{
+
+    const int TransferScheduler::DEFAULT_MAX_UPLOADS;
+    const int TransferScheduler::DEFAULT_MAX_DOWNLOADS;
+    const int TransferScheduler::DEFAULT_MAX_PER_HOST;
+
+    TransferScheduler::TransferScheduler(QObject *parent) : QObject(parent) {}
+
+    TransferScheduler::~TransferScheduler()
+    {
+        //停止进行中的传输，任务删除后各自的线程随即退出
+        for (auto &item : entries)
+        {
+            this->stopTask(item.second);
+            this->releaseTask(item.second);
+        }
+        //线程都是调度器的子对象，等它们结束后随调度器删除
+        for (QThread *thread : this->findChildren<QThread *>())
+            thread->wait();
+    }
+
+    void TransferScheduler::setSession(FTPSession *session)
+    {
+        this->session = session;
+        this->scheduleLater();
+    }
+
+    void TransferScheduler::setMaxUploads(int count)
+    {
+        maxUploads = std::max(1, count);
+        this->scheduleLater();
+    }
+
+    void TransferScheduler::setMaxDownloads(int count)
+    {
+        maxDownloads = std::max(1, count);
+        this->scheduleLater();
+    }
+
+    void TransferScheduler::setMaxPerHost(int count)
+    {
+        maxPerHost = std::max(1, count);
+        this->scheduleLater();
+    }
+
+    void TransferScheduler::setGlobalRateLimit(Direction direction,
+                                               long long bytesPerSecond)
+    {
+        if (direction == Direction::UPLOAD)
+            utils::RateLimiter::globalUpload().setLimit(bytesPerSecond);
+        else
+            utils::RateLimiter::globalDownload().setLimit(bytesPerSecond);
+    }
+
+    void TransferScheduler::setRateLimit(int id, long long bytesPerSecond)
+    {
+        auto iter = entries.find(id);
+        if (iter == entries.end())
+            return;
+        Entry &entry = iter->second;
+        entry.rateLimit = bytesPerSecond;
+        if (entry.upload != nullptr)
+            entry.upload->setRateLimit(bytesPerSecond);
+        if (entry.download != nullptr)
+            entry.download->setRateLimit(bytesPerSecond);
+    }
+
+    void TransferScheduler::setVerifyChecksum(bool enable)
+    {
+        verifyChecksum = enable;
+    }
+
+    void TransferScheduler::setCompressionLevel(int level)
+    {
+        compressionLevel = level;
+    }
+
+    void TransferScheduler::setDiskQueueDepth(int depth)
+    {
+        diskQueueDepth = depth;
+    }
+
+    void TransferScheduler::setLinkEstimate(long long bytesPerSecond, int rtt)
+    {
+        socketProfile.bufferSize = utils::bdpBufferSize(bytesPerSecond, rtt);
+    }
+
+    void TransferScheduler::setCongestionControl(const std::string &name)
+    {
+        socketProfile.congestion = name;
+    }
+
+    int TransferScheduler::addUpload(const std::string &localFilepath,
+                                     const std::string &remoteFilepath)
+    {
+        return this->add(Direction::UPLOAD, localFilepath, remoteFilepath);
+    }
+
+    int TransferScheduler::addDownload(const std::string &localFilepath,
+                                       const std::string &remoteFilepath)
+    {
+        return this->add(Direction::DOWNLOAD, localFilepath, remoteFilepath);
+    }
+
+    int TransferScheduler::add(Direction direction,
+                               const std::string &localFilepath,
+                               const std::string &remoteFilepath)
+    {
+        int id = nextId++;
+        Entry &entry = entries[id];
+        entry.item.id = id;
+        entry.item.direction = direction;
+        entry.item.localFilepath = localFilepath;
+        entry.item.remoteFilepath = remoteFilepath;
+        entry.item.state = ItemState::QUEUED;
+        entry.item.percent = 0;
+        entry.item.bytesPerSecond = 0;
+        entry.item.etaMs = -1;
+        //之后切换服务器不影响已添加的任务
+        if (session != nullptr)
+            this->captureLogin(entry);
+        emit itemStateChanged(id, ItemState::QUEUED);
+        this->scheduleLater();
+        return id;
+    }
+
+    void TransferScheduler::pause(int id)
+    {
+        auto iter = entries.find(id);
+        if (iter == entries.end())
+            return;
+        Entry &entry = iter->second;
+        if (entry.item.state == ItemState::RUNNING)
+        {
+            this->stopTask(entry);
+            this->setState(entry, ItemState::PAUSED);
+            this->scheduleLater();
+        }
+        else if (entry.item.state == ItemState::QUEUED)
+            this->setState(entry, ItemState::PAUSED);
+    }
+
+    void TransferScheduler::resume(int id)
+    {
+        auto iter = entries.find(id);
+        if (iter == entries.end())
+            return;
+        Entry &entry = iter->second;
+        if (entry.item.state == ItemState::PAUSED ||
+            entry.item.state == ItemState::FAILED)
+        {
+            entry.item.errorMsg.clear();
+            this->setState(entry, ItemState::QUEUED);
+            this->scheduleLater();
+        }
+    }
+
+    void TransferScheduler::cancel(int id)
+    {
+        auto iter = entries.find(id);
+        if (iter == entries.end())
+            return;
+        if (iter->second.item.state == ItemState::RUNNING)
+            this->scheduleLater();
+        this->stopTask(iter->second);
+        this->releaseTask(iter->second);
+        entries.erase(iter);
+        emit itemRemoved(id);
+    }
+
+    void TransferScheduler::clearDone()
+    {
+        for (auto iter = entries.begin(); iter != entries.end();)
+        {
+            if (iter->second.item.state == ItemState::DONE)
+            {
+                int id = iter->first;
+                iter = entries.erase(iter);
+                emit itemRemoved(id);
+            }
+            else
+                ++iter;
+        }
+    }
+
+    const TransferScheduler::Item *TransferScheduler::item(int id) const
+    {
+        auto iter = entries.find(id);
+        return iter == entries.end() ? nullptr : &iter->second.item;
+    }
+
+    std::vector<TransferScheduler::Item>
+    TransferScheduler::items(Direction direction) const
+    {
+        std::vector<Item> result;
+        for (auto &item : entries)
+            if (item.second.item.direction == direction)
+                result.push_back(item.second.item);
+        return result;
+    }
+
+    void TransferScheduler::scheduleLater()
+    {
+        //连续多次触发（如一次添加多个任务）只调度一次
+        if (isScheduling)
+            return;
+        isScheduling = true;
+        QTimer::singleShot(0, this, [this]() {
+            isScheduling = false;
+            this->schedule();
+        });
+    }
+
+    void TransferScheduler::schedule()
+    {
+        if (session == nullptr)
+            return;
+        //任务在自己的线程中开始，这里不等待，一次启动所有能启动的任务
+        for (auto &item : entries)
+        {
+            Entry &entry = item.second;
+            if (entry.item.state != ItemState::QUEUED)
+                continue;
+            int maxCount = entry.item.direction == Direction::UPLOAD
+                               ? maxUploads
+                               : maxDownloads;
+            if (runningCount(entry.item.direction) >= maxCount)
+                continue;
+            if (entry.hostKey.empty())
+                this->captureLogin(entry);
+            //各任务的主机可能不同，这台主机满了，后面别的主机的任务仍可启动
+            int freeConnections = maxPerHost - connectionCount(entry.hostKey);
+            //上限只够界面的会话时仍让一个任务运行，否则队列永远不会开始
+            if (freeConnections < 1 && !isRunningOnHost(entry.hostKey))
+                freeConnections = 1;
+            if (freeConnections < 1)
+                continue;
+            this->startEntry(entry, freeConnections);
+        }
+    }
+
+    void TransferScheduler::captureLogin(Entry &entry)
+    {
+        entry.hostname = session->getHostname();
+        entry.port = session->getPort();
+        entry.username = session->getUsername();
+        entry.password = session->getPassword();
+        entry.hostKey = makeHostKey(entry.username, entry.hostname, entry.port);
+    }
+
+    void TransferScheduler::startEntry(Entry &entry, int freeConnections)
+    {
+        const int id = entry.item.id;
+        const long long rateLimit = entry.rateLimit;
+        const bool isResume = entry.isResume;
+        this->setState(entry, ItemState::RUNNING);
+        //任务只从会话中取登录信息，这里用添加时记下的
+        FTPSession login(entry.hostname, entry.username, entry.password,
+                         entry.port, false);
+        //设置也在任务的线程中修改，上一次传输可能还没在那里收尾完
+        if (entry.item.direction == Direction::UPLOAD)
+        {
+            entry.connections = 1;
+            if (entry.upload == nullptr)
+            {
+                entry.upload = new UploadFileTask(
+                    login, entry.item.localFilepath,
+                    entry.item.remoteFilepath);
+                this->connectUploadSignals(id, entry.upload);
+                this->moveToTaskThread(entry.upload);
+            }
+            UploadFileTask *task = entry.upload;
+            this->runInTaskThread(
+                task, [task, isResume, rateLimit, checksum = verifyChecksum,
+                       level = compressionLevel, depth = diskQueueDepth,
+                       profile = socketProfile]() {
+                    task->setRateLimit(rateLimit);
+                    task->setVerifyChecksum(checksum);
+                    task->setCompressionLevel(level);
+                    task->setDiskQueueDepth(depth);
+                    task->setSocketProfile(profile);
+                    if (isResume)
+                        task->resume();
+                    else
+                        task->start();
+                });
+        }
+        else
+        {
+            if (entry.download == nullptr)
+            {
+                entry.download = new DownloadFileTask(
+                    login, entry.item.localFilepath,
+                    entry.item.remoteFilepath);
+                this->connectDownloadSignals(id, entry.download);
+                this->moveToTaskThread(entry.download);
+            }
+            //同一主机还有任务在排队时已经是多连接并行，不再分段；否则用上
+            //这台主机空闲的连接。各段的连接在任务结束前一直算在这个任务上，
+            //之后排队的任务要等到有空闲的连接才开始
+            bool isQueuedOnHost = false;
+            for (auto &item : entries)
+                if (item.first != id &&
+                    item.second.item.state == ItemState::QUEUED &&
+                    item.second.hostKey == entry.hostKey)
+                    isQueuedOnHost = true;
+            const int segmentCount =
+                isQueuedOnHost
+                    ? 1
+                    : std::min(freeConnections,
+                               DownloadFileTask::DEFAULT_SEGMENT_COUNT);
+            entry.connections = segmentCount;
+            DownloadFileTask *task = entry.download;
+            this->runInTaskThread(
+                task, [task, isResume, rateLimit, segmentCount,
+                       checksum = verifyChecksum, level = compressionLevel,
+                       depth = diskQueueDepth, profile = socketProfile]() {
+                    task->setRateLimit(rateLimit);
+                    task->setVerifyChecksum(checksum);
+                    task->setCompressionLevel(level);
+                    task->setDiskQueueDepth(depth);
+                    task->setSocketProfile(profile);
+                    task->setSegmentCount(segmentCount);
+                    if (isResume)
+                        task->resume();
+                    else
+                        task->start();
+                });
+        }
+    }
+
+    void TransferScheduler::moveToTaskThread(QObject *task)
+    {
+        QThread *thread = new QThread(this);
+        thread->start();
+        task->moveToThread(thread);
+    }
+
+    void TransferScheduler::runInTaskThread(QObject *task,
+                                            std::function<void()> func)
+    {
+        QMetaObject::invokeMethod(task, std::move(func), Qt::QueuedConnection);
+    }
+
+    void TransferScheduler::runInOwnThread(std::function<void()> func)
+    {
+        QMetaObject::invokeMethod(this, std::move(func), Qt::QueuedConnection);
+    }
+
+    void TransferScheduler::connectUploadSignals(int id, UploadFileTask *task)
+    {
+        //信号在任务的线程中发射，回到调度器的线程再处理
+        auto finishLater = [this, id](ItemState state, std::string errorMsg) {
+            this->runInOwnThread([this, id, state, errorMsg]() {
+                this->finish(id, state, errorMsg);
+            });
+        };
+        //数据开始传输后，失败或暂停再开始才从断点继续；在此之前失败时
+        //服务器上可能还没有这个文件，续传的 SIZE 会得到 550
+        QObject::connect(task, &UploadFileTask::uploadStarted, [this, id]() {
+            this->runInOwnThread([this, id]() { this->markStarted(id); });
+        });
+        QObject::connect(task, &UploadFileTask::uploadSucceeded,
+                         [finishLater]() { finishLater(ItemState::DONE, ""); });
+        QObject::connect(task, &UploadFileTask::uploadFailedWithMsg,
+                         [finishLater](std::string msg) {
+                             finishLater(ItemState::FAILED, std::move(msg));
+                         });
+        QObject::connect(task, &UploadFileTask::uploadFailed, [finishLater]() {
+            finishLater(ItemState::FAILED, "");
+        });
+        QObject::connect(task, &UploadFileTask::uploadChecksumMismatch,
+                         [finishLater]() {
+                             finishLater(ItemState::FAILED, "checksumMismatch");
+                         });
+        QObject::connect(task, &UploadFileTask::readFileError, [finishLater]() {
+            finishLater(ItemState::FAILED, "readFileError");
+        });
+        QObject::connect(
+            task, &UploadFileTask::uploadProgress,
+            [this, id](utils::TransferProgress::Snapshot progress) {
+                this->runInOwnThread([this, id, progress]() {
+                    this->setProgress(id, progress);
+                });
+            });
+    }
+
+    void TransferScheduler::connectDownloadSignals(int id,
+                                                   DownloadFileTask *task)
+    {
+        //信号在任务的线程中发射，回到调度器的线程再处理
+        auto finishLater = [this, id](ItemState state, std::string errorMsg) {
+            this->runInOwnThread([this, id, state, errorMsg]() {
+                this->finish(id, state, errorMsg);
+            });
+        };
+        //与上传相同，开始接收数据后才按续传处理
+        QObject::connect(task, &DownloadFileTask::downloadStarted, [this, id]() {
+            this->runInOwnThread([this, id]() { this->markStarted(id); });
+        });
+        QObject::connect(task, &DownloadFileTask::downloadSucceed,
+                         [finishLater]() { finishLater(ItemState::DONE, ""); });
+        QObject::connect(task, &DownloadFileTask::downloadFailedWithMsg,
+                         [finishLater](std::string msg) {
+                             finishLater(ItemState::FAILED, std::move(msg));
+                         });
+        QObject::connect(task, &DownloadFileTask::downloadFailed,
+                         [finishLater]() {
+                             finishLater(ItemState::FAILED, "");
+                         });
+        QObject::connect(task, &DownloadFileTask::downloadChecksumMismatch,
+                         [finishLater]() {
+                             finishLater(ItemState::FAILED, "checksumMismatch");
+                         });
+        QObject::connect(task, &DownloadFileTask::readFileError,
+                         [finishLater]() {
+                             finishLater(ItemState::FAILED, "readFileError");
+                         });
+        QObject::connect(
+            task, &DownloadFileTask::progressSync,
+            [this, id](utils::TransferProgress::Snapshot progress) {
+                this->runInOwnThread([this, id, progress]() {
+                    this->setProgress(id, progress);
+                });
+            });
+    }
+
+    void TransferScheduler::markStarted(int id)
+    {
+        auto iter = entries.find(id);
+        if (iter != entries.end())
+            iter->second.isResume = true;
+    }
+
+    void TransferScheduler::finish(int id, ItemState state,
+                                   std::string errorMsg)
+    {
+        auto iter = entries.find(id);
+        if (iter == entries.end() ||
+            iter->second.item.state != ItemState::RUNNING)
+            return;
+        Entry &entry = iter->second;
+        //失败时关闭数据连接和控制连接，保留任务以便续传
+        if (state == ItemState::FAILED)
+            this->stopTask(entry);
+        else
+        {
+            this->releaseTask(entry);
+            entry.item.percent = 100;
+        }
+        entry.item.errorMsg = std::move(errorMsg);
+        this->setState(entry, state);
+        this->scheduleLater();
+    }
+
+    void TransferScheduler::stopTask(Entry &entry)
+    {
+        if (entry.item.state != ItemState::RUNNING)
+            return;
+        if (entry.upload != nullptr)
+        {
+            UploadFileTask *task = entry.upload;
+            this->runInTaskThread(task, [task]() { task->stop(); });
+        }
+        if (entry.download != nullptr)
+        {
+            DownloadFileTask *task = entry.download;
+            this->runInTaskThread(task, [task]() { task->stop(); });
+        }
+    }
+
+    void TransferScheduler::releaseTask(Entry &entry)
+    {
+        this->releaseTask(entry.upload);
+        this->releaseTask(entry.download);
+        entry.upload = nullptr;
+        entry.download = nullptr;
+    }
+
+    void TransferScheduler::releaseTask(QObject *task)
+    {
+        if (task == nullptr)
+            return;
+        //任务可能还在自己的线程里等待网络，deleteLater() 等它回到
+        //事件循环后再删除；删除后线程就没事可做了，结束并删除线程
+        QThread *thread = task->thread();
+        QObject::connect(task, &QObject::destroyed, thread, &QThread::quit,
+                         Qt::DirectConnection);
+        QObject::connect(thread, &QThread::finished, thread,
+                         &QObject::deleteLater);
+        task->deleteLater();
+    }
+
+    void TransferScheduler::setState(Entry &entry, ItemState state)
+    {
+        entry.item.state = state;
+        //速率只对进行中的任务有意义
+        if (state != ItemState::RUNNING)
+        {
+            entry.item.bytesPerSecond = 0;
+            entry.item.etaMs = -1;
+        }
+        emit itemStateChanged(entry.item.id, state);
+    }
+
+    void TransferScheduler::setProgress(
+        int id, const utils::TransferProgress::Snapshot &progress)
+    {
+        auto iter = entries.find(id);
+        if (iter == entries.end())
+            return;
+        Item &item = iter->second.item;
+        item.percent = progress.percent;
+        item.bytesPerSecond = progress.bytesPerSecond;
+        item.etaMs = progress.etaMs;
+        emit itemProgressChanged(id);
+    }
+
+    int TransferScheduler::runningCount(Direction direction) const
+    {
+        return int(std::count_if(entries.begin(), entries.end(),
+                                 [direction](const auto &item) {
+                                     return item.second.item.state ==
+                                                ItemState::RUNNING &&
+                                            item.second.item.direction ==
+                                                direction;
+                                 }));
+    }
+
+    bool TransferScheduler::isRunningOnHost(const std::string &hostKey) const
+    {
+        return std::any_of(entries.begin(), entries.end(),
+                           [&hostKey](const auto &item) {
+                               return item.second.item.state ==
+                                          ItemState::RUNNING &&
+                                      item.second.hostKey == hostKey;
+                           });
+    }
+
+    int TransferScheduler::connectionCount(const std::string &hostKey) const
+    {
+        int count = 0;
+        for (auto &item : entries)
+            if (item.second.item.state == ItemState::RUNNING &&
+                item.second.hostKey == hostKey)
+                count += item.second.connections;
+        //界面的会话也登录在这台主机上
+        if (session != nullptr &&
+            makeHostKey(session->getUsername(), session->getHostname(),
+                        session->getPort()) == hostKey)
+            ++count;
+        return count;
+    }
+
+} // namespace ftpclient
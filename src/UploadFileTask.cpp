@@ -1,47 +1,13 @@
 #include "../include/UploadFileTask.h"
 #include "../include/FTPFunction.h"
+#include "../include/FtpReply.h"
 #include "../include/MyUtils.h"
 #include "../include/RunAsyncAwait.h"
-#include <QApplication>
+#include "../include/ServerCapabilities.h"
 #include <QFuture>
 #include <QtConcurrent/QtConcurrent>
 #include <QtDebug>
 #include <memory>
-#include <regex>
-
-namespace
-{
-    enum class RecvMsgAfterUpRes
-    {
-        SUCCEEDED,
-        FAILED_WITH_MSG,
-        FAILED
-    };
-
-    /**
-     * @brief 上传结束后接收服务器的消息
-     * @author zhb
-     * @param controlSock 控制连接
-     * @param errorMsg 出口参数，来自服务的错误消息
-     * @return 结果状态码
-     */
-    RecvMsgAfterUpRes recvMsgAfterUpload(SOCKET controlSock,
-                                         std::string &errorMsg)
-    {
-        std::string recvMsg;
-        int iResult = utils::recvFtpMsg(controlSock, recvMsg);
-        if (iResult <= 0)
-            return RecvMsgAfterUpRes::FAILED;
-        // 226 Successfully transferred "filename"
-        //检查返回码是否为226或250
-        if (!std::regex_search(recvMsg, std::regex(R"(^(226|250).*)")))
-        {
-            errorMsg = std::move(recvMsg);
-            return RecvMsgAfterUpRes::FAILED_WITH_MSG;
-        }
-        return RecvMsgAfterUpRes::SUCCEEDED;
-    }
-} // namespace
 
 namespace ftpclient
 {
@@ -53,7 +19,7 @@ namespace ftpclient
                                    const std::string &localFilepath,
                                    const std::string &remoteFilepath)
         : session(session.getHostname(), session.getUsername(),
-                  session.getPassword(), session.getPort(), false),
+                  session.getPassword(), session.getPort(), false, true),
           localFilepath(localFilepath),
           remoteFilepath(remoteFilepath),
           ifs(localFilepath, std::ios_base::in | std::ios_base::binary),
@@ -62,14 +28,13 @@ namespace ftpclient
           isSetStop(false),
           isAppend(false)
     {
+        //自己的会话作为子对象，任务被移到传输线程时一起移过去
+        //（参数 session 与成员同名，必须写 this->）
+        this->session.setParent(this);
         connectSessionSignals();
     }
 
-    UploadFileTask::~UploadFileTask()
-    {
-        this->quit();
-        WSACleanup();
-    }
+    UploadFileTask::~UploadFileTask() { this->quit(); }
 
     void UploadFileTask::connectSessionSignals()
     {
@@ -98,34 +63,18 @@ namespace ftpclient
                          });
         QObject::connect(&session, &FTPSession::setTransferModeFailed,
                          [this]() { emit uploadFailed(); });
-        //传输模式设置成功
-        //若为续传，先获取文件大小
-        //若非续传，按照既定流程进行
+        //传输模式设置成功，下一步准备传输
         QObject::connect(&session, &FTPSession::setTransferModeSucceeded,
-                         [this]() {
-                             if (isAppend)
-                                 session.getFilesize(remoteFilepath);
-                             else
-                                 this->enterPassiveMode();
-                         });
-        QObject::connect(&session, &FTPSession::getFilesizeFailed,
-                         [this]() { emit uploadFailed(); });
-        QObject::connect(&session, &FTPSession::getFilesizeFailedWithMsg,
-                         [this](std::string msg) {
-                             emit uploadFailedWithMsg(std::move(msg));
-                         });
-        //文件大小获取成功，按照既定流程进行
-        QObject::connect(&session, &FTPSession::getFilesizeSucceeded,
-                         [this](long long filesize) {
-                             this->uploadOffset = filesize;
-                             ifs.seekg(uploadOffset);
-                             this->enterPassiveMode();
+                         [this](bool binaryMode) {
+                             isBinaryMode = binaryMode;
+                             this->prepareTransfer();
                          });
     }
 
     void UploadFileTask::start()
     {
         isAppend = false;
+        uploadOffset = 0;
         isSetStop = false;
         session.connectAndLogin();
     }
@@ -140,114 +89,155 @@ namespace ftpclient
     void UploadFileTask::stop()
     {
         isSetStop = true;
+        //还没开始传输，不必 ABOR，关闭连接让序列马上结束
+        if (preparing)
+        {
+            preparing->stop();
+            this->quit();
+            return;
+        }
         utils::asyncAwait([this]() {
             std::string sendCmd = "ABOR\r\n";
             send(session.getControlSock(), sendCmd.c_str(), sendCmd.length(),
-                 0);
+                 utils::SEND_FLAGS);
             std::string recvMsg;
-            //两种情况：1. 服务器返回 226/225；2. 服务器先返回 426，再返回
-            // 226/225 为了省事这里不检查返回码，只是把缓冲区中的消息吃掉
-            recvMultipleMsg(session.getControlSock(), std::regex("."), recvMsg);
+            //不检查返回码，只是把 ABOR 的回复吃掉
+            recvAborMsg(session.getControlSock(), recvMsg);
         });
         //关闭数据连接和控制连接
         this->quit();
     }
 
-    void UploadFileTask::enterPassiveMode()
+    void UploadFileTask::prepareTransfer()
     {
-        std::string dataHostname;
-        int port;
-        std::string errorMsg;
+        if (isSetStop)
+            return;
+        //各步骤的结果，序列结束前只在 Reactor 线程中访问
+        struct Prepared
+        {
+            long long filesize = 0;
+            SOCKET dataSock = INVALID_SOCKET;
+            bool isDeflate = false;
+        };
+        auto prepared = std::make_shared<Prepared>();
+        const SOCKET controlSock = session.getControlSock();
+        auto seq = CommandSequence::create();
 
-        //先尝试 PASV 模式
-        auto pasvRet = utils::asyncAwait<CmdToServerRet>(
-            putServerIntoPasvMode, session.getControlSock(), port, dataHostname,
-            errorMsg);
-        if (pasvRet == CmdToServerRet::SUCCEEDED)
-            this->dataConnect(dataHostname, port);
-        else if (pasvRet == CmdToServerRet::FAILED_WITH_MSG)
+        //服务器不支持 SIZE 时不知道已经传了多少，从头重新上传
+        if (isAppend &&
+            CapabilityCache::instance().get(controlSock).size == Support::NO)
         {
-            //返回码为500，必须要用EPSV模式
-            if (std::regex_search(errorMsg, std::regex(R"(^500.*)")))
-            {
-                auto epsvRes = utils::asyncAwait<CmdToServerRet>(
-                    putServerIntoEpsvMode, session.getControlSock(), port,
-                    errorMsg);
-                // EPSV模式下，数据连接的主机名与控制连接的相同
-                if (epsvRes == CmdToServerRet::SUCCEEDED)
-                    this->dataConnect(session.getHostname(), port);
-                else if (epsvRes == CmdToServerRet::FAILED_WITH_MSG)
-                    emit uploadFailedWithMsg(std::move(errorMsg));
-                else // SEND_FAILED or RECV_FAILED
-                    emit uploadFailed();
-            }
-            else
-                emit uploadFailedWithMsg(std::move(errorMsg));
+            isAppend = false;
+            uploadOffset = 0;
+            ifs.seekg(0);
         }
-        else // SEND_FAILED or RECV_FAILED
-            emit uploadFailed();
-    }
+        //续传时先获取服务器上已有部分的大小，正常为"213 size"
+        if (isAppend)
+            seq->addCommand(controlSock, "SIZE " + remoteFilepath + "\r\n",
+                            {213}, [prepared](const std::string &reply) {
+                                return parseSizeReply(reply,
+                                                      prepared->filesize);
+                            });
+        //服务器不支持时照常不压缩
+        if (compressionLevel > 0)
+            seq->addDeflateMode(
+                controlSock, compressionLevel,
+                [prepared](bool enabled) { prepared->isDeflate = enabled; });
+        seq->addPassiveConnect(
+            controlSock, UploadFileTask::SOCKET_SEND_TIMEOUT,
+            UploadFileTask::SOCKET_RECV_TIMEOUT, socketProfile,
+            [prepared](SOCKET sock) { prepared->dataSock = sock; });
+        //正常为"150 Opening data connection."
+        seq->addCommand(controlSock,
+                        (isAppend ? "APPE " : "STOR ") + remoteFilepath +
+                            "\r\n",
+                        {150, 125});
 
-    void UploadFileTask::dataConnect(const std::string &hostname, int port)
-    {
-        if (isSetStop)
-            return;
+        using Result = std::pair<CommandSequence::Res, std::string>;
+        preparing = seq;
+        Result res = utils::reactorAwait<Result>(
+            [seq](std::function<void(Result)> finish) {
+                seq->run([finish](CommandSequence::Res res, std::string msg) {
+                    finish(Result(res, std::move(msg)));
+                });
+            });
+        preparing.reset();
 
-        auto res = utils::asyncAwait<ConnectToServerRes>(
-            connectToServer, dataSock, hostname, std::to_string(port),
-            UploadFileTask::SOCKET_SEND_TIMEOUT,
-            UploadFileTask::SOCKET_RECV_TIMEOUT);
-        //数据连接建立失败，发射 uploadFailed 信号
-        if (res != ConnectToServerRes::SUCCEEDED)
-            emit uploadFailed();
-        //数据连接建立成功，向服务器发 STOR 命令请求上传
-        else
+        //序列已结束，数据连接交给 quit() 管理
+        isDeflate = prepared->isDeflate;
+        if (prepared->dataSock != INVALID_SOCKET)
         {
-            this->isDataConnected = true;
-            this->uploadRequest();
+            dataSock = prepared->dataSock;
+            isDataConnected = true;
         }
-    }
-
-    void UploadFileTask::uploadRequest()
-    {
         if (isSetStop)
+        {
+            // stop() 关闭连接时数据连接可能还没交过来
+            this->quit();
             return;
-        std::string errorMsg;
-        auto res = utils::asyncAwait<CmdToServerRet>(
-            requestToUploadToServer, session.getControlSock(), isAppend,
-            remoteFilepath, errorMsg);
-        if (res == CmdToServerRet::SUCCEEDED)
+        }
+        if (res.first == CommandSequence::Res::FAILED_WITH_MSG)
+            emit uploadFailedWithMsg(std::move(res.second));
+        else if (res.first != CommandSequence::Res::SUCCEEDED)
+            emit uploadFailed();
+        else
         {
+            if (isAppend)
+            {
+                this->uploadOffset = prepared->filesize;
+                ifs.seekg(uploadOffset);
+            }
             //服务器同意上传文件
             emit uploadStarted();   //发射 uploadStarted 信号
             this->uploadFileData(); //开始传输文件内容
         }
-        else if (!isSetStop)
-        {
-            if (res == CmdToServerRet::FAILED_WITH_MSG)
-                emit uploadFailedWithMsg(std::move(errorMsg));
-            else // res == SEND_FAILED || res == RECV_FAILED
-                emit uploadFailed();
-        }
     }
 
     void UploadFileTask::uploadFileData()
     {
         std::string errorMsg;
-        int percent = 0, lastPercent = 0;
+        //收到 226 后控制连接可以还回连接池
+        bool isReusable = false;
+        progress.reset(utils::getFilesize(ifs), uploadOffset);
+        const utils::Throttle throttle{&rateLimiter,
+                                       &utils::RateLimiter::globalUpload()};
+        // ASCII 模式下服务器保存的内容与发送的不同，续传时只经手了后半段，
+        //这两种情况都算不出能与服务器比较的 CRC
+        const bool isChecksummed =
+            verifyChecksum && isBinaryMode && uploadOffset == 0;
+        utils::Crc32 checksum;
         QFuture<UploadFileDataRes> upFuture =
-            QtConcurrent::run([this, &percent]() {
-                return uploadFileDataToServer(dataSock, ifs, percent);
+            QtConcurrent::run([this, &throttle, isChecksummed, &checksum]() {
+                auto *crc = isChecksummed ? &checksum : nullptr;
+                //压缩后的数据要经过用户态，不能零拷贝
+                if (isDeflate)
+                    return uploadFileDataDeflate(dataSock, ifs, progress,
+                                                 throttle, crc,
+                                                 compressionLevel, bufferSize);
+                auto res = UploadFileDataRes::ZERO_COPY_UNSUPPORTED;
+                if (zeroCopy && isBinaryMode && !isChecksummed)
+                    res = uploadFileDataZeroCopy(dataSock, localFilepath,
+                                                 uploadOffset, progress,
+                                                 throttle);
+                //不能零拷贝时（ASCII 模式、不是普通文件等）逐块读文件再发送
+                if (res == UploadFileDataRes::ZERO_COPY_UNSUPPORTED &&
+                    diskQueueDepth > 0)
+                    res = uploadFileDataQueued(dataSock, localFilepath,
+                                               uploadOffset, progress, throttle,
+                                               crc, bufferSize, diskQueueDepth);
+                if (res == UploadFileDataRes::ZERO_COPY_UNSUPPORTED ||
+                    res == UploadFileDataRes::DISK_QUEUE_UNSUPPORTED)
+                    res = uploadFileDataToServer(dataSock, ifs, progress,
+                                                 throttle, crc, bufferSize);
+                return res;
             });
-        while (!upFuture.isFinished())
-        {
-            QApplication::processEvents();
-            if (percent != lastPercent)
-            {
-                emit uploadPercentage(percent);
-                lastPercent = percent;
-            }
-        }
+        auto syncProgress = [this]() {
+            emit uploadProgress(progress.sample());
+        };
+        //定时刷新进度，其余时间睡在事件循环里
+        utils::awaitFuture(upFuture, utils::PROGRESS_TICK_INTERVAL,
+                           syncProgress);
+        syncProgress();
 
         //关闭数据连接
         closesocket(dataSock);
@@ -260,11 +250,35 @@ namespace ftpclient
             if (upRes == UploadFileDataRes::SUCCEEDED)
             {
                 // 上传结束，用控制连接接收服务器消息
-                auto recvRes = utils::asyncAwait<RecvMsgAfterUpRes>(
-                    recvMsgAfterUpload, session.getControlSock(), errorMsg);
-                if (recvRes == RecvMsgAfterUpRes::SUCCEEDED)
-                    emit uploadSucceeded();
-                else if (recvRes == RecvMsgAfterUpRes::FAILED_WITH_MSG)
+                auto recvRes = utils::asyncAwait<RecvMultRes>(
+                    recvTransferCompleteMsg, session.getControlSock(),
+                    errorMsg);
+                if (recvRes == RecvMultRes::SUCCEEDED)
+                {
+                    auto verifyRes = VerifyChecksumRes::UNSUPPORTED;
+                    if (isChecksummed)
+                        verifyRes = utils::reactorAwait<VerifyChecksumRes>(
+                            [this, &checksum](
+                                std::function<void(VerifyChecksumRes)> finish) {
+                                asyncVerifyCrc32(
+                                    session.getControlSock(), remoteFilepath,
+                                    checksum.value(),
+                                    CommandSequence::COMMAND_TIMEOUT,
+                                    [finish](VerifyChecksumRes res,
+                                             std::uint32_t) { finish(res); });
+                            });
+                    //等待校验时可能被 stop()，这时连接已关闭，不再发射信号
+                    if (!isSetStop)
+                    {
+                        //校验时网络出错，文件已经传完，只是连接不能再用
+                        isReusable = verifyRes != VerifyChecksumRes::FAILED;
+                        if (verifyRes == VerifyChecksumRes::MISMATCHED)
+                            emit uploadChecksumMismatch();
+                        else
+                            emit uploadSucceeded();
+                    }
+                }
+                else if (recvRes == RecvMultRes::FAILED_WITH_MSG)
                     emit uploadFailedWithMsg(std::move(errorMsg));
                 else // recvRes == FAILED
                     emit uploadFailed();
@@ -275,8 +289,16 @@ namespace ftpclient
                 emit readFileError();
         }
 
-        //关闭控制连接
-        session.quit();
+        //连接池中的连接都是 MODE S
+        if (isReusable && isDeflate)
+            isReusable = utils::asyncAwait<CmdToServerRet>(
+                             enterStreamMode, session.getControlSock(),
+                             errorMsg) == CmdToServerRet::SUCCEEDED;
+        //关闭控制连接或还回连接池
+        if (isReusable)
+            session.releaseToPool();
+        else
+            session.quit();
     }
 
     void UploadFileTask::quit()
@@ -1,13 +1,33 @@
+#include "../include/ServerCapabilities.h"
 #include "../include/mainwindow.h"
 #include <QApplication>
+#include <QDir>
+#include <QStandardPaths>
 
 int main(int argc, char *argv[])
 {
     QApplication::setAttribute(Qt::AA_EnableHighDpiScaling); //添加高分屏支持
     QApplication a(argc, argv);
-    MainWindow w;
-    w.show();
-    w.setWindowIcon(QIcon(":/FTPicon.ico"));
 
-    return a.exec();
+    //服务器能力缓存保存在用户数据目录中，下次启动时不必重新试探
+    const QString dataDir = QStandardPaths::writableLocation(
+        QStandardPaths::AppLocalDataLocation);
+    QDir().mkpath(dataDir);
+    const std::string capabilitiesPath =
+        QDir::toNativeSeparators(dataDir + "/capabilities.txt")
+            .toLocal8Bit()
+            .toStdString();
+    auto &capabilities = ftpclient::CapabilityCache::instance();
+    capabilities.load(capabilitiesPath);
+
+    int ret;
+    {
+        MainWindow w;
+        w.show();
+        w.setWindowIcon(QIcon(":/FTPicon.ico"));
+        ret = a.exec();
+    }
+    //窗口关闭后传输线程都已结束，不会再有新的记录
+    capabilities.save(capabilitiesPath);
+    return ret;
 }
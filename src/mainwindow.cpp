@@ -1,6 +1,4 @@
 #include "../include/mainwindow.h"
-#include "../include/DownloadFileTask.h"
-#include "../include/UploadFileTask.h"
 #include "ui_mainwindow.h"
 #include <QFileDialog>
 #include <QFuture>
@@ -8,6 +6,7 @@
 #include <QMessageBox>
 #include <QtConcurrent/QtConcurrent>
 #include <QtDebug>
+#include <algorithm>
 #include <iostream>
 
 //#define SET_UI_FONT
@@ -15,6 +14,36 @@
 using namespace std;
 using namespace ftpclient;
 
+namespace
+{
+    //速率，如 "1.5 MB/s"
+    QString formatRate(double bytesPerSecond)
+    {
+        const char *units[] = {"B/s", "KB/s", "MB/s", "GB/s"};
+        int unit = 0;
+        while (bytesPerSecond >= 1024 && unit < 3)
+        {
+            bytesPerSecond /= 1024;
+            ++unit;
+        }
+        return QString::number(bytesPerSecond, 'f', unit == 0 ? 0 : 1) + " " +
+               units[unit];
+    }
+
+    //剩余时间，如 "1:05"、"2:03:45"
+    QString formatEta(long long etaMs)
+    {
+        long long seconds = (etaMs + 999) / 1000;
+        QString text = QString("%1:%2")
+                           .arg(seconds / 60 % 60)
+                           .arg(seconds % 60, 2, 10, QChar('0'));
+        if (seconds >= 3600)
+            text = QString::number(seconds / 3600) + ":" +
+                   text.rightJustified(5, '0');
+        return text;
+    }
+} // namespace
+
 MainWindow::MainWindow(QWidget *parent)
     : QMainWindow(parent),
       ui(new Ui::MainWindow),
@@ -33,6 +62,7 @@ MainWindow::MainWindow(QWidget *parent)
     ui->dir->setModel(qml.get());
     ui->uploadListView->setModel(&uploadListModel);
     ui->downloadListView->setModel(&downloadListModel);
+    connectSchedulerSignals();
 
     ui->displayingMsg->append(
         "Welcome to the FTP Client designed by ZHB and ZYC.");
@@ -62,6 +92,7 @@ void MainWindow::on_connectButton_clicked()
         isLogin = false;
         ui->connectButton->setText("连接");
         hideFTPFunction(false);
+        scheduler.setSession(nullptr);
         se->quit();
         se.release();
     }
@@ -74,129 +105,58 @@ void MainWindow::on_connectButton_clicked()
             new FTPSession(hostname.toStdString(), username.toStdString(),
                            password.toStdString()));
         this->initConnection(se.get());
+        scheduler.setSession(se.get());
         // login
         se->connectAndLogin();
     }
 }
 
-void MainWindow::connectUploadSignals(UploadFileTask *task)
+void MainWindow::connectSchedulerSignals()
 {
-    QObject::connect(task, &UploadFileTask::uploadStarted, [this]() {
-        uploadStatus = TransStatus::RUNNING;
-
-        ui->uploadPauseResumeButton->setText("暂停");
-        ui->uploadPauseResumeButton->setVisible(true);
-        ui->uploadStopButton->setVisible(true);
-        ui->uploadProgressBar->setValue(0);
-        ui->uploadProgressBar->setVisible(true);
-
-        ui->displayingMsg->append("uploadStarted");
-    });
-
-    QObject::connect(task, &UploadFileTask::uploadSucceeded, [this]() {
-        uploadStatus = TransStatus::FREE;
-        uploadEndedUISchedule();
-
-        ui->displayingMsg->append("uploadSucceeded");
-        QMessageBox::about(this, "上传成功", "上传成功");
-        se->listWorkingDir(); //刷新目录
-    });
-
-    QObject::connect(
-        task, &UploadFileTask::uploadFailedWithMsg,
-        [this](std::string errorMsg) {
-            uploadStatus = TransStatus::FREE;
-            runningUploadTask->stop();
-            uploadEndedUISchedule();
-
-            QMessageBox::about(this, "错误",
-                               "uploadFailedWithMsg" +
-                                   QString::fromStdString(errorMsg));
-            ui->displayingMsg->append("uploadFailedWithMsg");
-            ui->displayingMsg->append(QString::fromStdString(errorMsg));
-        });
-
-    QObject::connect(task, &UploadFileTask::uploadFailed, [this]() {
-        uploadStatus = TransStatus::FREE;
-        runningUploadTask->stop();
-        uploadEndedUISchedule();
-
-        ui->displayingMsg->append("uploadFailed");
-        QMessageBox::about(this, "错误", "uploadFailed");
-    });
-
-    QObject::connect(task, &UploadFileTask::readFileError, [this]() {
-        uploadStatus = TransStatus::FREE;
-        runningUploadTask->stop();
-        uploadEndedUISchedule();
-
-        ui->displayingMsg->append("readFileError");
-        QMessageBox::about(this, "错误", "readFileError");
-    });
-
-    QObject::connect(task, &UploadFileTask::uploadPercentage,
-                     [this](int percentage) {
-                         qDebug() << "percentage: " << percentage << "%";
-                         ui->uploadProgressBar->setValue(percentage);
-                     });
-}
-
-void MainWindow::connectDownloadSignals(DownloadFileTask *task)
-{
-    QObject::connect(task, &DownloadFileTask::downloadStarted, [this]() {
-        downloadStatus = TransStatus::RUNNING;
-
-        ui->downloadPauseResumeButton->setText("暂停");
-        ui->downloadPauseResumeButton->setVisible(true);
-        ui->downloadStopButton->setVisible(true);
-        ui->downloadProgressBar->setVisible(true);
-        ui->downloadProgressBar->setValue(0);
-
-        ui->displayingMsg->append("DownloadStarted");
-    });
-
-    QObject::connect(task, &DownloadFileTask::downloadSucceed, [this]() {
-        downloadStatus = TransStatus::FREE;
-        downloadEndedUISchedule();
-
-        ui->displayingMsg->append("DownloadSucceeded");
-        QMessageBox::about(this, "下载成功", "下载成功");
-    });
-
     QObject::connect(
-        task, &DownloadFileTask::downloadFailedWithMsg,
-        [this](std::string errorMsg) {
-            downloadStatus = TransStatus::FREE;
-            runningDownloadTask->stop();
-            downloadEndedUISchedule();
-
-            ui->displayingMsg->append("DownloadFailedWithMsg");
-            ui->displayingMsg->append(QString::fromStdString(errorMsg));
-            QMessageBox::about(this, "错误",
-                               "DownloadFailedWithMsg" +
-                                   QString::fromStdString(errorMsg));
+        &scheduler, &TransferScheduler::itemStateChanged,
+        [this](int id, ItemState state) {
+            updateTransferRow(id);
+            const TransferScheduler::Item *item = scheduler.item(id);
+            bool isUpload = item->direction == Direction::UPLOAD;
+            QString name = transferNames[id];
+            if (state == ItemState::DONE)
+            {
+                ui->displayingMsg->append(
+                    (isUpload ? "uploadSucceeded: " : "DownloadSucceeded: ") +
+                    name);
+                //一批上传全部结束后再刷新目录
+                auto uploads = scheduler.items(Direction::UPLOAD);
+                bool isUploading = std::any_of(
+                    uploads.begin(), uploads.end(), [](const auto &upload) {
+                        return upload.state == ItemState::QUEUED ||
+                               upload.state == ItemState::RUNNING;
+                    });
+                if (isUpload && !isUploading && se)
+                    se->listWorkingDir();
+            }
+            else if (state == ItemState::FAILED)
+            {
+                ui->displayingMsg->append(
+                    (isUpload ? "uploadFailed: " : "DownloadFailed: ") + name);
+                if (!item->errorMsg.empty())
+                    ui->displayingMsg->append(
+                        QString::fromStdString(item->errorMsg));
+            }
         });
 
-    QObject::connect(task, &DownloadFileTask::downloadFailed, [this]() {
-        downloadStatus = TransStatus::FREE;
-        runningDownloadTask->stop();
-        downloadEndedUISchedule();
+    QObject::connect(&scheduler, &TransferScheduler::itemProgressChanged,
+                     [this](int id) { updateTransferRow(id); });
 
-        ui->displayingMsg->append("DownloadFailed");
-        QMessageBox::about(this, "错误", "DownloadFailed");
-    });
+    QObject::connect(&scheduler, &TransferScheduler::itemRemoved,
+                     [this](int id) { removeTransferRow(id); });
 
-    QObject::connect(task, &DownloadFileTask::readFileError, [this]() {
-        downloadStatus = TransStatus::FREE;
-        runningDownloadTask->stop();
-
-        ui->displayingMsg->append("readFileError");
-        QMessageBox::about(this, "错误", "readFileError");
+    //选中的任务变了，暂停/恢复按钮的文字跟着变
+    QObject::connect(ui->uploadListView, &QListView::clicked, [this]() {
+        updateTransferControls(Direction::UPLOAD);
     });
-
-    QObject::connect(task, &DownloadFileTask::percentSync, [this](int percent) {
-        qDebug() << "percentage: " << percent << "%";
-        ui->downloadProgressBar->setValue(percent);
+    QObject::connect(ui->downloadListView, &QListView::clicked, [this]() {
+        updateTransferControls(Direction::DOWNLOAD);
     });
 }
 
@@ -515,131 +475,150 @@ void MainWindow::initConnection(FTPSession *se)
     });
 }
 
-void MainWindow::uploadEndedUISchedule()
-{
-    runningUploadTask.release();
-    popUpload();
-    ui->uploadProgressBar->setVisible(false);
-    ui->uploadPauseResumeButton->setVisible(false);
-    ui->uploadStopButton->setVisible(false);
-    scheduleUploadQueue();
-}
-
-void MainWindow::downloadEndedUISchedule()
+void MainWindow::updateTransferRow(int id)
 {
-    runningDownloadTask.release();
-    popDownload();
-    ui->downloadProgressBar->setVisible(false);
-    ui->downloadPauseResumeButton->setVisible(false);
-    ui->downloadStopButton->setVisible(false);
-    scheduleDownloadQueue();
-}
-
-void MainWindow::scheduleUploadQueue()
-{
-    if (!uploadQueue.empty() && uploadStatus == TransStatus::FREE)
+    const TransferScheduler::Item *item = scheduler.item(id);
+    if (item == nullptr)
+        return;
+    bool isUpload = item->direction == Direction::UPLOAD;
+    std::vector<int> &ids = isUpload ? uploadIds : downloadIds;
+    QStringListModel &model = isUpload ? uploadListModel : downloadListModel;
+
+    QString text = transferNames[id] + "  ";
+    switch (item->state)
     {
-        std::string localFilepath, remoteFilepath;
-        std::tie(localFilepath, remoteFilepath) = uploadQueue.front();
-        runningUploadTask = std::unique_ptr<UploadFileTask>(
-            new UploadFileTask(*se, localFilepath, remoteFilepath));
-        connectUploadSignals(runningUploadTask.get());
-        runningUploadTask->start();
+    case ItemState::QUEUED:
+        text += "[排队中]";
+        break;
+    case ItemState::RUNNING:
+        text += "[" + QString::number(item->percent) + "%";
+        if (item->bytesPerSecond > 0)
+            text += " " + formatRate(item->bytesPerSecond);
+        if (item->etaMs >= 0)
+            text += " 剩余 " + formatEta(item->etaMs);
+        text += "]";
+        break;
+    case ItemState::PAUSED:
+        text += "[暂停]";
+        break;
+    case ItemState::FAILED:
+        text += "[失败]";
+        break;
+    case ItemState::DONE:
+        text += "[完成]";
+        break;
     }
-}
 
-void MainWindow::scheduleDownloadQueue()
-{
-    if (!downloadQueue.empty() && downloadStatus == TransStatus::FREE)
+    auto iter = std::find(ids.begin(), ids.end(), id);
+    if (iter == ids.end())
     {
-        std::string localFilepath, remoteFilepath;
-        std::tie(localFilepath, remoteFilepath) = downloadQueue.front();
-        runningDownloadTask = std::unique_ptr<DownloadFileTask>(
-            new DownloadFileTask(*se, localFilepath, remoteFilepath));
-        connectDownloadSignals(runningDownloadTask.get());
-        runningDownloadTask->start();
+        ids.push_back(id);
+        model.insertRow(model.rowCount());
+        iter = ids.end() - 1;
     }
+    model.setData(model.index(int(iter - ids.begin())), text);
+    updateTransferControls(item->direction);
 }
 
-void MainWindow::pushUpload(const QString &filename,
-                            const std::string &localFilepath,
-                            const std::string &remoteFilepath)
+void MainWindow::removeTransferRow(int id)
 {
-    uploadListModel.insertRow(uploadListModel.rowCount());
-    QModelIndex index = uploadListModel.index(uploadListModel.rowCount() - 1);
-    uploadListModel.setData(index, filename);
-    uploadQueue.push_back({localFilepath, remoteFilepath});
-}
-
-void MainWindow::pushDownload(const QString &filename,
-                              const std::string &localFilepath,
-                              const std::string &remoteFilepath)
-{
-    downloadListModel.insertRow(downloadListModel.rowCount());
-    QModelIndex index =
-        downloadListModel.index(downloadListModel.rowCount() - 1);
-    downloadListModel.setData(index, filename);
-    downloadQueue.push_back({localFilepath, remoteFilepath});
+    for (Direction direction : {Direction::UPLOAD, Direction::DOWNLOAD})
+    {
+        bool isUpload = direction == Direction::UPLOAD;
+        std::vector<int> &ids = isUpload ? uploadIds : downloadIds;
+        QStringListModel &model =
+            isUpload ? uploadListModel : downloadListModel;
+        auto iter = std::find(ids.begin(), ids.end(), id);
+        if (iter != ids.end())
+        {
+            model.removeRow(int(iter - ids.begin()));
+            ids.erase(iter);
+            updateTransferControls(direction);
+        }
+    }
+    transferNames.erase(id);
 }
 
-void MainWindow::popUpload()
+void MainWindow::updateTransferControls(Direction direction)
 {
-    if (!uploadQueue.empty())
+    bool isUpload = direction == Direction::UPLOAD;
+    QProgressBar *progressBar =
+        isUpload ? ui->uploadProgressBar : ui->downloadProgressBar;
+    QPushButton *pauseResumeButton =
+        isUpload ? ui->uploadPauseResumeButton : ui->downloadPauseResumeButton;
+    QPushButton *stopButton =
+        isUpload ? ui->uploadStopButton : ui->downloadStopButton;
+
+    //总进度：已完成的算 100%
+    auto items = scheduler.items(direction);
+    int percentSum = 0;
+    bool isAllDone = true;
+    for (auto &item : items)
     {
-        uploadQueue.pop_front();
-        uploadListModel.removeRow(0);
+        percentSum += item.state == ItemState::DONE ? 100 : item.percent;
+        if (item.state != ItemState::DONE)
+            isAllDone = false;
     }
+    progressBar->setVisible(!items.empty() && !isAllDone);
+    if (!items.empty())
+        progressBar->setValue(percentSum / int(items.size()));
+
+    int id = selectedTransfer(direction);
+    const TransferScheduler::Item *item = scheduler.item(id);
+    pauseResumeButton->setVisible(item != nullptr &&
+                                  item->state != ItemState::DONE);
+    stopButton->setVisible(item != nullptr);
+    if (item != nullptr && (item->state == ItemState::PAUSED ||
+                            item->state == ItemState::FAILED))
+        pauseResumeButton->setText("恢复");
+    else
+        pauseResumeButton->setText("暂停");
 }
 
-void MainWindow::popDownload()
+int MainWindow::selectedTransfer(Direction direction) const
 {
-    if (!downloadQueue.empty())
-    {
-        downloadQueue.pop_front();
-        downloadListModel.removeRow(0);
-    }
+    bool isUpload = direction == Direction::UPLOAD;
+    const std::vector<int> &ids = isUpload ? uploadIds : downloadIds;
+    QListView *listView =
+        isUpload ? ui->uploadListView : ui->downloadListView;
+    if (ids.empty())
+        return -1;
+    int row = listView->currentIndex().row();
+    if (row < 0 || row >= int(ids.size()))
+        row = 0;
+    return ids[row];
 }
 
 void MainWindow::on_uploadPauseResumeButton_clicked()
 {
-    if (uploadStatus == TransStatus::RUNNING)
-    {
-        uploadStatus = TransStatus::PAUSE;
-        runningUploadTask->stop();
-        ui->uploadPauseResumeButton->setText("恢复");
-    }
+    int id = selectedTransfer(Direction::UPLOAD);
+    const TransferScheduler::Item *item = scheduler.item(id);
+    if (item == nullptr)
+        return;
+    if (item->state == ItemState::PAUSED || item->state == ItemState::FAILED)
+        scheduler.resume(id);
     else
-    {
-        runningUploadTask->resume();
-    }
+        scheduler.pause(id);
 }
 void MainWindow::on_uploadStopButton_clicked()
 {
-    if (uploadStatus == TransStatus::RUNNING)
-        runningUploadTask->stop();
-    uploadStatus = TransStatus::FREE;
-    uploadEndedUISchedule();
+    scheduler.cancel(selectedTransfer(Direction::UPLOAD));
 }
 
 void MainWindow::on_downloadPauseResumeButton_clicked()
 {
-    if (downloadStatus == TransStatus::RUNNING)
-    {
-        downloadStatus = TransStatus::PAUSE;
-        runningDownloadTask->stop();
-        ui->downloadPauseResumeButton->setText("恢复");
-    }
+    int id = selectedTransfer(Direction::DOWNLOAD);
+    const TransferScheduler::Item *item = scheduler.item(id);
+    if (item == nullptr)
+        return;
+    if (item->state == ItemState::PAUSED || item->state == ItemState::FAILED)
+        scheduler.resume(id);
     else
-    {
-        runningDownloadTask->resume();
-    }
+        scheduler.pause(id);
 }
 void MainWindow::on_downloadStopButton_clicked()
 {
-    if (downloadStatus == TransStatus::RUNNING)
-        runningDownloadTask->stop();
-    downloadStatus = TransStatus::FREE;
-    downloadEndedUISchedule();
+    scheduler.cancel(selectedTransfer(Direction::DOWNLOAD));
 }
 
 void MainWindow::on_upload_clicked()
@@ -653,8 +632,10 @@ void MainWindow::on_upload_clicked()
         std::string remoteFilepath = currentDir + "/" + filename.toStdString();
         qDebug() << "upload local filepath:" << localFilepath;
         qDebug() << "upload remote filepath:" << remoteFilepath.data();
-        pushUpload(filename, localFilepath.toStdString(), remoteFilepath);
-        scheduleUploadQueue();
+        int id =
+            scheduler.addUpload(localFilepath.toStdString(), remoteFilepath);
+        transferNames[id] = filename;
+        updateTransferRow(id);
     }
     else
         ui->displayingMsg->append("User did not choose a file.");
@@ -674,8 +655,10 @@ void MainWindow::on_download_clicked()
         std::string remoteFilepath = currentDir + "/" + currentItem;
         qDebug() << "download local filepath:" << localFilepath;
         qDebug() << "download remote filepath:" << remoteFilepath.data();
-        pushDownload(filename, localFilepath.toStdString(), remoteFilepath);
-        scheduleDownloadQueue();
+        int id = scheduler.addDownload(localFilepath.toStdString(),
+                                       remoteFilepath);
+        transferNames[id] = filename;
+        updateTransferRow(id);
     }
     else
         ui->displayingMsg->append("User did not choose a file.");
@@ -1,11 +1,18 @@
 //测试用代码
 // by zhb
+#include "../include/DownloadFileTask.h"
 #include "../include/FTPSession.h"
+#include "../include/ServerCapabilities.h"
 #include "../include/UploadFileTask.h"
 #include <QFuture>
+#include <QTimer>
 #include <QtConcurrent/QtConcurrent>
 #include <QtDebug>
+#include <algorithm>
+#include <fstream>
 #include <iostream>
+#include <iterator>
+#include <memory>
 #include <string>
 #include <vector>
 
@@ -41,9 +48,9 @@ void connectUploadSignals(UploadFileTask *task)
                      []() { qDebug("uploadFailed"); });
     QObject::connect(task, &UploadFileTask::readFileError,
                      []() { qDebug("readFileError"); });
-    QObject::connect(task, &UploadFileTask::uploadPercentage,
-                     [](int percentage) {
-                         qDebug() << "percentage: " << percentage << "%";
+    QObject::connect(task, &UploadFileTask::uploadProgress,
+                     [](utils::TransferProgress::Snapshot progress) {
+                         qDebug() << "percentage: " << progress.percent << "%";
                      });
 }
 
@@ -195,3 +202,122 @@ void test_z()
 
     se->connectAndLogin();
 }
+
+//两个文件内容是否相同
+bool isSameFile(const string &path1, const string &path2)
+{
+    std::ifstream ifs1(path1, std::ios::binary);
+    std::ifstream ifs2(path2, std::ios::binary);
+    if (!ifs1 || !ifs2)
+        return false;
+    return std::equal(std::istreambuf_iterator<char>(ifs1),
+                      std::istreambuf_iterator<char>(),
+                      std::istreambuf_iterator<char>(ifs2),
+                      std::istreambuf_iterator<char>());
+}
+
+//分段下载到一半时暂停，1 秒后续传，完成后与服务器上的原文件比较
+//服务器在本机，原文件应大于 DownloadFileTask::MIN_SEGMENTED_FILESIZE
+void test_segmented_resume()
+{
+    const auto &test = testcases[1];
+    FTPSession *se =
+        new FTPSession(test.hostname, test.username, test.password);
+    const string remoteFilepath = "aa/big.bin";
+    const string localFilepath = "C:/Users/zhb/Desktop/ftpclient/big.bin";
+    //服务器根目录下的同一个文件
+    const string originalFilepath = "C:/ftproot/test01/aa/big.bin";
+
+    DownloadFileTask *task =
+        new DownloadFileTask(*se, localFilepath, remoteFilepath);
+    task->setSegmentCount(4);
+    //限速，保证暂停时还没下完
+    task->setRateLimit(4 * 1024 * 1024);
+
+    auto isPaused = std::make_shared<bool>(false);
+    QObject::connect(
+        task, &DownloadFileTask::progressSync,
+        [task, isPaused](utils::TransferProgress::Snapshot progress) {
+            qDebug() << "percentage: " << progress.percent << "%";
+            if (*isPaused || progress.percent < 10)
+                return;
+            *isPaused = true;
+            qDebug("pause");
+            //不在进度信号里停止，等分段下载的等待返回
+            QTimer::singleShot(0, [task]() { task->stop(); });
+            QTimer::singleShot(1000, [task]() {
+                qDebug("resume");
+                task->resume();
+            });
+        });
+    QObject::connect(task, &DownloadFileTask::downloadSucceed,
+                     [localFilepath, originalFilepath]() {
+                         qDebug("downloadSucceed");
+                         if (isSameFile(localFilepath, originalFilepath))
+                             qDebug("segmented resume: file matches");
+                         else
+                             qDebug("segmented resume: file MISMATCHED");
+                     });
+    QObject::connect(task, &DownloadFileTask::downloadFailedWithMsg,
+                     [](string msg) {
+                         qDebug("downloadFailedWithMsg");
+                         qDebug() << "msg: " << msg.data();
+                     });
+    QObject::connect(task, &DownloadFileTask::downloadFailed,
+                     []() { qDebug("downloadFailed"); });
+    QObject::connect(task, &DownloadFileTask::readFileError,
+                     []() { qDebug("readFileError"); });
+    task->start();
+}
+
+//读出整个文件
+string readWholeFile(const string &path)
+{
+    std::ifstream ifs(path, std::ios::binary);
+    return string(std::istreambuf_iterator<char>(ifs),
+                  std::istreambuf_iterator<char>());
+}
+
+//没有版本行的旧能力文件读入后按新格式保存，再读入、保存一次结果不变
+//会清空全局的 CapabilityCache
+void test_capability_legacy_load()
+{
+    struct LegacyCase
+    {
+        string name;
+        //旧文件中的一行
+        string legacyLine;
+        //按新格式保存后的一行
+        string savedLine;
+    };
+    const vector<LegacyCase> cases = {
+        //地址、端口之后为 epsv pasv rest size mlsd hash xcrc modeZ utf8，
+        //再加 isFeatKnown
+        {"without pipelining", "192.168.1.2 21 1 1 1 2 1 1 2 1 1 1",
+         "192.168.1.2 21 1 1 1 2 1 2 1 0 1"},
+        //在 utf8 之后多一列 pipelining
+        {"with pipelining", "192.168.1.3 21 2 1 1 1 0 2 1 0 1 1 0",
+         "192.168.1.3 21 2 1 1 1 2 1 0 1 0"}};
+    const string legacyPath = "capabilities_legacy.txt";
+    const string savedPath = "capabilities_saved.txt";
+    const string resavedPath = "capabilities_resaved.txt";
+    auto &cache = CapabilityCache::instance();
+    for (const auto &test : cases)
+    {
+        std::ofstream(legacyPath) << test.legacyLine << '\n';
+        cache.clear();
+        bool isOk = cache.load(legacyPath) && cache.save(savedPath);
+        const string saved = readWholeFile(savedPath);
+        //第一行是格式版本
+        const auto lineStart = saved.find('\n') + 1;
+        isOk = isOk && lineStart != 0 &&
+               saved.substr(lineStart) == test.savedLine + '\n';
+        //新格式读入后再保存，内容不变
+        cache.clear();
+        isOk = isOk && cache.load(savedPath) && cache.save(resavedPath) &&
+               readWholeFile(resavedPath) == saved;
+        qDebug() << "legacy capabilities," << test.name.data() << ":"
+                 << (isOk ? "OK" : "FAILED");
+    }
+    cache.clear();
+}
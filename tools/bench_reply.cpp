@@ -0,0 +1,156 @@
+//回复解析的微基准测试
+//对比旧的 std::regex 写法与 FtpReply.h 中的解析函数，每秒能处理多少条命令的回复
+//只测解析部分，不涉及网络
+//
+//编译运行：
+//  g++ -std=c++17 -O2 tools/bench_reply.cpp src/FtpReply.cpp -o bench_reply
+//  ./bench_reply
+#include "../include/FtpReply.h"
+#include <chrono>
+#include <cstdio>
+#include <regex>
+#include <string>
+#include <vector>
+
+namespace
+{
+    //一组典型的回复，与各个命令包装函数一一对应
+    enum class Kind
+    {
+        PASV,
+        EPSV,
+        SIZE,
+        PWD,
+        SIMPLE
+    };
+
+    struct Sample
+    {
+        Kind kind;
+        std::string reply;
+    };
+
+    const std::vector<Sample> samples = {
+        {Kind::PASV, "227 Entering Passive Mode (192,168,1,20,195,80)\r\n"},
+        {Kind::EPSV, "229 Entering Extended Passive Mode (|||50000|)\r\n"},
+        {Kind::SIZE, "213 1073741824\r\n"},
+        {Kind::PWD, "257 \"/home/ftp/data\" is current directory.\r\n"},
+        {Kind::SIMPLE, "250 CWD successful. \"/data\" is current directory.\r\n"},
+        {Kind::SIMPLE, "200 Type set to I\r\n"},
+        {Kind::SIMPLE, "150 Opening data channel for file transfer.\r\n"},
+        {Kind::SIMPLE, "350 Restarting at 1048576.\r\n"},
+    };
+
+    // 旧写法：每次调用都构造正则，再用正则迭代器取出参数
+    long long oldWay(const Sample &sample)
+    {
+        const std::string &msg = sample.reply;
+        switch (sample.kind)
+        {
+        case Kind::PASV:
+        {
+            std::regex e(R"(^227\s.*\(\d+,\d+,\d+,\d+,\d+,\d+\))");
+            if (!std::regex_search(msg, e))
+                return -1;
+            std::regex p(R"(\((\d+),(\d+),(\d+),(\d+),(\d+),(\d+)\))");
+            std::sregex_iterator iter(msg.begin(), msg.end(), p);
+            return std::stoi((*iter)[5].str()) * 256 +
+                   std::stoi((*iter)[6].str());
+        }
+        case Kind::EPSV:
+        {
+            std::regex e(R"(^229\s.*\(\|\|\|\d+\|\))");
+            if (!std::regex_search(msg, e))
+                return -1;
+            std::regex p(R"(\(\|\|\|(\d+)\|\))");
+            std::sregex_iterator iter(msg.begin(), msg.end(), p);
+            return std::stoi((*iter)[1]);
+        }
+        case Kind::SIZE:
+        {
+            std::regex e(R"(^213\s+\d+)");
+            if (!std::regex_search(msg, e))
+                return -1;
+            std::regex p(R"(^213\s+(\d+))");
+            std::sregex_iterator iter(msg.begin(), msg.end(), p);
+            return std::stoll((*iter)[1]);
+        }
+        case Kind::PWD:
+        {
+            std::regex e(R"(^257\s+".+")");
+            if (!std::regex_search(msg, e))
+                return -1;
+            std::regex p("\"(.+)\"");
+            std::sregex_iterator iter(msg.begin(), msg.end(), p);
+            return (long long)(*iter)[1].str().length();
+        }
+        default:
+        {
+            std::regex e(R"(^(150|125|200|250|350)\s+)");
+            return std::regex_search(msg, e) ? 0 : -1;
+        }
+        }
+    }
+
+    long long newWay(const Sample &sample)
+    {
+        std::string_view msg = sample.reply;
+        switch (sample.kind)
+        {
+        case Kind::PASV:
+        {
+            int host[4], port;
+            return ftpclient::parsePasvReply(msg, host, port) ? port : -1;
+        }
+        case Kind::EPSV:
+        {
+            int port;
+            return ftpclient::parseEpsvReply(msg, port) ? port : -1;
+        }
+        case Kind::SIZE:
+        {
+            long long size;
+            return ftpclient::parseSizeReply(msg, size) ? size : -1;
+        }
+        case Kind::PWD:
+        {
+            std::string_view path;
+            return ftpclient::parsePathReply(msg, path)
+                       ? (long long)path.length()
+                       : -1;
+        }
+        default:
+            return ftpclient::replyCodeIn(msg, {150, 125, 200, 250, 350}) ? 0
+                                                                          : -1;
+        }
+    }
+
+    /**
+     * @brief 运行若干轮，返回每秒处理的回复条数
+     */
+    template <class Parse>
+    double repliesPerSecond(Parse parse, int rounds, long long &checksum)
+    {
+        auto begin = std::chrono::steady_clock::now();
+        for (int i = 0; i < rounds; ++i)
+            for (const Sample &sample : samples)
+                checksum += parse(sample);
+        auto end = std::chrono::steady_clock::now();
+        double seconds = std::chrono::duration<double>(end - begin).count();
+        return double(rounds) * samples.size() / seconds;
+    }
+} // namespace
+
+int main()
+{
+    long long checksumOld = 0, checksumNew = 0;
+    double oldRate = repliesPerSecond(oldWay, 20000, checksumOld);
+    double newRate = repliesPerSecond(newWay, 2000000, checksumNew);
+    std::printf("std::regex : %12.0f replies/s\n", oldRate);
+    std::printf("FtpReply   : %12.0f replies/s\n", newRate);
+    std::printf("speedup    : %12.1fx\n", newRate / oldRate);
+    //防止编译器把计算优化掉，同时检查两种写法结果一致
+    std::printf("checksum   : %lld %lld\n", checksumOld / 20000,
+                checksumNew / 2000000);
+    return 0;
+}
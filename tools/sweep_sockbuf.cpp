@@ -0,0 +1,210 @@
+//数据连接收发缓冲区大小的扫描测试
+//依次用不同的 SO_SNDBUF / SO_RCVBUF 发送同样多的数据，输出吞吐量曲线，
+//用来为 TransferScheduler::setLinkEstimate() 找合适的带宽时延积
+//
+//不指定服务器时在本机回环地址上起一个接收端；回环地址没有时延，
+//可以用 netem 模拟长肥管道（需要 root，测完记得删除）：
+//  tc qdisc add dev lo root netem delay 20ms
+//  tc qdisc del dev lo root
+//也可以指定一个收到数据就丢弃、对方关闭写端后也关闭连接的服务器，如
+//  nc -l -N 9000 > /dev/null
+//
+//编译运行：
+//  g++ -std=c++17 -O2 tools/sweep_sockbuf.cpp src/Socket.cpp -lpthread -o sweep_sockbuf
+//  ./sweep_sockbuf [MiB] [host port]
+#include "../include/Socket.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace
+{
+    const int CHUNK_SIZE = 256 * 1024;
+    //曲线中最快一项的长度
+    const int BAR_WIDTH = 50;
+
+    struct Row
+    {
+        std::string label;
+        int effective;
+        double rate;
+    };
+
+    /**
+     * @brief 在本机回环地址上监听，接收缓冲区在 listen() 前设置，
+     * accept() 得到的连接继承这个值
+     * @return 监听的 socket，port 为系统分配的端口
+     */
+    SOCKET listenLocal(const utils::SocketProfile &profile, int &port)
+    {
+        SOCKET sock = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+        if (sock == INVALID_SOCKET)
+            return INVALID_SOCKET;
+        utils::applySocketProfile(sock, profile);
+        sockaddr_in addr{};
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        addr.sin_port = 0;
+        socklen_t len = sizeof(addr);
+        if (bind(sock, (sockaddr *)&addr, sizeof(addr)) != 0 ||
+            listen(sock, 1) != 0 ||
+            getsockname(sock, (sockaddr *)&addr, &len) != 0)
+        {
+            closesocket(sock);
+            return INVALID_SOCKET;
+        }
+        port = ntohs(addr.sin_port);
+        return sock;
+    }
+
+    //接收端：收到对方关闭为止，丢弃数据
+    void sinkOne(SOCKET listenSock)
+    {
+        SOCKET sock = accept(listenSock, nullptr, nullptr);
+        if (sock == INVALID_SOCKET)
+            return;
+        std::vector<char> buffer(CHUNK_SIZE);
+        while (recv(sock, buffer.data(), int(buffer.size()), 0) > 0)
+            ;
+        closesocket(sock);
+    }
+
+    SOCKET connectTo(const std::string &host, const std::string &port,
+                     const utils::SocketProfile &profile)
+    {
+        addrinfo hints{};
+        hints.ai_family = AF_UNSPEC;
+        hints.ai_socktype = SOCK_STREAM;
+        hints.ai_protocol = IPPROTO_TCP;
+        addrinfo *result = nullptr;
+        if (getaddrinfo(host.c_str(), port.c_str(), &hints, &result) != 0)
+            return INVALID_SOCKET;
+        SOCKET sock = INVALID_SOCKET;
+        for (addrinfo *ptr = result; ptr != nullptr; ptr = ptr->ai_next)
+        {
+            sock = socket(ptr->ai_family, ptr->ai_socktype, ptr->ai_protocol);
+            if (sock == INVALID_SOCKET)
+                continue;
+            utils::prepareSocket(sock);
+            utils::applySocketProfile(sock, profile);
+            if (connect(sock, ptr->ai_addr, (int)ptr->ai_addrlen) == 0)
+                break;
+            closesocket(sock);
+            sock = INVALID_SOCKET;
+        }
+        freeaddrinfo(result);
+        return sock;
+    }
+
+    /**
+     * @brief 发送 total 字节，等对方关闭连接
+     * @return 吞吐量（MiB/s），失败时为负数
+     */
+    double sendAndWait(SOCKET sock, long long total)
+    {
+        std::vector<char> buffer(CHUNK_SIZE, 'x');
+        auto begin = std::chrono::steady_clock::now();
+        long long sent = 0;
+        while (sent < total)
+        {
+            int len = int(std::min<long long>(CHUNK_SIZE, total - sent));
+            int ret = send(sock, buffer.data(), len, utils::SEND_FLAGS);
+            if (ret <= 0)
+                return -1;
+            sent += ret;
+        }
+        //关闭写端，对方读完所有数据后关闭连接，计时才包括在途的数据
+        shutdown(sock, 1);
+        while (recv(sock, buffer.data(), int(buffer.size()), 0) > 0)
+            ;
+        auto end = std::chrono::steady_clock::now();
+        double seconds = std::chrono::duration<double>(end - begin).count();
+        return double(total) / (1024 * 1024) / seconds;
+    }
+
+    //内核实际使用的缓冲区大小，Linux 上是设置值的两倍
+    int effectiveBufferSize(SOCKET sock)
+    {
+        int size = 0;
+        socklen_t len = sizeof(size);
+        getsockopt(sock, SOL_SOCKET, SO_SNDBUF, (char *)&size, &len);
+        return size;
+    }
+} // namespace
+
+int main(int argc, char *argv[])
+{
+    long long megabytes = argc > 1 ? std::atoll(argv[1]) : 256;
+    const bool isLocal = argc < 4;
+    if (megabytes <= 0 || !utils::initSockets())
+    {
+        std::fprintf(stderr, "usage: %s [MiB] [host port]\n", argv[0]);
+        return 1;
+    }
+    const long long total = megabytes * 1024 * 1024;
+
+    // 0 表示系统默认值，即内核的自动调整
+    std::vector<int> sizes = {0};
+    for (int size = utils::MIN_SOCKET_BUFFER_SIZE;
+         size <= utils::MAX_SOCKET_BUFFER_SIZE; size *= 2)
+        sizes.push_back(size);
+
+    std::vector<Row> rows;
+    for (int size : sizes)
+    {
+        utils::SocketProfile profile;
+        profile.bufferSize = size;
+
+        std::string host = isLocal ? "127.0.0.1" : argv[2];
+        std::string port = isLocal ? std::string() : argv[3];
+        SOCKET listenSock = INVALID_SOCKET;
+        std::thread sink;
+        if (isLocal)
+        {
+            int localPort = 0;
+            listenSock = listenLocal(profile, localPort);
+            if (listenSock == INVALID_SOCKET)
+                return 1;
+            port = std::to_string(localPort);
+            sink = std::thread(sinkOne, listenSock);
+        }
+
+        Row row;
+        row.label = size == 0 ? "default" : std::to_string(size / 1024) + "K";
+        row.effective = 0;
+        row.rate = -1;
+        SOCKET sock = connectTo(host, port, profile);
+        if (sock != INVALID_SOCKET)
+        {
+            row.effective = effectiveBufferSize(sock);
+            row.rate = sendAndWait(sock, total);
+            closesocket(sock);
+        }
+        if (sink.joinable())
+            sink.join();
+        if (listenSock != INVALID_SOCKET)
+            closesocket(listenSock);
+        rows.push_back(row);
+    }
+
+    double maxRate = 0;
+    for (const Row &row : rows)
+        maxRate = std::max(maxRate, row.rate);
+    std::printf("%10s %12s %10s\n", "buffer", "effective", "MiB/s");
+    for (const Row &row : rows)
+    {
+        if (row.rate < 0)
+        {
+            std::printf("%10s %12s %10s\n", row.label.c_str(), "-", "failed");
+            continue;
+        }
+        std::string bar(std::size_t(row.rate / maxRate * BAR_WIDTH), '#');
+        std::printf("%10s %12d %10.1f %s\n", row.label.c_str(), row.effective,
+                    row.rate, bar.c_str());
+    }
+    return 0;
+}